@@ -0,0 +1,9 @@
+// Comment openers inside literals and quotes inside comments, don't open anything
+const char *url = "http://example.com/*"; int after_url;
+const char *star = "*/"; char quote = '"'; const char *apostrophe = "it's";
+/* a "quoted */ int after_block; /* it's */ int after_apostrophe;
+/* a block comment // with a line comment inside */ int after_nested;
+// a line comment /* with a block opener
+int after_line; char slash = '/'; char star_char = '*';
+/**/ int empty; /*/ still a comment */ int after_odd; /* closed */*int_ptr;
+int escaped = "\"//"[0] + '\'' + "/*\\"[1];
@@ -0,0 +1,36 @@
+namespace geometry {
+    class Point final {
+    public:
+        constexpr Point(int x, int y) noexcept : x_(x), y_(y) {}
+        auto operator<=>(const Point &) const = default;
+
+    private:
+        int x_;
+        int y_;
+    };
+}
+
+template <typename T>
+struct Holder {
+    T value;
+    int T::*member;
+};
+
+int main() {
+    geometry::Point p(1, 2);
+    int Holder<int>::*pm = nullptr;
+    Holder<int> *h = nullptr;
+    (h->*pm) = 1;
+    ((*h).*pm) = 2;
+
+    const char *raw = R"(a "quoted" // not a comment)";
+    const char *delim = R"end(text )" still raw)end";
+    const char *u8raw = u8R"(utf8)";
+    const wchar_t *wraw = LR"(wide)";
+    const char *path = R"(C:\dir\file)";
+
+    bool flag = p == p and not false or true;
+    static_assert(sizeof(int) >= 2, "int too small");
+
+    return flag ? 0 : 1;
+}
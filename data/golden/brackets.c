@@ -0,0 +1,7 @@
+// Brackets in comments and literals are not tokens: ( [ {
+) int f(int a[2]) {
+    if (a[0] == ")") { return a[1]; } /* } ] ) */
+    char c = '{'; char *s = "([{";
+    return (a[0];
+}
+]
@@ -0,0 +1,4 @@
+// Nesting deeper than a vector of tokens, and pairs that straddle vector boundaries
+int deep = ((((((((((((((((((((((((((((((((((((((((1))))))))))))))))))))))))))))))))))))))));
+int mixed[] = {{(a[0])}, {(a[1])}, {(a[2])}, {(a[3])}, {(a[4])}, {(a[5])}, {(a[6])}, {(a[7])}, {(a[8])}, {(a[9])}, {(a[10])}, {(a[11])}, };
+void f(void) { if (x) { while (y[z[0]]) { g((h), [i]); } } }
@@ -0,0 +1,4 @@
+int a = 1;
+int b @ 2;
+  int c = $d;
+/* open
\ No newline at end of file
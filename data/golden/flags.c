@@ -0,0 +1,11 @@
+f();
+#define X \
+  1
+  int a;/* c */int b; // d
+	x = y
+/* multi
+ line */ z;
+w\
+v =
+
+  u;
\ No newline at end of file
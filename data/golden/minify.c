@@ -0,0 +1,17 @@
+/* Minified with comments and white space removed */
+#include <stdio.h>
+
+// Comment openers inside literals are kept
+static const char *url = "http://example.com";   // trailing comment
+static const char *pattern = "/* not a comment */";
+
+int spl\
+iced = 1;   // An identifier split by a splice \
+and a comment continued by one
+
+int main(void) {
+    printf("%s %s %d\n",
+           url, pattern,
+           spliced);
+    return 0;
+}
@@ -0,0 +1,2 @@
+int a;
+char c = 'x
\ No newline at end of file
@@ -0,0 +1 @@
+auto s = R"(x)"
\ No newline at end of file
@@ -0,0 +1,9 @@
+// Numbers only match a pattern with their whole spelling
+double a = 1.5;
+int b = 1;
+float c = 1.25e3;
+long d = 10;
+int e = x+1;
+unsigned f = 1u;
+int g = 1
+;
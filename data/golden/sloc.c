@@ -0,0 +1,19 @@
+// Comment only
+#include <stdio.h>
+
+/* Block comment
+   over three lines
+
+*/
+int main(void) {    // Code with a trailing comment
+    /* Leading comment */ int a = 1;
+    char *s = "// not a comment";
+    char *t = "/* not a comment either */";
+    	 
+    int b = 2; /* Comment opened after code
+    still a comment */
+    // Comment continued by a splice \
+    on the next line
+    return a + b;   /* closed */ /* and opened again
+    */ }
+/* last line without newline */
\ No newline at end of file
@@ -0,0 +1,9 @@
+// Identifiers interned to the same symbol when they are spelled the same
+int spliced_ident\
+ifier = 1;
+int spliced_ident = 2;
+int a_rather_long_identifier_that_spans_more_than_one_vector = spliced_identifier;
+int café = spliced_ident + a_rather_long_identifier_that_spans_more_than_one_vector;
+static int twice(int x) { return x + x; }
+int main(void) { return twice(café) + twice(spliced_ident\
+ifier); }
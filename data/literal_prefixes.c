@@ -0,0 +1,11 @@
+// Encoding-prefixed literals and line splices.
+
+const char *narrow = "plain";
+const char *utf8 = u8"utf-8";
+const int *wide = L"wide";
+int chars = L'w' + u'x' + U'y' + 'z';
+
+int spliced_ident\
+ifier = 12\
+34; // comment continued \
+on the next line
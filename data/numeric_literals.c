@@ -0,0 +1,20 @@
+// Numeric constants that must lex as a single pp-number.
+
+static const double coefficients[] = {
+    1e-5, 0x1p+3, 1.5e+10f, .5, 1., 2.5E-7L,
+    0x1.8p-1, 6.02214076e+23, -3.0e+00
+};
+
+// C23 digit separators, also next to an exponent sign
+static const long separated[] = { 1'000, 0x1'FF, 0b1'0 };
+
+// Padded so that the sign of 1'0e-5 and the separator of 123'456 start a 32-byte block
+static const double scaled =                            1'0e-5 + 2'5E+3;
+static const long straddle =                    123'456;
+
+int main() {
+    int mask = 0b1010 | 0xFFu | 017;
+    long big = 123456789012345678LL;
+    double x = coefficients[0] - 1e-5 + .25e-3;
+    return mask + big - 1 + (int) x;
+}
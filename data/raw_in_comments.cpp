@@ -0,0 +1,12 @@
+// Raw string openers inside comments and other literals open nothing
+// example: R"(
+int a = 1;
+/* R"( */ int b;
+auto s = R"(x // y)" "R\"(" + 2;
+
+/* a long block comment that spans more than one vector R"( and
+   continues R"x( here */ int c = R"y(raw // not a comment
+/* not a comment either )y"; // trailing R"( comment
+const char *d = "R\"(" ; char e = 'R'; auto f = u8R"(x)" LR"(y)";
+int g; // R"z(
+int h;
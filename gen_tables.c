@@ -0,0 +1,677 @@
+/*
+ * Build time generator for the token tables.
+ *
+ * Reads the token specification in tokens.def and writes:
+ *  - token_types.h: the TokenType enum with collision free codes,
+ *  - token_tables.h: the constant tables of the punctuator sub lexers and
+ *    the keyword lists with their perfect hash multipliers,
+ *  - token_names.c: token names and spellings used when printing, and the
+ *    translation between TokenType and the public token codes,
+ *  - simdlex_tokens.h: the public SimdLexToken enum included by simdlex.h.
+ *
+ * Fails if the specification cannot be encoded without conflicts.
+ *
+ * Usage: gen_tables <output directory>
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define D_C     (1 << 0)
+#define D_CPP   (1 << 1)
+#define D_ALL   (D_C | D_CPP)
+
+#define TOK_BODY_CODE 255
+
+#define KEYWORD_HASH_MIN_BITS 9
+#define KEYWORD_HASH_MAX_BITS 12
+#define KEYWORD_MAX_LEN 16
+
+typedef enum SpecKind SpecKind;
+enum SpecKind {
+    SPEC_PUNCT,
+    SPEC_KEYWORD,
+    SPEC_ALT_KEYWORD,
+    SPEC_TEXT
+};
+
+typedef struct SpecEntry SpecEntry;
+struct SpecEntry {
+    SpecKind kind;
+    const char *name;           // Enum name without TOK_ (target punctuator for alternative tokens)
+    const char *spelling;
+    const char *clang_name;
+    const char *comment;
+    int dialects;
+    int code;                   // Fixed code, or -1 if assigned here
+    bool remapped;              // Multi-byte punctuator whose byte sum collides
+    int public_code;            // SIMDLEX_TOKEN_ code, stable across changes of the internal codes
+};
+
+static SpecEntry spec[] = {
+#define PUNCT(name, spelling, clang_name, dialects) \
+    {SPEC_PUNCT, #name, spelling, clang_name, NULL, dialects, -1, false},
+#define KEYWORD(name, spelling, dialects) \
+    {SPEC_KEYWORD, #name, spelling, spelling, NULL, dialects, -1, false},
+#define ALT_KEYWORD(spelling, punct_name, dialects) \
+    {SPEC_ALT_KEYWORD, #punct_name, spelling, NULL, NULL, dialects, -1, false},
+#define TEXT_TOKEN(name, code, clang_name, comment) \
+    {SPEC_TEXT, #name, NULL, clang_name, comment, D_ALL, code, false},
+#include "tokens.def"
+#undef PUNCT
+#undef KEYWORD
+#undef ALT_KEYWORD
+#undef TEXT_TOKEN
+};
+
+static const int spec_size = sizeof(spec) / sizeof(spec[0]);
+
+static const char *code_owner[256];
+
+static void fail(const char *message, const char *name) {
+    fprintf(stderr, "gen_tables: %s: %s\n", message, name);
+    exit(1);
+}
+
+static void claim_code(int code, const char *name) {
+    if (code < 0 || code > 255)
+        fail("token code out of range", name);
+
+    if (code_owner[code] != NULL) {
+        fprintf(stderr, "gen_tables: %s and %s share code %d\n", code_owner[code], name, code);
+        exit(1);
+    }
+
+    code_owner[code] = name;
+}
+
+static int next_free_code(int from, int step) {
+    for (int code = from; code >= 0 && code <= 255; code += step) {
+        if (code_owner[code] == NULL)
+            return code;
+    }
+
+    fail("out of token codes", "");
+    return -1;
+}
+
+static int arithmetic_code(const char *spelling) {
+    const int len = strlen(spelling);
+    const uint8_t a = spelling[0];
+
+    if (len == 1)
+        return a;
+
+    const uint8_t b = spelling[1];
+
+    if (len == 2)   // Saturated add, then - 2
+        return (a + b > 255 ? 255 : a + b) - 2;
+
+    return (uint8_t) (a + b + spelling[2]);
+}
+
+static SpecEntry *find_punct(const char *name) {
+    for (int i = 0; i < spec_size; ++i) {
+        if (spec[i].kind == SPEC_PUNCT && strcmp(spec[i].name, name) == 0)
+            return &spec[i];
+    }
+
+    fail("unknown punctuator", name);
+    return NULL;
+}
+
+static bool is_ident_byte(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+static void assign_codes(void) {
+    claim_code(TOK_BODY_CODE, "BODY");
+
+    for (int i = 0; i < spec_size; ++i) {
+        if (spec[i].kind == SPEC_TEXT)
+            claim_code(spec[i].code, spec[i].name);
+    }
+
+    // One byte punctuators are their ASCII code
+    for (int i = 0; i < spec_size; ++i) {
+        SpecEntry *entry = &spec[i];
+
+        if (entry->kind != SPEC_PUNCT)
+            continue;
+
+        const int len = strlen(entry->spelling);
+        if (len < 1 || len > 3)
+            fail("punctuators must have one to three bytes", entry->name);
+
+        for (int j = 0; j < len; ++j) {
+            if (is_ident_byte(entry->spelling[j]) || entry->spelling[j] <= ' ' || entry->spelling[j] > '~')
+                fail("invalid punctuator byte", entry->name);
+        }
+
+        if (len > 1 && entry->dialects != D_ALL && entry->dialects != D_CPP)
+            fail("multi-byte punctuators must be in all dialects or C++ only", entry->name);
+
+        if (len == 1) {
+            if (entry->dialects != D_ALL)
+                fail("one byte punctuators must be in all dialects", entry->name);
+
+            entry->code = arithmetic_code(entry->spelling);
+            claim_code(entry->code, entry->name);
+        }
+    }
+
+    // Multi-byte punctuators use their byte sum if it is free
+    for (int i = 0; i < spec_size; ++i) {
+        SpecEntry *entry = &spec[i];
+
+        if (entry->kind != SPEC_PUNCT || strlen(entry->spelling) == 1)
+            continue;
+
+        const int code = arithmetic_code(entry->spelling);
+
+        if (code_owner[code] == NULL) {
+            entry->code = code;
+            claim_code(entry->code, entry->name);
+        }
+    }
+
+    // Collisions get a code from the top of the free range
+    for (int i = 0; i < spec_size; ++i) {
+        SpecEntry *entry = &spec[i];
+
+        if (entry->kind != SPEC_PUNCT || entry->code >= 0)
+            continue;
+
+        entry->code = next_free_code(TOK_BODY_CODE - 1, -1);
+        entry->remapped = true;
+        claim_code(entry->code, entry->name);
+    }
+
+    // Keywords take the lowest free codes in order
+    for (int i = 0; i < spec_size; ++i) {
+        SpecEntry *entry = &spec[i];
+
+        if (entry->kind == SPEC_KEYWORD) {
+            entry->code = next_free_code(0, 1);
+            claim_code(entry->code, entry->name);
+        }
+    }
+
+    // Alternative tokens share the code of their punctuator
+    for (int i = 0; i < spec_size; ++i) {
+        SpecEntry *entry = &spec[i];
+
+        if (entry->kind == SPEC_ALT_KEYWORD)
+            entry->code = find_punct(entry->name)->code;
+    }
+}
+
+// Public codes follow the order of tokens.def, after the fixed codes of EOF, IDENT and NUM
+static int assign_public_codes(void) {
+    int next = 0;
+
+    for (int i = 0; i < spec_size; ++i) {
+        if (spec[i].kind == SPEC_TEXT && spec[i].code < 3) {
+            spec[i].public_code = spec[i].code;
+            next = next > spec[i].code + 1 ? next : spec[i].code + 1;
+        }
+    }
+
+    if (next != 3)
+        fail("EOF, IDENT and NUM must have the codes 0, 1 and 2", "");
+
+    for (int i = 0; i < spec_size; ++i) {
+        SpecEntry *entry = &spec[i];
+
+        if (entry->kind == SPEC_ALT_KEYWORD)
+            entry->public_code = find_punct(entry->name)->public_code;
+        else if (entry->kind != SPEC_TEXT || entry->code >= 3)
+            entry->public_code = next++;
+    }
+
+    if (next > 255)
+        fail("out of public token codes", "");
+
+    return next;
+}
+
+static void check_keywords(void) {
+    for (int i = 0; i < spec_size; ++i) {
+        const SpecEntry *entry = &spec[i];
+
+        if (entry->kind != SPEC_KEYWORD && entry->kind != SPEC_ALT_KEYWORD)
+            continue;
+
+        const int len = strlen(entry->spelling);
+        if (len == 0 || len > KEYWORD_MAX_LEN)
+            fail("keyword length out of range", entry->spelling);
+
+        for (int j = 0; j < len; ++j) {
+            if (!is_ident_byte(entry->spelling[j]) || (j == 0 && entry->spelling[j] <= '9'))
+                fail("keyword is not an identifier", entry->spelling);
+        }
+
+        for (int j = i + 1; j < spec_size; ++j) {
+            if ((spec[j].kind == SPEC_KEYWORD || spec[j].kind == SPEC_ALT_KEYWORD)
+                && strcmp(entry->spelling, spec[j].spelling) == 0)
+                fail("duplicate keyword", entry->spelling);
+        }
+    }
+}
+
+// Same hash as the lexer: fold the first 8 bytes to 32 bits, multiply, keep the top bits
+static uint32_t keyword_hash(const char *spelling, uint32_t multiplier, int bits) {
+    char padded[8] = {0};
+    memcpy(padded, spelling, strlen(spelling) < 8 ? strlen(spelling) : 8);
+
+    uint64_t val;
+    memcpy(&val, padded, sizeof(val));
+
+    return (uint32_t) ((((val >> 32) ^ val) & 0xffffffff) * multiplier) >> (32 - bits);
+}
+
+static bool is_collision_free(const SpecEntry **keywords, int count, uint32_t multiplier, int bits) {
+    static bool used[1 << KEYWORD_HASH_MAX_BITS];
+    memset(used, 0, sizeof(used));
+
+    for (int i = 0; i < count; ++i) {
+        const uint32_t h = keyword_hash(keywords[i]->spelling, multiplier, bits);
+
+        if (used[h] || h == 0)  // Slot 0 is the empty entry
+            return false;
+
+        used[h] = true;
+    }
+
+    return true;
+}
+
+static int dialect_keywords(int dialect, const SpecEntry **keywords) {
+    int count = 0;
+
+    for (int i = 0; i < spec_size; ++i) {
+        if ((spec[i].kind == SPEC_KEYWORD || spec[i].kind == SPEC_ALT_KEYWORD) && (spec[i].dialects & dialect))
+            keywords[count++] = &spec[i];
+    }
+
+    return count;
+}
+
+// Deterministic search for a multiplier without collisions
+static uint32_t find_multiplier(const SpecEntry **keywords, int count, int bits) {
+    uint64_t state = 0x9E3779B97F4A7C15;
+
+    for (int attempt = 0; attempt < 1 << 24; ++attempt) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+
+        const uint32_t multiplier = (uint32_t) (state >> 32) | 1;
+
+        if (is_collision_free(keywords, count, multiplier, bits))
+            return multiplier;
+    }
+
+    return 0;
+}
+
+static FILE *open_output(const char *dir, const char *file_name) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%s", dir, file_name);
+
+    FILE *file = fopen(path, "w");
+    if (file == NULL)
+        fail("cannot open output file", path);
+
+    fprintf(file, "// Generated by gen_tables from tokens.def. Do not edit.\n\n");
+
+    return file;
+}
+
+static const char *section_comment(const SpecEntry *entry) {
+    if (entry->kind == SPEC_KEYWORD)
+        return entry->dialects == D_CPP ? "C++ keywords" : "Keywords";
+
+    if (entry->kind == SPEC_TEXT)
+        return "Tokens with text";
+
+    const int len = strlen(entry->spelling);
+    const char *sections[2][3] = {
+        {"One byte punctuators", "Two byte punctuators", "Three byte punctuators"},
+        {"C++ one byte punctuators", "C++ two byte punctuators", "C++ three byte punctuators"}
+    };
+
+    return sections[entry->dialects == D_CPP][len - 1];
+}
+
+static void write_token_types(const char *dir, int hash_bits, int max_keywords) {
+    FILE *file = open_output(dir, "token_types.h");
+
+    fprintf(file, "#ifndef TOKEN_TYPES_H\n#define TOKEN_TYPES_H\n\n#include <stdint.h>\n\n");
+    fprintf(file, "#define KEYWORD_HASH_BITS %d\n", hash_bits);
+    fprintf(file, "#define KEYWORD_MAX_LEN %d\n", KEYWORD_MAX_LEN);
+    fprintf(file, "#define KEYWORD_TABLE_SIZE %d\n\n", max_keywords + 1);
+
+    fprintf(file, "typedef enum : uint8_t {");
+
+    const char *section = NULL;
+
+    for (int i = 0; i < spec_size; ++i) {
+        const SpecEntry *entry = &spec[i];
+
+        if (entry->kind == SPEC_ALT_KEYWORD)
+            continue;
+
+        if (section == NULL || strcmp(section, section_comment(entry)) != 0) {
+            section = section_comment(entry);
+            fprintf(file, "\n    // %s\n", section);
+        }
+
+        char decl[64];
+        snprintf(decl, sizeof(decl), "TOK_%s = %d,", entry->name, entry->code);
+
+        if (entry->kind == SPEC_TEXT) {
+            fprintf(file, "    %-36s// %s\n", decl, entry->comment);
+        } else if (entry->remapped) {
+            fprintf(file, "    %-36s// %s (Byte sum collides with TOK_%s)\n", decl, entry->spelling,
+                    code_owner[arithmetic_code(entry->spelling)]);
+        } else {
+            fprintf(file, "    %-36s// %s\n", decl, entry->spelling);
+        }
+    }
+
+    fprintf(file, "\n    %-36s// Token body\n", "TOK_BODY = 255,");
+    fprintf(file, "} TokenType;\n\n#endif //TOKEN_TYPES_H\n");
+    fclose(file);
+}
+
+// Distinct bytes at position pos of multi-byte punctuators of length len, common ones first
+static int punct_bytes(int len, int pos, char *bytes, int *common_count) {
+    int count = 0;
+
+    for (int pass = 0; pass < 2; ++pass) {
+        const int dialects = pass == 0 ? D_ALL : D_CPP;
+
+        for (int i = 0; i < spec_size; ++i) {
+            if (spec[i].kind != SPEC_PUNCT || strlen(spec[i].spelling) != len || spec[i].dialects != dialects)
+                continue;
+
+            if (memchr(bytes, spec[i].spelling[pos], count) == NULL)
+                bytes[count++] = spec[i].spelling[pos];
+        }
+
+        if (pass == 0)
+            *common_count = count;
+    }
+
+    bytes[count] = '\0';
+
+    return count;
+}
+
+static void write_c_string(FILE *file, const char *str) {
+    fputc('"', file);
+
+    for (; *str; ++str) {
+        if (*str == '"' || *str == '\\')
+            fputc('\\', file);
+
+        fputc(*str, file);
+    }
+
+    fputc('"', file);
+}
+
+static void write_multi_byte_tables(FILE *file, int len, const char *prefix) {
+    const char *positions[3] = {"FIRST", "SECOND", "THIRD"};
+    char bytes[3][128];
+    int counts[3];
+
+    for (int pos = 0; pos < len; ++pos) {
+        int common_count = 0;
+        counts[pos] = punct_bytes(len, pos, bytes[pos], &common_count);
+
+        fprintf(file, "#define %s_%s_BYTES ", prefix, positions[pos]);
+        write_c_string(file, bytes[pos]);
+        fprintf(file, "\n#define %s_%s_COUNT_C %d\n", prefix, positions[pos], common_count);
+        fprintf(file, "#define %s_%s_COUNT %d\n", prefix, positions[pos], counts[pos]);
+    }
+
+    // {first index, second index, [third index,] remapped code or 0}, common ones first
+    int count = 0;
+    int common_count = 0;
+
+    fprintf(file, "#define %s_PUNCT_DATA \\\n", prefix);
+
+    for (int pass = 0; pass < 2; ++pass) {
+        const int dialects = pass == 0 ? D_ALL : D_CPP;
+
+        for (int i = 0; i < spec_size; ++i) {
+            const SpecEntry *entry = &spec[i];
+
+            if (entry->kind != SPEC_PUNCT || strlen(entry->spelling) != len || entry->dialects != dialects)
+                continue;
+
+            char data[64] = "{";
+
+            for (int pos = 0; pos < len; ++pos) {
+                const long idx = strchr(bytes[pos], entry->spelling[pos]) - bytes[pos];
+                snprintf(data + strlen(data), sizeof(data) - strlen(data), "%ld, ", idx);
+            }
+
+            snprintf(data + strlen(data), sizeof(data) - strlen(data), "%d},", entry->remapped ? entry->code : 0);
+            fprintf(file, "    %-20s/* %s */ \\\n", data, entry->spelling);
+            ++count;
+        }
+
+        if (pass == 0)
+            common_count = count;
+    }
+
+    fprintf(file, "\n#define %s_PUNCT_COUNT_C %d\n", prefix, common_count);
+    fprintf(file, "#define %s_PUNCT_COUNT %d\n\n", prefix, count);
+}
+
+static void write_one_byte_luts(FILE *file) {
+    // Low nibble table holds one bit per distinct high nibble
+    uint8_t low_lut[16] = {0};
+    uint8_t high_lut[16] = {0};
+    int classes = 0;
+
+    for (int i = 0; i < spec_size; ++i) {
+        const SpecEntry *entry = &spec[i];
+
+        if (entry->kind != SPEC_PUNCT || strlen(entry->spelling) != 1)
+            continue;
+
+        const uint8_t c = entry->spelling[0];
+
+        if (high_lut[c >> 4] == 0) {
+            if (classes == 8)
+                fail("one byte punctuators span more than 8 high nibbles", entry->name);
+
+            high_lut[c >> 4] = 1 << classes++;
+        }
+
+        low_lut[c & 0x0F] |= high_lut[c >> 4];
+    }
+
+    // Verify the classification matches exactly the one byte punctuators
+    for (int c = 0; c < 256; ++c) {
+        const bool classified = c < 0x80 && (low_lut[c & 0x0F] & high_lut[c >> 4]);
+        bool is_punct = false;
+
+        for (int i = 0; i < spec_size; ++i) {
+            if (spec[i].kind == SPEC_PUNCT && strlen(spec[i].spelling) == 1 && (uint8_t) spec[i].spelling[0] == c)
+                is_punct = true;
+        }
+
+        if (classified != is_punct)
+            fail("one byte lookup tables are inexact", "");
+    }
+
+    fprintf(file, "// Nibble lookup tables (_mm256_setr_epi8 order) classifying one byte punctuators\n");
+    fprintf(file, "#define ONE_BYTE_PUNCT_LOW_NIBBLES ");
+    for (int i = 0; i < 16; ++i)
+        fprintf(file, "%d%s", low_lut[i], i < 15 ? ", " : "\n");
+
+    fprintf(file, "#define ONE_BYTE_PUNCT_HIGH_NIBBLES ");
+    for (int i = 0; i < 16; ++i)
+        fprintf(file, "%d%s", high_lut[i], i < 15 ? ", " : "\n\n");
+}
+
+static void write_keyword_list(FILE *file, const char *prefix, const SpecEntry **keywords, int count,
+                               uint32_t multiplier) {
+    fprintf(file, "#define %s_KEYWORD_MULTIPLIER %uu\n", prefix, multiplier);
+    fprintf(file, "#define %s_KEYWORDS \\\n", prefix);
+
+    for (int i = 0; i < count; ++i) {
+        fprintf(file, "    {\"%s\", TOK_%s}, \\\n", keywords[i]->spelling,
+                keywords[i]->kind == SPEC_KEYWORD ? keywords[i]->name : find_punct(keywords[i]->name)->name);
+    }
+
+    fprintf(file, "\n");
+}
+
+static void write_token_tables(const char *dir, int hash_bits, const SpecEntry **c_keywords, int c_count,
+                               uint32_t c_multiplier, const SpecEntry **cpp_keywords, int cpp_count,
+                               uint32_t cpp_multiplier) {
+    FILE *file = open_output(dir, "token_tables.h");
+
+    fprintf(file, "#ifndef TOKEN_TABLES_H\n#define TOKEN_TABLES_H\n\n");
+
+    write_one_byte_luts(file);
+
+    fprintf(file, "// Two byte punctuators (C++ only ones last)\n");
+    write_multi_byte_tables(file, 2, "TWO_BYTE");
+
+    fprintf(file, "// Three byte punctuators (C++ only ones last)\n");
+    write_multi_byte_tables(file, 3, "THREE_BYTE");
+
+    fprintf(file, "// Keywords with collision free hash multipliers for %d bit lookup tables\n", hash_bits);
+    write_keyword_list(file, "C", c_keywords, c_count, c_multiplier);
+    write_keyword_list(file, "CPP", cpp_keywords, cpp_count, cpp_multiplier);
+
+    fprintf(file, "#endif //TOKEN_TABLES_H\n");
+    fclose(file);
+}
+
+static void write_public_tokens(const char *dir, int count) {
+    FILE *file = open_output(dir, "simdlex_tokens.h");
+
+    fprintf(file, "#ifndef SIMDLEX_TOKENS_H\n#define SIMDLEX_TOKENS_H\n\n");
+    fprintf(file, "// Token types returned by simdlex_token_type, in the order of tokens.def\n");
+    fprintf(file, "typedef enum SimdLexToken SimdLexToken;\nenum SimdLexToken {");
+
+    const char *section = NULL;
+
+    for (int i = 0; i < spec_size; ++i) {
+        const SpecEntry *entry = &spec[i];
+
+        if (entry->kind == SPEC_ALT_KEYWORD)
+            continue;
+
+        if (section == NULL || strcmp(section, section_comment(entry)) != 0) {
+            section = section_comment(entry);
+            fprintf(file, "\n    // %s\n", section);
+        }
+
+        char decl[64];
+        snprintf(decl, sizeof(decl), "SIMDLEX_TOKEN_%s = %d,", entry->name, entry->public_code);
+        fprintf(file, "    %-44s// %s\n", decl, entry->kind == SPEC_TEXT ? entry->comment : entry->spelling);
+    }
+
+    char decl[64];
+    snprintf(decl, sizeof(decl), "SIMDLEX_TOKEN_COUNT = %d", count);
+    fprintf(file, "\n    %-44s// Number of token types\n", decl);
+    fprintf(file, "};\n\n#endif //SIMDLEX_TOKENS_H\n");
+
+    fclose(file);
+}
+
+static void write_token_names(const char *dir) {
+    FILE *file = open_output(dir, "token_names.c");
+
+    fprintf(file, "#include \"simdlex_tokens.h\"\n#include \"tokens.h\"\n\n");
+
+    fprintf(file, "const char *const token_names[256] = {\n");
+    for (int i = 0; i < spec_size; ++i) {
+        if (spec[i].kind != SPEC_ALT_KEYWORD)
+            fprintf(file, "    [TOK_%s] = \"%s\",\n", spec[i].name, spec[i].clang_name);
+    }
+    fprintf(file, "};\n\n");
+
+    fprintf(file, "const char *const token_spellings[256] = {\n");
+    for (int i = 0; i < spec_size; ++i) {
+        if (spec[i].kind != SPEC_PUNCT && spec[i].kind != SPEC_KEYWORD)
+            continue;
+
+        fprintf(file, "    [TOK_%s] = ", spec[i].name);
+        write_c_string(file, spec[i].spelling);
+        fprintf(file, ",\n");
+    }
+    fprintf(file, "};\n\n");
+
+    fprintf(file, "const uint8_t public_token_types[256] = {\n");
+    for (int i = 0; i < spec_size; ++i) {
+        if (spec[i].kind != SPEC_ALT_KEYWORD)
+            fprintf(file, "    [TOK_%s] = SIMDLEX_TOKEN_%s,\n", spec[i].name, spec[i].name);
+    }
+    fprintf(file, "};\n\n");
+
+    fprintf(file, "const TokenType internal_token_types[256] = {\n");
+    for (int i = 0; i < spec_size; ++i) {
+        if (spec[i].kind != SPEC_ALT_KEYWORD)
+            fprintf(file, "    [SIMDLEX_TOKEN_%s] = TOK_%s,\n", spec[i].name, spec[i].name);
+    }
+    fprintf(file, "};\n");
+
+    fclose(file);
+}
+
+int main(int argc, char **argv) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: gen_tables <output directory>.\n");
+        return 1;
+    }
+
+    assign_codes();
+    const int public_count = assign_public_codes();
+    check_keywords();
+
+    const SpecEntry *c_keywords[256];
+    const SpecEntry *cpp_keywords[256];
+    const int c_count = dialect_keywords(D_C, c_keywords);
+    const int cpp_count = dialect_keywords(D_CPP, cpp_keywords);
+
+    // Smallest table size for which both dialects have a perfect hash
+    int hash_bits;
+    uint32_t c_multiplier = 0;
+    uint32_t cpp_multiplier = 0;
+
+    for (hash_bits = KEYWORD_HASH_MIN_BITS; hash_bits <= KEYWORD_HASH_MAX_BITS; ++hash_bits) {
+        c_multiplier = find_multiplier(c_keywords, c_count, hash_bits);
+        cpp_multiplier = find_multiplier(cpp_keywords, cpp_count, hash_bits);
+
+        if (c_multiplier && cpp_multiplier)
+            break;
+    }
+
+    if (!c_multiplier || !cpp_multiplier)
+        fail("no perfect hash for the keyword sets", "");
+
+    const int max_keywords = c_count > cpp_count ? c_count : cpp_count;
+    if (max_keywords >= 256)
+        fail("too many keywords", "");
+
+    write_token_types(argv[1], hash_bits, max_keywords);
+    write_token_tables(argv[1], hash_bits, c_keywords, c_count, c_multiplier, cpp_keywords, cpp_count,
+                       cpp_multiplier);
+    write_token_names(argv[1]);
+    write_public_tokens(argv[1], public_count);
+
+    return 0;
+}
@@ -0,0 +1,363 @@
+#include "intern.h"
+
+#include <immintrin.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define HASH_SEED 0x811C9DC5
+#define HASH_MULT 0x9E3779B1
+#define HASH_FINAL_MULT 0x85EBCA6B
+
+#define HASH_LANES 8
+
+static uint32_t next_power_of_two(uint32_t n) {
+    uint32_t p = 16;
+
+    while (p < n)
+        p <<= 1;
+
+    return p;
+}
+
+void symbol_table_init(SymbolTable *table, uint32_t capacity) {
+    table->capacity = next_power_of_two(capacity * 2);
+    table->size = 0;
+    table->slots = calloc(table->capacity, sizeof(SymbolSlot));
+
+    table->names_capacity = capacity < 16 ? 16 : capacity;
+    table->name_offsets = malloc(table->names_capacity * sizeof(uint32_t));
+    table->name_lengths = malloc(table->names_capacity * sizeof(uint32_t));
+
+    table->names_bytes = table->names_capacity * 16;
+    table->names_size = 0;
+    table->names = malloc(table->names_bytes);
+
+    if (table->slots == NULL || table->name_offsets == NULL || table->name_lengths == NULL || table->names == NULL) {
+        fprintf(stderr, "Memory allocation failure.\n");
+    }
+}
+
+void symbol_table_free(SymbolTable *table) {
+    free(table->slots);
+    free(table->name_offsets);
+    free(table->name_lengths);
+    free(table->names);
+}
+
+uint32_t symbol_hash(const char *str, uint32_t len) {
+    uint32_t hash = HASH_SEED;
+
+    // 4 bytes per step, the last step holds the 0 to 3 remaining bytes
+    for (uint32_t k = 0; ; k += 4) {
+        const uint32_t n = len - k < 4 ? len - k : 4;
+        uint32_t word = 0;
+        memcpy(&word, str + k, n);
+
+        hash = (hash ^ word) * HASH_MULT;
+        hash ^= hash >> 15;
+
+        if (n < 4)
+            break;
+    }
+
+    hash = (hash ^ len) * HASH_FINAL_MULT;
+
+    return hash ^ (hash >> 16);
+}
+
+static void grow_slots(SymbolTable *table) {
+    const uint32_t capacity = table->capacity * 2;
+    SymbolSlot *slots = calloc(capacity, sizeof(SymbolSlot));
+
+    if (slots == NULL) {
+        fprintf(stderr, "Memory allocation failure.\n");
+        return;
+    }
+
+    // Stored hashes avoid touching the names
+    for (uint32_t i = 0; i < table->capacity; ++i) {
+        if (table->slots[i].id == 0)
+            continue;
+
+        uint32_t pos = table->slots[i].hash & (capacity - 1);
+        while (slots[pos].id)
+            pos = (pos + 1) & (capacity - 1);
+
+        slots[pos] = table->slots[i];
+    }
+
+    free(table->slots);
+    table->slots = slots;
+    table->capacity = capacity;
+}
+
+static uint32_t add_name(SymbolTable *table, const char *str, uint32_t len) {
+    if (table->size == table->names_capacity) {
+        table->names_capacity *= 2;
+        table->name_offsets = realloc(table->name_offsets, table->names_capacity * sizeof(uint32_t));
+        table->name_lengths = realloc(table->name_lengths, table->names_capacity * sizeof(uint32_t));
+    }
+
+    while (table->names_size + len + 1 > table->names_bytes) {
+        table->names_bytes *= 2;
+        table->names = realloc(table->names, table->names_bytes);
+    }
+
+    if (table->name_offsets == NULL || table->name_lengths == NULL || table->names == NULL) {
+        fprintf(stderr, "Memory allocation failure.\n");
+        exit(1);
+    }
+
+    memcpy(table->names + table->names_size, str, len);
+    table->names[table->names_size + len] = '\0';
+
+    table->name_offsets[table->size] = table->names_size;
+    table->name_lengths[table->size] = len;
+    table->names_size += len + 1;
+
+    return table->size++;
+}
+
+static bool slot_matches(const SymbolTable *table, const SymbolSlot slot, const char *str, uint32_t len,
+                         uint32_t hash) {
+    const uint32_t id = slot.id - 1;
+
+    return slot.hash == hash
+        && table->name_lengths[id] == len
+        && memcmp(table->names + table->name_offsets[id], str, len) == 0;
+}
+
+uint32_t symbol_intern(SymbolTable *table, const char *str, uint32_t len, uint32_t hash) {
+    // Keep the load factor at most 1/2
+    if ((table->size + 1) * 2 > table->capacity)
+        grow_slots(table);
+
+    const uint32_t mask = table->capacity - 1;
+    uint32_t pos = hash & mask;
+
+    while (table->slots[pos].id) {
+        if (slot_matches(table, table->slots[pos], str, len, hash))
+            return table->slots[pos].id - 1;
+
+        pos = (pos + 1) & mask;
+    }
+
+    const uint32_t id = add_name(table, str, len);
+    table->slots[pos] = (SymbolSlot) { hash, id + 1 };
+
+    return id;
+}
+
+uint32_t symbol_lookup(const SymbolTable *table, const char *str, uint32_t len) {
+    const uint32_t hash = symbol_hash(str, len);
+    const uint32_t mask = table->capacity - 1;
+    uint32_t pos = hash & mask;
+
+    while (table->slots[pos].id) {
+        if (slot_matches(table, table->slots[pos], str, len, hash))
+            return table->slots[pos].id - 1;
+
+        pos = (pos + 1) & mask;
+    }
+
+    return SYMBOL_NONE;
+}
+
+const char *symbol_name(const SymbolTable *table, uint32_t id) {
+    return table->names + table->name_offsets[id];
+}
+
+static __m256i ident_bytes(const __m256i vector) {
+    // [0-9], [A-Z], [a-z], _ and bytes of multibyte code points
+    const __m256i digit = _mm256_and_si256(
+        _mm256_cmpgt_epi8(vector, _mm256_set1_epi8('0' - 1)),
+        _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), vector)
+    );
+
+    // Lower case letters after setting the 0x20 bit
+    const __m256i lower = _mm256_or_si256(vector, _mm256_set1_epi8(0x20));
+    const __m256i alpha = _mm256_and_si256(
+        _mm256_cmpgt_epi8(lower, _mm256_set1_epi8('a' - 1)),
+        _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), lower)
+    );
+
+    return _mm256_or_si256(
+        _mm256_or_si256(digit, alpha),
+        _mm256_or_si256(
+            _mm256_cmpeq_epi8(vector, _mm256_set1_epi8('_')),
+            _mm256_cmpgt_epi8(_mm256_setzero_si256(), vector)
+        )
+    );
+}
+
+/**
+ * Hash up to 8 identifiers, one per 32-bit lane. Each step gathers the
+ *  next 4 bytes of every identifier still active and keeps the bytes before
+ *  the first non identifier byte.
+ */
+static void hash_identifiers(const char *src, const uint32_t *locs, int count, uint32_t *hashes, uint32_t *lengths) {
+    const __m256i ones = _mm256_set1_epi32(1);
+
+    __m256i offsets = _mm256_loadu_si256((const __m256i *) locs);
+    __m256i active = _mm256_cmpgt_epi32(
+        _mm256_set1_epi32(count),
+        _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7)
+    );
+    __m256i hash = _mm256_set1_epi32(HASH_SEED);
+    __m256i len = _mm256_setzero_si256();
+
+    while (!_mm256_testz_si256(active, active)) {
+        const __m256i chunk = _mm256_mask_i32gather_epi32(
+            _mm256_setzero_si256(),
+            (const int *) src,
+            offsets,
+            active,
+            1
+        );
+
+        // Bytes before the lowest non identifier byte: (stop & -stop) - 1
+        const __m256i stop = _mm256_andnot_si256(ident_bytes(chunk), _mm256_set1_epi8(-1));
+        const __m256i keep = _mm256_sub_epi32(
+            _mm256_and_si256(stop, _mm256_sub_epi32(_mm256_setzero_si256(), stop)),
+            ones
+        );
+
+        __m256i mixed = _mm256_mullo_epi32(
+            _mm256_xor_si256(hash, _mm256_and_si256(chunk, keep)),
+            _mm256_set1_epi32(HASH_MULT)
+        );
+        mixed = _mm256_xor_si256(mixed, _mm256_srli_epi32(mixed, 15));
+
+        hash = _mm256_blendv_epi8(hash, mixed, active);
+
+        // Number of kept bytes: sum of their low bits
+        const __m256i kept = _mm256_srli_epi32(
+            _mm256_mullo_epi32(
+                _mm256_and_si256(keep, _mm256_set1_epi32(0x01010101)),
+                _mm256_set1_epi32(0x01010101)
+            ),
+            24
+        );
+        len = _mm256_add_epi32(len, _mm256_and_si256(kept, active));
+
+        // Identifiers continue while all 4 bytes were kept
+        active = _mm256_and_si256(active, _mm256_cmpeq_epi32(stop, _mm256_setzero_si256()));
+        offsets = _mm256_add_epi32(offsets, _mm256_set1_epi32(4));
+    }
+
+    hash = _mm256_mullo_epi32(_mm256_xor_si256(hash, len), _mm256_set1_epi32(HASH_FINAL_MULT));
+    hash = _mm256_xor_si256(hash, _mm256_srli_epi32(hash, 16));
+
+    _mm256_storeu_si256((__m256i *) hashes, hash);
+    _mm256_storeu_si256((__m256i *) lengths, len);
+}
+
+// Same bytes as ident_bytes
+static bool is_ident_byte(const char c) {
+    return (c >= '0' && c <= '9') || ((c | 0x20) >= 'a' && (c | 0x20) <= 'z') || c == '_' || (unsigned char) c >= 0x80;
+}
+
+static bool is_splice(const char *str) {
+    return str[0] == '\\' && str[1] == '\n';
+}
+
+/**
+ * Intern an identifier broken by line splices, which the vector hash
+ *  stops at. The name is its spelling with the splices removed.
+ */
+static uint32_t intern_spliced(SymbolTable *table, const char *src, uint32_t loc) {
+    uint32_t end = loc;
+
+    while (is_ident_byte(src[end]) || is_splice(src + end))
+        end += is_splice(src + end) ? 2 : 1;
+
+    char buffer[256];
+    char *name = end - loc <= sizeof(buffer) ? buffer : malloc(end - loc);
+
+    if (name == NULL) {
+        fprintf(stderr, "Memory allocation failure.\n");
+        exit(1);
+    }
+
+    uint32_t len = 0;
+
+    for (uint32_t k = loc; k < end; ++k) {
+        if (is_splice(src + k)) {
+            ++k;
+            continue;
+        }
+
+        name[len++] = src[k];
+    }
+
+    const uint32_t id = symbol_intern(table, name, len, symbol_hash(name, len));
+
+    if (name != buffer)
+        free(name);
+
+    return id;
+}
+
+static void intern_batch(TokenArray *tok_array, SymbolTable *table, const uint32_t *token_idx, int count) {
+    uint32_t locs[HASH_LANES] = {0};
+    uint32_t hashes[HASH_LANES];
+    uint32_t lengths[HASH_LANES];
+
+    for (int i = 0; i < count; ++i)
+        locs[i] = tok_array->token_locs[token_idx[i]];
+
+    hash_identifiers(tok_array->src, locs, count, hashes, lengths);
+
+    for (int i = 0; i < count; ++i) {
+        if (is_splice(tok_array->src + locs[i] + lengths[i])) {
+            tok_array->symbol_ids[token_idx[i]] = intern_spliced(table, tok_array->src, locs[i]);
+            continue;
+        }
+
+        tok_array->symbol_ids[token_idx[i]] = symbol_intern(
+            table,
+            tok_array->src + locs[i],
+            lengths[i],
+            hashes[i]
+        );
+    }
+}
+
+void intern_identifiers(TokenArray *tok_array, SymbolTable *table) {
+    if (tok_array->symbol_ids == NULL) {
+        if (posix_memalign((void **) &tok_array->symbol_ids, VECTOR_SIZE,
+                           (tok_array->capacity + VECTOR_SIZE) * sizeof(uint32_t))) {
+            fprintf(stderr, "Memory allocation failure.\n");
+            return;
+        }
+    }
+
+    uint32_t token_idx[HASH_LANES];
+    int count = 0;
+
+    for (uint64_t i = 0; i < tok_array->size; i += VECTOR_SIZE) {
+        const __m256i types = _mm256_loadu_si256((const __m256i *) (tok_array->token_types + i));
+
+        for (int j = 0; j < VECTOR_SIZE; j += 8) {
+            _mm256_store_si256((__m256i *) (tok_array->symbol_ids + i + j), _mm256_set1_epi32(SYMBOL_NONE));
+        }
+
+        uint32_t idents = _mm256_movemask_epi8(_mm256_cmpeq_epi8(types, _mm256_set1_epi8(TOK_IDENT)));
+
+        if (tok_array->size - i < VECTOR_SIZE)
+            idents &= (1u << (tok_array->size - i)) - 1;
+
+        while (idents) {
+            token_idx[count++] = i + __builtin_ctz(idents);
+            idents &= idents - 1;
+
+            if (count == HASH_LANES) {
+                intern_batch(tok_array, table, token_idx, count);
+                count = 0;
+            }
+        }
+    }
+
+    intern_batch(tok_array, table, token_idx, count);
+}
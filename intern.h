@@ -0,0 +1,90 @@
+#ifndef INTERN_H
+#define INTERN_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "tokens.h"
+
+/**
+ * Open addressing slot. The hash is stored next to the ID so probes only
+ *  touch the slot array (8 slots per cache line) until a hash matches.
+ */
+typedef struct SymbolSlot SymbolSlot;
+struct SymbolSlot {
+    uint32_t hash;
+    uint32_t id;                // Symbol ID + 1, 0 if the slot is empty
+};
+
+/**
+ * Interned identifiers with dense IDs starting at 0. Names are copied,
+ *  so a table can be shared by several lexed inputs.
+ */
+typedef struct SymbolTable SymbolTable;
+struct SymbolTable {
+    SymbolSlot *slots;
+    uint32_t capacity;          // Number of slots (power of two)
+    uint32_t size;              // Number of symbols
+    uint32_t *name_offsets;     // Offset of each symbol name in names
+    uint32_t *name_lengths;
+    uint32_t names_capacity;    // Capacity of name_offsets and name_lengths
+    char *names;                // NUL terminated names
+    size_t names_size;
+    size_t names_bytes;         // Capacity of names
+};
+
+/**
+ * Create an empty symbol table.
+ *
+ * @param table Table to initialize.
+ * @param capacity Expected number of symbols.
+ */
+void symbol_table_init(SymbolTable *table, uint32_t capacity);
+
+void symbol_table_free(SymbolTable *table);
+
+/**
+ * Hash an identifier. Same function as the vectorized hash used when
+ *  interning tokens.
+ *
+ * @param str Identifier text.
+ * @param len Length of the identifier.
+ * @return 32-bit hash.
+ */
+uint32_t symbol_hash(const char *str, uint32_t len);
+
+/**
+ * Find or insert a symbol.
+ *
+ * @param table Symbol table.
+ * @param str Identifier text.
+ * @param len Length of the identifier.
+ * @param hash Hash of the identifier (symbol_hash).
+ * @return Symbol ID.
+ */
+uint32_t symbol_intern(SymbolTable *table, const char *str, uint32_t len, uint32_t hash);
+
+/**
+ * Find a symbol without inserting it.
+ *
+ * @param table Symbol table.
+ * @param str Identifier text.
+ * @param len Length of the identifier.
+ * @return Symbol ID, or SYMBOL_NONE if the identifier was never interned.
+ */
+uint32_t symbol_lookup(const SymbolTable *table, const char *str, uint32_t len);
+
+const char *symbol_name(const SymbolTable *table, uint32_t id);
+
+/**
+ * Assign a symbol ID to every identifier token. Identifiers are hashed
+ *  8 at a time, one per 32-bit lane, reading 4 bytes of each per step.
+ *  IDs are stored in tok_array->symbol_ids, SYMBOL_NONE for other tokens.
+ *
+ * @param tok_array Lexed tokens.
+ * @param table Symbol table to intern into.
+ */
+void intern_identifiers(TokenArray *tok_array, SymbolTable *table);
+
+#endif //INTERN_H
@@ -1,102 +1,1170 @@
+#define _GNU_SOURCE
+
 #include "lexer.h"
 
 #include <limits.h>
 
-#include "print_utils.c"
+#include "token_tables.h"
+#include "tune.h"
+#include "unicode.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+typedef struct Keyword Keyword;
+struct Keyword {
+    const char *spelling;
+    TokenType type;
+};
+
+static const Keyword c_keywords[] = {C_KEYWORDS};
+
+static const Keyword cpp_keywords[] = {CPP_KEYWORDS};
+
+__m256i lex_block(const char *input, const long pos, const long input_size, __m256i *current_vec, __m256i *next_vec,
+                  const __m256i src_current_vec, const __m256i src_next_vec, LexState *state) {
+    // Hide raw string literals from the sub lexers
+    uint32_t raw_starts = 0;
+    uint32_t raw_region = 0;
+
+    if (state->dialect == LEX_DIALECT_CPP) {
+        raw_region = raw_string_sub_lex(input, pos, input_size, *current_vec, *next_vec, src_current_vec, state,
+                                        &raw_starts);
+
+        *current_vec = _mm256_blendv_epi8(
+            *current_vec,
+            _mm256_setzero_si256(),
+            get_mask(raw_region)
+        );
+    }
+
+    __m256i tags = run_sublexers(current_vec, next_vec, src_current_vec, state);
+
+    if (raw_region) {
+        raw_string_tags(current_vec, &tags, src_current_vec, src_next_vec, raw_region, raw_starts);
+        state->lit_region |= raw_region;
+        state->error_region &= ~raw_region;
+    }
+
+    return tags;
+}
+
+void lex_stream_init(LexStream *stream, char *input, long input_size, const LexOptions *options,
+                     const KeywordTable *keyword_table, TokenArray tokens) {
+    stream->input = input;
+
+    stream->tokens = tokens;
+    stream->tokens.src = input;
+    stream->state.dialect = options->dialect;
+
+    // Filter tags before compaction, identifiers are filtered again once keywords are known
+    stream->filter = options->filter != NULL;
+    stream->post_filter = false;
+    stream->filter_lo = _mm256_setzero_si256();
+    stream->filter_hi = _mm256_setzero_si256();
+
+    if (options->filter != NULL) {
+        TokenFilter tag_filter;
+        stream->post_filter = tag_filter_for(options->filter, keyword_table, &tag_filter);
+
+        stream->filter_lo = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) tag_filter.bits));
+        stream->filter_hi = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) (tag_filter.bits + 16)));
+    }
+
+    lex_stream_restart(stream, 0, input_size);
+
+    // Tokens of large inputs outgrow the cache, write them around it
+    stream->stream_tokens = tokens.capacity >= STREAM_TOKENS_MIN_INPUT;
+    stream->stage.size = 0;
+}
+
+void lex_stream_restart(LexStream *stream, long start, long end) {
+    stream->pos = start;
+    stream->input_size = end;
+
+    const LexDialect dialect = stream->state.dialect;
+    stream->state = (LexState) {0};
+    stream->state.dialect = dialect;
+
+    utf8_check_init(&stream->utf8_checker);
+    stream->errors = 0;
+
+    // The first token of a range starts a line
+    stream->line_start = true;
+    stream->space_before = false;
+    stream->backslash_before = false;
+
+    // Reload the first vector, the previous range may have edited it through its carries
+    stream->current_vec = load_vector(stream->input + start);
+    stream->src_current_vec = stream->current_vec;
+}
+
+// Extend marks through the runs of skipped bytes right after them, carry marks the byte before the vector.
+// Marks and skipped bytes do not overlap, so only the first byte of a run follows a mark
+static uint32_t extend_marks(uint32_t marks, uint32_t skipped, bool carry) {
+    const uint32_t run_starts = ((marks << 1) | carry) & skipped;
+
+    return marks | (skipped & ~(skipped + run_starts));
+}
+
+// Layout flags of each byte of the current vector, from the regions lex_block left in the state
+static __m256i token_layout_flags(LexStream *stream) {
+    const LexState *state = &stream->state;
+
+    __m256i blank_vec = stream->src_current_vec;
+    replace_white_space(&blank_vec);
+    const uint32_t ws = _mm256_movemask_epi8(_mm256_cmpeq_epi8(blank_vec, _mm256_setzero_si256()));
+    const uint32_t newlines = _mm256_movemask_epi8(
+        _mm256_cmpeq_epi8(stream->src_current_vec, _mm256_set1_epi8('\n'))
+    );
+    const uint32_t backslashes = _mm256_movemask_epi8(
+        _mm256_cmpeq_epi8(stream->src_current_vec, _mm256_set1_epi8('\\'))
+    );
+
+    // Line splices are skipped like clang does, also those the splice region leaves to the token they join.
+    // Newlines inside comments do not end a line
+    const uint32_t splices = state->splice_region | (newlines & ((backslashes << 1) | stream->backslash_before));
+    const uint32_t gaps = (ws | state->comment_region) & ~state->lit_region & ~splices;
+    const uint32_t line_ends = newlines & gaps & ~state->comment_region;
+    const uint32_t spaces = gaps & ~line_ends;
+
+    // Bytes reached from a newline through gaps only, and bytes reached from a space through splices only
+    const uint32_t in_line_start = extend_marks(line_ends, spaces | splices, stream->line_start);
+    const uint32_t in_space = extend_marks(spaces, splices, stream->space_before);
+
+    const uint32_t start_of_line = (in_line_start << 1) | stream->line_start;
+    const uint32_t leading_space = (in_space << 1) | stream->space_before;
+
+    stream->line_start = in_line_start >> 31;
+    stream->space_before = in_space >> 31;
+    stream->backslash_before = backslashes >> 31;
+
+    return _mm256_or_si256(
+        _mm256_and_si256(get_mask(start_of_line), _mm256_set1_epi8(TOKEN_START_OF_LINE)),
+        _mm256_and_si256(get_mask(leading_space), _mm256_set1_epi8(TOKEN_LEADING_SPACE))
+    );
+}
+
+__attribute__((always_inline)) inline bool lex_stream_block(LexStream *stream) {
+    const long i = stream->pos;
+
+    if (i >= stream->input_size)
+        return false;
+
+    char *input = stream->input;
+
+    // Run sub lexers
+    __m256i next_vec = load_vector(input + i + VECTOR_SIZE);
+    const __m256i src_next_vec = load_vector(input + i + VECTOR_SIZE);
+
+    utf8_check_block(&stream->utf8_checker, stream->src_current_vec);
+
+    __m256i tags = lex_block(input, i, stream->input_size, &stream->current_vec, &next_vec,
+                             stream->src_current_vec, src_next_vec, &stream->state);
+
+    stream->errors |= stream->state.error_region;
+
+    if (stream->filter) {
+        tags = _mm256_and_si256(tags, filter_tag_mask(tags, stream->filter_lo, stream->filter_hi));
+    }
+
+    // Flags of the token starts, compacted like the tags and stored at the index of the first token
+    if (stream->tokens.token_flags != NULL) {
+        __m256i flags = token_layout_flags(stream);
+        int flag_count;
+        mm256_pext(&flags, non_zero_mask(tags), &flag_count);
+
+        const uint64_t index = stream->tokens.size + (stream->stream_tokens ? stream->stage.size : 0);
+        _mm256_storeu_si256((__m256i *) (stream->tokens.token_flags + index), flags);
+    }
+
+    // Traverse tags
+    int size;
+    __m256i indices;
+    find_token_indices(&tags, &indices, &size);
+
+    // Handle results
+    if (stream->stream_tokens) {
+        append_tokens_streamed(&stream->tokens, &stream->stage, tags, indices, size, i);
+    } else {
+        append_tokens(&stream->tokens, tags, indices, size, i);
+    }
+    _mm256_storeu_si256((__m256i *)(input + i), stream->current_vec);
+    stream->state.last_char = input[i + 31];
+
+    // Swap vectors
+    stream->current_vec = next_vec;
+    stream->src_current_vec = src_next_vec;
+    stream->pos = i + VECTOR_SIZE;
+
+    return true;
+}
+
+static bool stream_has_errors(LexStream *stream, bool *invalid_utf8) {
+    const LexState *state = &stream->state;
+    *invalid_utf8 = !utf8_check_finish(&stream->utf8_checker);
+
+    // Unterminated literals, comments and raw strings
+    return stream->errors || *invalid_utf8 || state->ch_continue || state->str_continue
+           || state->block_comm_continue || state->raw_unterminated;
+}
+
+TokenArray lex_stream_finish(LexStream *stream, const LexOptions *options, const KeywordTable *keyword_table) {
+    TokenArray tokens = stream->tokens;
+
+    if (stream->stream_tokens) {
+        finish_token_stage(&tokens, &stream->stage);
+    }
+
+    tokens.has_errors = stream_has_errors(stream, &tokens.invalid_utf8);
+
+    find_keywords(&tokens, keyword_table);
+
+    if (stream->post_filter) {
+        filter_tokens(&tokens, options->filter);
+    }
+
+    if (options->symbols != NULL) {
+        intern_identifiers(&tokens, options->symbols);
+    }
+
+    if (options->match_brackets) {
+        match_brackets(&tokens);
+    }
+
+    return tokens;
+}
+
+static bool alloc_token_flags(TokenArray *tok_array) {
+    // lex_stream_block writes whole vectors past the last token
+    if (posix_memalign((void **) &tok_array->token_flags, VECTOR_SIZE, tok_array->capacity + VECTOR_SIZE)) {
+        fprintf(stderr, "Memory allocation failure.\n");
+        tok_array->token_flags = NULL;
+        return false;
+    }
+
+    return true;
+}
+
+void lex_streams(char **inputs, const long *input_sizes, int count, const LexOptions *options, TokenArray *results) {
+    KeywordTable keyword_table;
+    populate_keyword_lookup_table(&keyword_table, options->dialect);
+
+    // One input after the other: interleaving the vectors of several inputs measured slower than this
+    for (int s = 0; s < count; ++s) {
+        TokenArray tokens = create_empty_token_array(input_sizes[s] + 4, &options->alloc);
+
+        if (options->token_flags) {
+            alloc_token_flags(&tokens);
+        }
+
+        LexStream stream;
+        lex_stream_init(&stream, inputs[s], input_sizes[s], options, &keyword_table, tokens);
+
+        while (lex_stream_block(&stream));
+
+        results[s] = lex_stream_finish(&stream, options, &keyword_table);
+    }
+}
+
+int finish_vector_tokens(LexStream *stream, int first, int count, const KeywordTable *keyword_table,
+                         const TokenFilter *filter) {
+    TokenType *types = stream->tokens.token_types + first;
+    uint32_t *locs = stream->tokens.token_locs + first;
+
+    uint32_t idents = _mm256_movemask_epi8(
+        _mm256_cmpeq_epi8(load_vector((const char *) types), _mm256_set1_epi8(TOK_IDENT))
+    );
+
+    if (count < VECTOR_SIZE)
+        idents &= (1u << count) - 1;
+
+    for (; idents; idents &= idents - 1) {
+        const int j = __builtin_ctz(idents);
+        types[j] = keyword_type(keyword_table, stream->input + locs[j]);
+    }
+
+    if (!stream->post_filter)
+        return count;
+
+    TokenArray finished = stream->tokens;
+    finished.token_types = types;
+    finished.token_locs = locs;
+    finished.size = count;
+    filter_tokens(&finished, filter);
+
+    const int kept = (int) finished.size;
+    const int last = (int) stream->tokens.size - first - count;
+
+    memmove(types + kept, types + count, last * sizeof(TokenType));
+    memmove(locs + kept, locs + count, last * sizeof(uint32_t));
+    stream->tokens.size = first + kept + last;
+
+    return kept;
+}
+
+// Drop the first count tokens of the stream
+static void drop_tokens(LexStream *stream, int count) {
+    const int last = (int) stream->tokens.size - count;
+
+    memmove(stream->tokens.token_types, stream->tokens.token_types + count, last * sizeof(TokenType));
+    memmove(stream->tokens.token_locs, stream->tokens.token_locs + count, last * sizeof(uint32_t));
+    stream->tokens.size = last;
+}
+
+bool lex_with_callback(char *input, long input_size, const LexOptions *options, TokenCallback callback, void *user) {
+    KeywordTable keyword_table;
+    populate_keyword_lookup_table(&keyword_table, options->dialect);
+
+    LexOptions stream_options = *options;
+    stream_options.symbols = NULL;
+    stream_options.match_brackets = false;
+
+    // Tokens of the last two vectors, with room for the whole vectors written by append_tokens
+    TokenType types[2 * VECTOR_SIZE] __attribute__((aligned(VECTOR_SIZE)));
+    uint32_t locs[2 * VECTOR_SIZE] __attribute__((aligned(VECTOR_SIZE)));
+
+    TokenArray tokens = {0};
+    tokens.token_types = types;
+    tokens.token_locs = locs;
+    tokens.capacity = VECTOR_SIZE;
+
+    LexStream stream;
+    lex_stream_init(&stream, input, input_size, &stream_options, &keyword_table, tokens);
+
+    // Tokens of the previous vector wait for the next one
+    int previous = 0;
+
+    while (lex_stream_block(&stream)) {
+        if (previous > 0) {
+            const int finished = finish_vector_tokens(&stream, 0, previous, &keyword_table, options->filter);
+
+            if (finished > 0) {
+                callback(types, locs, finished, user);
+            }
+
+            drop_tokens(&stream, finished);
+        }
+
+        previous = (int) stream.tokens.size;
+    }
+
+    // Finishing the stream resolves the keywords of the last vector
+    const TokenArray last = lex_stream_finish(&stream, &stream_options, &keyword_table);
+
+    if (last.size > 0) {
+        callback(types, locs, (int) last.size, user);
+    }
+
+    return last.has_errors;
+}
+
+void lex_iterator_init(LexIterator *it, char *input, long input_size, const LexOptions *options) {
+    it->options = *options;
+    it->options.symbols = NULL;
+    it->options.match_brackets = false;
+    populate_keyword_lookup_table(&it->keyword_table, options->dialect);
+
+    TokenArray tokens = {0};
+    tokens.token_types = it->types;
+    tokens.token_locs = it->locs;
+    tokens.capacity = VECTOR_SIZE;
+
+    lex_stream_init(&it->stream, input, input_size, &it->options, &it->keyword_table, tokens);
+    it->pending = 0;
+    it->ready = 0;
+    it->done = false;
+    it->has_errors = false;
+}
+
+int lex_next_batch(LexIterator *it, TokenType *out_types, uint32_t *out_locs, int max) {
+    int count = 0;
+
+    while (count < max) {
+        const int left = it->ready - it->pending;
+
+        if (left > 0) {
+            const int n = left < max - count ? left : max - count;
+
+            memcpy(out_types + count, it->types + it->pending, n * sizeof(TokenType));
+            memcpy(out_locs + count, it->locs + it->pending, n * sizeof(uint32_t));
+
+            count += n;
+            it->pending += n;
+            continue;
+        }
+
+        // Stop at a vector boundary once the next vector may not fit
+        if (it->done || (count > 0 && max - count < VECTOR_SIZE))
+            break;
+
+        drop_tokens(&it->stream, it->ready);
+        it->pending = 0;
+
+        const int previous = (int) it->stream.tokens.size;
+
+        if (!lex_stream_block(&it->stream)) {
+            // Finishing the stream resolves the keywords of the last vector
+            const TokenArray last = lex_stream_finish(&it->stream, &it->options, &it->keyword_table);
+
+            it->ready = (int) last.size;
+            it->has_errors = last.has_errors;
+            it->done = true;
+            continue;
+        }
+
+        it->ready = previous > 0 ? finish_vector_tokens(&it->stream, 0, previous, &it->keyword_table,
+                                                        it->options.filter) : 0;
+    }
+
+    return count;
+}
+
+TokenArray lex(char *input, long input_size, const LexOptions *options) {
+    TokenArray tokens;
+    lex_streams(&input, &input_size, 1, options, &tokens);
+
+    return tokens;
+}
+
+// Closing bracket of an opening one
+static TokenType closing_bracket(TokenType type) {
+    switch (type) {
+        case TOK_L_PAREN: return TOK_R_PAREN;
+        case TOK_L_SQUARE: return TOK_R_SQUARE;
+        default: return TOK_R_BRACE;
+    }
+}
+
+// Inclusive prefix sum of the signed bytes of a vector
+static __m256i prefix_sum_epi8(__m256i vector) {
+    vector = _mm256_add_epi8(vector, _mm256_slli_si256(vector, 1));
+    vector = _mm256_add_epi8(vector, _mm256_slli_si256(vector, 2));
+    vector = _mm256_add_epi8(vector, _mm256_slli_si256(vector, 4));
+    vector = _mm256_add_epi8(vector, _mm256_slli_si256(vector, 8));
+
+    // Carry the total of the low lane into the high lane
+    const __m256i low_total = _mm256_shuffle_epi8(
+        _mm256_permute2x128_si256(vector, vector, 0x08),
+        _mm256_set1_epi8(15)
+    );
+
+    return _mm256_add_epi8(vector, low_total);
+}
+
+static bool alloc_bracket_matches(TokenArray *tok_array) {
+    if (tok_array->bracket_matches != NULL)
+        return true;
+
+    if (posix_memalign((void **) &tok_array->bracket_matches, VECTOR_SIZE,
+                       (tok_array->capacity + VECTOR_SIZE) * sizeof(uint32_t))) {
+        fprintf(stderr, "Memory allocation failure.\n");
+        tok_array->bracket_matches = NULL;
+        return false;
+    }
+
+    return true;
+}
+
+void match_brackets(TokenArray *tok_array) {
+    if (!alloc_bracket_matches(tok_array))
+        return;
+
+    const TokenType *types = tok_array->token_types;
+    uint32_t *matches = tok_array->bracket_matches;
+
+    uint32_t *open_at = NULL;   // Unmatched opening bracket of each depth, BRACKET_NONE if none
+    int32_t open_capacity = 0;
+    int32_t depth = 0;          // Depth before the current vector
+    uint64_t brackets = 0;
+    uint64_t matched = 0;
+
+    for (uint64_t i = 0; i < tok_array->size; i += VECTOR_SIZE) {
+        const __m256i type_vec = _mm256_loadu_si256((const __m256i *) (types + i));
+
+        for (int j = 0; j < VECTOR_SIZE; j += 8) {
+            _mm256_storeu_si256((__m256i *) (matches + i + j), _mm256_set1_epi32(BRACKET_NONE));
+        }
+
+        const __m256i opens = _mm256_or_si256(
+            _mm256_or_si256(
+                _mm256_cmpeq_epi8(type_vec, _mm256_set1_epi8(TOK_L_PAREN)),
+                _mm256_cmpeq_epi8(type_vec, _mm256_set1_epi8(TOK_L_SQUARE))
+            ),
+            _mm256_cmpeq_epi8(type_vec, _mm256_set1_epi8(TOK_L_BRACE))
+        );
+        const __m256i closes = _mm256_or_si256(
+            _mm256_or_si256(
+                _mm256_cmpeq_epi8(type_vec, _mm256_set1_epi8(TOK_R_PAREN)),
+                _mm256_cmpeq_epi8(type_vec, _mm256_set1_epi8(TOK_R_SQUARE))
+            ),
+            _mm256_cmpeq_epi8(type_vec, _mm256_set1_epi8(TOK_R_BRACE))
+        );
+
+        uint32_t open_bits = _mm256_movemask_epi8(opens);
+        uint32_t bracket_bits = open_bits | _mm256_movemask_epi8(closes);
+
+        if (tok_array->size - i < VECTOR_SIZE) {
+            const uint32_t valid = (1u << (tok_array->size - i)) - 1;
+            open_bits &= valid;
+            bracket_bits &= valid;
+        }
+
+        if (bracket_bits == 0)
+            continue;
+
+        // Depth after each token relative to the vector, masks are -1 so closers add 1 and openers remove it
+        int8_t depths[VECTOR_SIZE] __attribute__((aligned(VECTOR_SIZE)));
+        _mm256_store_si256((__m256i *) depths, prefix_sum_epi8(_mm256_sub_epi8(closes, opens)));
+
+        brackets += _mm_popcnt_u32(bracket_bits);
+
+        // A closer has the depth of its opener once the opener is counted, no stack is needed
+        for (; bracket_bits; bracket_bits &= bracket_bits - 1) {
+            const int j = __builtin_ctz(bracket_bits);
+            const uint32_t index = i + j;
+            const int32_t after = depth + depths[j];
+
+            if (open_bits & (1u << j)) {
+                const int32_t level = after - 1;
+
+                if (level >= open_capacity) {
+                    const int32_t capacity = open_capacity ? 2 * open_capacity : 64;
+                    uint32_t *grown = realloc(open_at, capacity * sizeof(uint32_t));
+
+                    if (grown == NULL) {
+                        fprintf(stderr, "Memory allocation failure.\n");
+                        free(open_at);
+                        return;
+                    }
+
+                    open_at = grown;
+                    open_capacity = capacity;
+                }
+
+                open_at[level] = index;
+                continue;
+            }
+
+            // More closers than openers so far, the depth stays at 0 for the brackets that follow
+            if (after < 0) {
+                ++depth;
+                continue;
+            }
+
+            const uint32_t opener = open_at[after];
+            open_at[after] = BRACKET_NONE;
+
+            if (opener != BRACKET_NONE && closing_bracket(types[opener]) == types[index]) {
+                matches[opener] = index;
+                matches[index] = opener;
+                matched += 2;
+            }
+        }
+
+        depth += depths[VECTOR_SIZE - 1];
+    }
+
+    tok_array->bracket_errors = matched != brackets;
+    free(open_at);
+}
+
+// Drop filtered tokens of each file, end-of-file tokens are kept so that every range still ends with one
+static void filter_packed_tokens(TokenArray *tok_array, FilePack *pack, const TokenFilter *filter) {
+    uint64_t size = 0;
+
+    for (int f = 0; f < pack->count; ++f) {
+        PackedFile *file = &pack->files[f];
+        const uint64_t end = file->first_token + file->token_count;
+
+        file->first_token = size;
+
+        for (uint64_t i = end - file->token_count; i < end; ++i) {
+            const TokenType type = tok_array->token_types[i];
+
+            tok_array->token_types[size] = type;
+            tok_array->token_locs[size] = tok_array->token_locs[i];
+
+            if (tok_array->token_flags != NULL) {
+                tok_array->token_flags[size] = tok_array->token_flags[i];
+            }
+
+            size += type == TOK_EOF || token_filter_has(filter, type);
+        }
+
+        file->token_count = size - file->first_token;
+    }
+
+    tok_array->size = size;
+}
+
+TokenArray lex_pack(FilePack *pack, const LexOptions *options) {
+    KeywordTable keyword_table;
+    populate_keyword_lookup_table(&keyword_table, options->dialect);
+
+    // Room for every byte of the arena and one end-of-file token per file
+    TokenArray empty = create_empty_token_array(pack->size + pack->count + 4, &options->alloc);
+
+    if (options->token_flags) {
+        alloc_token_flags(&empty);
+    }
+
+    LexStream stream;
+    lex_stream_init(&stream, pack->arena, 0, options, &keyword_table, empty);
+
+    // End-of-file tokens are appended between files, past any staged token
+    stream.stream_tokens = false;
+
+    bool has_errors = false;
+    bool invalid_utf8 = false;
+
+    for (int f = 0; f < pack->count; ++f) {
+        PackedFile *file = &pack->files[f];
+        const long end = file->offset + file->size;
+
+        // Files start on a vector boundary, only the carry state has to be reset
+        lex_stream_restart(&stream, file->offset, end);
+        file->first_token = stream.tokens.size;
+
+        while (lex_stream_block(&stream));
+
+        bool file_invalid_utf8;
+        file->has_errors = stream_has_errors(&stream, &file_invalid_utf8);
+        has_errors |= file->has_errors;
+        invalid_utf8 |= file_invalid_utf8;
+
+        append_token(&stream.tokens, create_token(TOK_EOF, end));
+
+        if (stream.tokens.token_flags != NULL) {
+            stream.tokens.token_flags[stream.tokens.size - 1] = 0;
+        }
+
+        file->token_count = stream.tokens.size - file->first_token;
+    }
+
+    TokenArray tokens = stream.tokens;
+    tokens.has_errors = has_errors;
+    tokens.invalid_utf8 = invalid_utf8;
+
+    // One keyword pass over all files, locations are still arena offsets
+    find_keywords(&tokens, &keyword_table);
+
+    if (stream.post_filter) {
+        filter_packed_tokens(&tokens, pack, options->filter);
+    }
+
+    if (options->symbols != NULL) {
+        intern_identifiers(&tokens, options->symbols);
+    }
+
+    // Locations relative to the start of each file, as lex returns them
+    for (int f = 0; f < pack->count; ++f) {
+        const PackedFile *file = &pack->files[f];
+        const uint32_t offset = file->offset;
+        uint32_t *locs = tokens.token_locs + file->first_token;
+
+        for (uint64_t i = 0; i < file->token_count; ++i) {
+            locs[i] -= offset;
+        }
+    }
+
+    // Brackets are matched within each file, indices relative to its first token
+    if (options->match_brackets && alloc_bracket_matches(&tokens)) {
+        for (int f = 0; f < pack->count; ++f) {
+            TokenArray view = packed_file_tokens(pack, &tokens, f);
+            match_brackets(&view);
+
+            pack->files[f].bracket_errors = view.bracket_errors;
+            tokens.bracket_errors |= view.bracket_errors;
+        }
+    }
+
+    return tokens;
+}
+
+TokenArray packed_file_tokens(const FilePack *pack, const TokenArray *tokens, int index) {
+    const PackedFile *file = &pack->files[index];
+
+    TokenArray view = *tokens;
+    view.size = file->token_count;
+    view.capacity = file->token_count;
+    view.src = pack->arena + file->offset;
+    view.token_types = tokens->token_types + file->first_token;
+    view.token_locs = tokens->token_locs + file->first_token;
+    view.has_errors = file->has_errors;
+
+    view.bracket_errors = file->bracket_errors;
+
+    if (tokens->symbol_ids != NULL) {
+        view.symbol_ids = tokens->symbol_ids + file->first_token;
+    }
+
+    if (tokens->bracket_matches != NULL) {
+        view.bracket_matches = tokens->bracket_matches + file->first_token;
+    }
+
+    if (tokens->token_flags != NULL) {
+        view.token_flags = tokens->token_flags + file->first_token;
+    }
+
+    return view;
+}
+
+bool tag_filter_for(const TokenFilter *filter, const KeywordTable *keyword_table, TokenFilter *tag_filter) {
+    *tag_filter = *filter;
+
+    bool keyword_kept = false;
+    bool keyword_dropped = false;
+
+    for (int i = 1; i <= keyword_table->size; ++i) {
+        if (token_filter_has(filter, keyword_table->types[i])) {
+            keyword_kept = true;
+        } else {
+            keyword_dropped = true;
+        }
+    }
+
+    // Identifiers may still become kept keywords
+    if (keyword_kept) {
+        token_filter_add(tag_filter, TOK_IDENT);
+    }
+
+    // Tokens resolved from identifiers need a second pass unless all of them are kept
+    return token_filter_has(tag_filter, TOK_IDENT) && (!token_filter_has(filter, TOK_IDENT) || keyword_dropped);
+}
+
+__m256i filter_tag_mask(const __m256i tags, const __m256i filter_lo, const __m256i filter_hi) {
+    // Byte of the bitmap holding each tag: tag >> 3
+    const __m256i byte_idx = _mm256_and_si256(
+        _mm256_srli_epi16(tags, 3),
+        _mm256_set1_epi8(0x1F)
+    );
+
+    const __m256i use_hi = _mm256_cmpgt_epi8(byte_idx, _mm256_set1_epi8(15));
+    const __m256i bitmap_byte = _mm256_blendv_epi8(
+        _mm256_shuffle_epi8(filter_lo, byte_idx),
+        _mm256_shuffle_epi8(filter_hi, byte_idx),
+        use_hi
+    );
+
+    // Bit of that byte: 1 << (tag & 7)
+    const __m256i bit = _mm256_shuffle_epi8(
+        _mm256_setr_epi8(
+            1, 2, 4, 8, 16, 32, 64, (char) 128, 0, 0, 0, 0, 0, 0, 0, 0,
+            1, 2, 4, 8, 16, 32, 64, (char) 128, 0, 0, 0, 0, 0, 0, 0, 0
+        ),
+        _mm256_and_si256(tags, _mm256_set1_epi8(7))
+    );
+
+    return _mm256_cmpeq_epi8(_mm256_and_si256(bitmap_byte, bit), bit);
+}
+
+void filter_tokens(TokenArray *tok_array, const TokenFilter *filter) {
+    uint64_t size = 0;
+
+    for (uint64_t i = 0; i < tok_array->size; ++i) {
+        tok_array->token_types[size] = tok_array->token_types[i];
+        tok_array->token_locs[size] = tok_array->token_locs[i];
+
+        if (tok_array->token_flags != NULL) {
+            tok_array->token_flags[size] = tok_array->token_flags[i];
+        }
+
+        size += token_filter_has(filter, tok_array->token_types[i]);
+    }
+
+    tok_array->size = size;
+}
+
+void lex_stats(const char *input, long input_size, const LexOptions *options, TokenStats *stats) {
+    memset(stats, 0, sizeof(TokenStats));
+
+    LexState state = {0};
+    state.dialect = options->dialect;
+
+    KeywordTable keyword_table;
+    populate_keyword_lookup_table(&keyword_table, options->dialect);
+
+    __m256i current_vec = load_vector(input);
+    __m256i src_current_vec = current_vec;
+
+    for (long i = 0; i < input_size; i += VECTOR_SIZE) {
+        __m256i next_vec = load_vector(input + i + VECTOR_SIZE);
+        const __m256i src_next_vec = next_vec;
+
+        const __m256i tags = lex_block(input, i, input_size, &current_vec, &next_vec, src_current_vec, src_next_vec,
+                                       &state);
+
+        // Count tags by class: all, identifiers, numbers, then the rest one by one
+        const uint32_t starts = ~_mm256_movemask_epi8(_mm256_cmpeq_epi8(tags, _mm256_setzero_si256()));
+        const uint32_t idents = _mm256_movemask_epi8(_mm256_cmpeq_epi8(tags, _mm256_set1_epi8(TOK_IDENT)));
+        const uint32_t nums = _mm256_movemask_epi8(_mm256_cmpeq_epi8(tags, _mm256_set1_epi8(TOK_NUM)));
+
+        stats->tokens += _mm_popcnt_u32(starts);
+        stats->counts[TOK_NUM] += _mm_popcnt_u32(nums);
+
+        // Identifiers are resolved to keywords from the input right away
+        for (uint32_t bits = idents; bits; bits &= bits - 1) {
+            ++stats->counts[keyword_type(&keyword_table, input + i + __builtin_ctz(bits))];
+        }
+
+        uint32_t rest = starts & ~idents & ~nums;
+
+        if (rest) {
+            uint8_t tag_bytes[VECTOR_SIZE] __attribute__((aligned(32)));
+            _mm256_store_si256((__m256i *) tag_bytes, tags);
+
+            for (; rest; rest &= rest - 1) {
+                ++stats->counts[tag_bytes[__builtin_ctz(rest)]];
+            }
+        }
+
+        stats->literal_bytes += _mm_popcnt_u32(state.lit_region);
+
+        state.last_char = (char) _mm256_extract_epi8(current_vec, 31);
+
+        // Swap vectors
+        current_vec = next_vec;
+        src_current_vec = src_next_vec;
+    }
+}
 
-#include <stdio.h>
-#include <stdlib.h>
+long minify_source(const char *input, long input_size, const LexOptions *options, bool keep_lines, char *output) {
+    LexState state = {0};
+    state.dialect = options->dialect;
 
-TokenArray lex(char *input, long input_size) {
-    TokenArray tokens = create_empty_token_array(input_size + 4);
-    tokens.src = input;
+    long output_size = 0;
+    bool started = false;       // A token was written
+    bool gap_pending = false;   // Previous vector ended inside a gap after a token
+    bool gap_newline = false;   // That gap holds a newline
 
-    char last_char = 0;
-    bool ch_continue = 0;
-    bool str_continue = 0;
-    bool escaped_continue = 0;
-    bool ln_comm_continue = 0;
-    bool block_comm_continue = 0;
     __m256i current_vec = load_vector(input);
-    __m256i src_current_vec = load_vector(input);
+    __m256i src_current_vec = current_vec;
 
-    for (int i = 0; i < input_size; i += VECTOR_SIZE) {
-        // Run sub lexers
+    for (long i = 0; i < input_size; i += VECTOR_SIZE) {
         __m256i next_vec = load_vector(input + i + VECTOR_SIZE);
-        const __m256i src_next_vec = load_vector(input + i + VECTOR_SIZE);
+        const __m256i src_next_vec = next_vec;
+
+        lex_block(input, i, input_size, &current_vec, &next_vec, src_current_vec, src_next_vec, &state);
+
+        const uint32_t zero = _mm256_movemask_epi8(_mm256_cmpeq_epi8(current_vec, _mm256_setzero_si256()));
+        const uint32_t newlines = _mm256_movemask_epi8(_mm256_cmpeq_epi8(src_current_vec, _mm256_set1_epi8('\n')));
+
+        __m256i blank_vec = src_current_vec;
+        replace_white_space(&blank_vec);
+        const uint32_t ws = _mm256_movemask_epi8(_mm256_cmpeq_epi8(blank_vec, _mm256_setzero_si256()));
+
+        // Gaps: white space and comments outside literals, splices unless lines are kept
+        uint32_t gaps = ((zero & ws) | state.comment_region | state.splice_region) & ~state.lit_region;
+        if (keep_lines)
+            gaps &= ~state.splice_region;
+
+        // The padding past the end of input is a gap, also when a literal left open at the end spans it
+        if (input_size - i < VECTOR_SIZE)
+            gaps |= ~0u << (input_size - i);
+
+        const uint32_t kept = ~gaps;
+        const uint32_t real_newlines = newlines & gaps & ~state.splice_region;
+
+        // Gaps holding a newline carry into the bit after their end
+        const uint64_t nl_in_gap = real_newlines | (gap_newline & gaps & 1);
+        const uint64_t nl_carry = ((uint64_t) gaps + nl_in_gap) & ~(uint64_t) gaps;
+        const uint32_t nl_gap_ends = nl_carry >> 1;
+
+        // One separator at the end of each gap, the last one may continue into the next vector
+        uint32_t gap_ends = gaps & ~(gaps >> 1) & 0x7FFFFFFF;
+
+        if (!started) {
+            gap_ends = kept ? gap_ends & ~((kept & -kept) - 1) : 0;
+        }
+
+        if (gap_pending && !(gaps & 1)) {
+            if (!keep_lines) {
+                output[output_size++] = gap_newline ? '\n' : ' ';
+            } else if (!gap_newline) {
+                output[output_size++] = ' ';
+            }
+        }
+
+        // With kept lines the newlines themselves separate
+        const uint32_t spaces = gap_ends & ~nl_gap_ends;
+        const uint32_t emit = keep_lines ? kept | real_newlines | spaces : kept | gap_ends;
 
-        __m256i tags = run_sublexers(
-            &current_vec, &next_vec,
-            src_current_vec, last_char,
-            &ch_continue, &escaped_continue, &str_continue, &ln_comm_continue, &block_comm_continue);
+        __m256i out_vec = _mm256_blendv_epi8(
+            src_current_vec,
+            _mm256_set1_epi8(' '),
+            get_mask(spaces)
+        );
+        out_vec = _mm256_blendv_epi8(out_vec, _mm256_set1_epi8('\n'), get_mask(gap_ends & nl_gap_ends));
 
-        // Traverse tags
         int size;
-        __m256i indices;
-        find_token_indices(&tags, &indices, &size);
+        mm256_pext(&out_vec, get_mask(emit), &size);
+        _mm256_storeu_si256((__m256i *) (output + output_size), out_vec);
+        output_size += size;
+
+        started |= kept != 0;
+        gap_pending = started && (gaps >> 31);
+        gap_newline = (gaps >> 31) && (nl_carry >> 32);
 
-        // Handle results
-        append_tokens(&tokens, tags, indices, size, i);
-        _mm256_storeu_si256((__m256i *)(input + i), current_vec);
-        last_char = input[i + 31];
+        state.last_char = (char) _mm256_extract_epi8(current_vec, 31);
 
         // Swap vectors
         current_vec = next_vec;
         src_current_vec = src_next_vec;
     }
 
-    short lookup[256] = {0};
-    populate_keyword_lookup_table(lookup);
-    find_keywords(&tokens, lookup);
+    // End with a newline like the input
+    if (gap_pending && gap_newline && !keep_lines)
+        output[output_size++] = '\n';
 
-    return tokens;
+    return output_size;
+}
+
+void count_lines(const char *input, long input_size, const LexOptions *options, LineStats *stats) {
+    *stats = (LineStats) {0};
+
+    LexState state = {0};
+    state.dialect = options->dialect;
+
+    uint64_t lines = 0;
+    uint64_t filled_lines = 0;  // Lines with anything but white space
+    bool code_carry = false;    // The line open at the end of the previous vector has code
+    bool filled_carry = false;
+
+    __m256i current_vec = load_vector(input);
+    __m256i src_current_vec = current_vec;
+
+    for (long i = 0; i < input_size; i += VECTOR_SIZE) {
+        __m256i next_vec = load_vector(input + i + VECTOR_SIZE);
+        const __m256i src_next_vec = next_vec;
+
+        lex_block(input, i, input_size, &current_vec, &next_vec, src_current_vec, src_next_vec, &state);
+
+        const uint32_t newlines = _mm256_movemask_epi8(_mm256_cmpeq_epi8(src_current_vec, _mm256_set1_epi8('\n')));
+
+        // Padding past the end of input is zero, so white space
+        __m256i blank_vec = src_current_vec;
+        replace_white_space(&blank_vec);
+        const uint32_t filled = ~_mm256_movemask_epi8(_mm256_cmpeq_epi8(blank_vec, _mm256_setzero_si256()));
+        const uint32_t code = filled & ~(state.comment_region & ~state.lit_region);
+
+        // Adding a byte to the run of non-newlines holding it carries into the newline ending the run,
+        // the carry out of bit 31 is the line left open
+        const uint64_t runs = (uint32_t) ~newlines;
+        const uint64_t code_ends = (runs + (code | code_carry)) & ~runs;
+        const uint64_t filled_ends = (runs + (filled | filled_carry)) & ~runs;
+
+        lines += _mm_popcnt_u32(newlines);
+        stats->code += _mm_popcnt_u32((uint32_t) code_ends);
+        filled_lines += _mm_popcnt_u32((uint32_t) filled_ends);
+
+        code_carry = code_ends >> 32;
+        filled_carry = filled_ends >> 32;
+
+        state.last_char = (char) _mm256_extract_epi8(current_vec, 31);
+
+        // Swap vectors
+        current_vec = next_vec;
+        src_current_vec = src_next_vec;
+    }
+
+    // Last line without newline
+    if (input_size > 0 && input[input_size - 1] != '\n') {
+        ++lines;
+        stats->code += code_carry;
+        filled_lines += filled_carry;
+    }
+
+    stats->comment = filled_lines - stats->code;
+    stats->blank = lines - filled_lines;
+}
+
+const char *lex_error_message(LexErrorKind kind) {
+    switch (kind) {
+        case LEX_ERROR_STRAY_CHAR: return "stray character in program";
+        case LEX_ERROR_INVALID_CHAR: return "character not allowed in an identifier";
+        case LEX_ERROR_INVALID_UTF8: return "invalid UTF-8 encoding";
+        case LEX_ERROR_UNTERMINATED_LITERAL: return "missing terminating quote";
+        case LEX_ERROR_UNTERMINATED_RAW_STRING: return "unterminated raw string";
+        case LEX_ERROR_UNTERMINATED_COMMENT: return "unterminated comment";
+        default: return "unknown error";
+    }
 }
 
-uint8_t hash(uint64_t val) {
-    return ((((val >> 32) ^ val) & 0xffffffff) * (uint64_t)3523216747) >> 32;
+static void add_lex_error(LexError *errors, int max_errors, int *count, LexErrorKind kind, long offset) {
+    if (*count < max_errors) {
+        errors[*count] = (LexError) { kind, offset };
+    }
+
+    ++*count;
 }
 
-void populate_keyword_lookup_table(short *lookup) {
-    const char *keywords[] = {
-        "", "auto", "break", "case", "char", "const", "continue", "default", "do",
-        "double", "else", "enum", "extern", "float", "for", "goto", "if", "inline",
-        "int", "long", "register", "restrict", "return", "short", "signed", "sizeof",
-        "static", "struct", "switch", "typedef", "union", "unsigned", "void", "volatile",
-        "while", "_Alignas", "_Alignof", "_Atomic", "_Bool", "_Complex", "_Generic",
-        "_Imaginary", "_Noreturn", "_Static_assert", "_Thread_local"
-    };
+int find_lex_errors(const char *input, long input_size, const LexOptions *options, LexError *errors, int max_errors) {
+    LexState state = {0};
+    state.dialect = options->dialect;
+
+    int count = 0;
+    long lit_start = -1;            // Last literal
+    long reported_lit = -1;         // Last literal reported as unterminated
+    long comment_start = -1;        // Last comment
+    long utf8_next = 0;             // Next code point to decode
+    bool in_comment = false;
+
+    __m256i current_vec = load_vector(input);
+    __m256i src_current_vec = current_vec;
+
+    for (long i = 0; i < input_size; i += VECTOR_SIZE) {
+        __m256i next_vec = load_vector(input + i + VECTOR_SIZE);
+        const __m256i src_next_vec = next_vec;
+
+        const __m256i tags = lex_block(input, i, input_size, &current_vec, &next_vec, src_current_vec, src_next_vec,
+                                       &state);
+
+        uint8_t tag_bytes[VECTOR_SIZE] __attribute__((aligned(32)));
+        _mm256_store_si256((__m256i *) tag_bytes, tags);
+
+        const uint32_t comment_starts = state.comment_region & ~((state.comment_region << 1) | in_comment);
+        const uint32_t non_ascii = _mm256_movemask_epi8(src_current_vec);
+
+        for (int j = 0; j < VECTOR_SIZE && i + j < input_size; ++j) {
+            const long pos = i + j;
+            const uint8_t tag = tag_bytes[j];
+
+            if (tag && tag != TOK_IDENT && tag != TOK_NUM && token_spellings[tag] == NULL)
+                lit_start = pos;
+
+            if ((comment_starts >> j) & 1)
+                comment_start = pos;
+
+            // Sequences that do not decode
+            if ((non_ascii >> j) & 1 && pos >= utf8_next) {
+                uint32_t cp;
+                const int len = utf8_decode((const uint8_t *) input + pos, &cp);
+
+                if (!len)
+                    add_lex_error(errors, max_errors, &count, LEX_ERROR_INVALID_UTF8, pos);
 
-    int num_keywords = (sizeof(keywords) / sizeof(keywords[0]));
-    for (int i = 1; i < num_keywords; ++i) {
-        char keyword_copy[9] = {0};
-        strncpy(keyword_copy, keywords[i], 8);
+                utf8_next = pos + (len ? len : 1);
 
-        uint64_t val = *((uint64_t*) keyword_copy);
-        uint8_t hash_val = hash(val);
+                if (len && (state.error_region >> j) & 1)
+                    add_lex_error(errors, max_errors, &count, LEX_ERROR_INVALID_CHAR, pos);
 
-        lookup[hash_val] = i;
+                continue;
+            }
+
+            if (!((state.error_region >> j) & 1) || (uint8_t) input[pos] >= 0x80)
+                continue;
+
+            if (input[pos] == '\n') {
+                if (lit_start != reported_lit)
+                    add_lex_error(errors, max_errors, &count, LEX_ERROR_UNTERMINATED_LITERAL, lit_start);
+
+                reported_lit = lit_start;
+            } else {
+                add_lex_error(errors, max_errors, &count, LEX_ERROR_STRAY_CHAR, pos);
+            }
+        }
+
+        in_comment = state.comment_region >> 31;
+        state.last_char = (char) _mm256_extract_epi8(current_vec, 31);
+
+        // Swap vectors
+        current_vec = next_vec;
+        src_current_vec = src_next_vec;
     }
+
+    if ((state.ch_continue || state.str_continue) && lit_start != reported_lit)
+        add_lex_error(errors, max_errors, &count, LEX_ERROR_UNTERMINATED_LITERAL, lit_start);
+
+    if (state.block_comm_continue)
+        add_lex_error(errors, max_errors, &count, LEX_ERROR_UNTERMINATED_COMMENT, comment_start);
+
+    if (state.raw_unterminated && lit_start >= 0 && raw_string_end(input, lit_start, input_size) > input_size)
+        add_lex_error(errors, max_errors, &count, LEX_ERROR_UNTERMINATED_RAW_STRING, lit_start);
+
+    return count;
+}
+
+TokenType keyword_type(const KeywordTable *table, const char *str) {
+    const __m128i ident_ranges = _mm_set_epi8(
+        0,  0,  0,  0,  0,  0,  0,  0,
+        'z',  'a',  '_',  '_',  'Z',  'A',  '9',  '0'
+    );
+    const __m128i byte_indices = _mm_setr_epi8(
+        0, 1, 2, 3, 4, 5, 6, 7,
+        8, 9, 10, 11, 12, 13, 14, 15
+    );
+
+    // Identifier length from its first 16 bytes
+    const __m128i text = _mm_loadu_si128((const __m128i *) str);
+    const uint32_t is_ident = _mm_cvtsi128_si32(
+        _mm_cmpestrm(ident_ranges, 8, text, 16, _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES | _SIDD_BIT_MASK)
+    ) | _mm_movemask_epi8(text);
+    const int len = __builtin_ctz(~is_ident);
+
+    if (len == KEYWORD_MAX_LEN && is_ident_char(str[KEYWORD_MAX_LEN]))
+        return TOK_IDENT;   // Longer than any keyword
+
+    const __m128i ident = _mm_and_si128(
+        text,
+        _mm_cmpgt_epi8(_mm_set1_epi8(len), byte_indices)
+    );
+
+    const uint64_t val = _mm_cvtsi128_si64(ident);
+    const uint8_t keyword_pos = table->lookup[hash(val, table->multiplier)];
+
+    bool are_equal = table->lengths[keyword_pos] == len && _mm_movemask_epi8(
+        _mm_cmpeq_epi8(
+            ident,
+            _mm_load_si128((const __m128i *) table->spellings[keyword_pos])
+        )
+    ) == 0xFFFF;
+    TokenType type = table->types[keyword_pos];
+
+    // are_equal ? keyword_id : TOK_IDENT
+    return TOK_IDENT ^ ((type ^ TOK_IDENT) & -!!are_equal);
+}
+
+uint32_t hash(uint64_t val, uint32_t multiplier) {
+    return (uint32_t) ((((val >> 32) ^ val) & 0xffffffff) * multiplier) >> (32 - KEYWORD_HASH_BITS);
 }
 
-void find_keywords(TokenArray *tok_array, short *lookup) {
-    const char *keywords[] = {
-        "", "auto", "break", "case", "char", "const", "continue", "default", "do",
-        "double", "else", "enum", "extern", "float", "for", "goto", "if", "inline",
-        "int", "long", "register", "restrict", "return", "short", "signed", "sizeof",
-        "static", "struct", "switch", "typedef", "union", "unsigned", "void", "volatile",
-        "while", "_Alignas", "_Alignof", "_Atomic", "_Bool", "_Complex", "_Generic",
-        "_Imaginary", "_Noreturn", "_Static_assert", "_Thread_local"
-    };
+void populate_keyword_lookup_table(KeywordTable *table, LexDialect dialect) {
+    const Keyword *keywords = c_keywords;
+    int num_keywords = sizeof(c_keywords) / sizeof(c_keywords[0]);
+    table->multiplier = C_KEYWORD_MULTIPLIER;
+
+    if (dialect == LEX_DIALECT_CPP) {
+        keywords = cpp_keywords;
+        num_keywords = sizeof(cpp_keywords) / sizeof(cpp_keywords[0]);
+        table->multiplier = CPP_KEYWORD_MULTIPLIER;
+    }
+
+    table->size = 0;
+    memset(table->lookup, 0, sizeof(table->lookup));
+    memset(table->spellings, 0, sizeof(table->spellings));
 
-    const TokenType keyword_types[] = {0, TOK_AUTO, TOK_BREAK, TOK_CASE, TOK_CHAR,
-        TOK_CONST, TOK_CONTINUE, TOK_DEFAULT, TOK_DO, TOK_DOUBLE, TOK_ELSE,
-        TOK_ENUM, TOK_EXTERN, TOK_FLOAT, TOK_FOR, TOK_GOTO, TOK_IF, TOK_INLINE,
-        TOK_INT, TOK_LONG, TOK_REGISTER, TOK_RESTRICT, TOK_RETURN, TOK_SHORT,
-        TOK_SIGNED, TOK_SIZEOF, TOK_STATIC, TOK_STRUCT, TOK_SWITCH, TOK_TYPEDEF,
-        TOK_UNION, TOK_UNSIGNED, TOK_VOID, TOK_VOLATILE, TOK_WHILE, TOK__ALIGNAS,
-        TOK__ALIGNOF, TOK__ATOMIC, TOK__BOOL, TOK__COMPLEX, TOK__GENERIC,
-        TOK__IMAGINARY, TOK__NORETURN, TOK__STATIC_ASSERT, TOK__THREAD_LOCAL};
+    // Entry 0 stays empty and never matches
+    table->lengths[0] = 0xFF;
+    table->types[0] = TOK_IDENT;
 
+    for (int i = 0; i < num_keywords; ++i) {
+        const int len = strlen(keywords[i].spelling);
+        memcpy(table->spellings[i + 1], keywords[i].spelling, len);
+        table->lengths[i + 1] = len;
+        table->types[i + 1] = keywords[i].type;
+        table->size = i + 1;
+
+        uint64_t val;
+        memcpy(&val, table->spellings[i + 1], sizeof(uint64_t));
+
+        table->lookup[hash(val, table->multiplier)] = i + 1;
+    }
+}
+
+void find_keywords(TokenArray *tok_array, const KeywordTable *table) {
     for (int i = 0; i < tok_array->size; i += VECTOR_SIZE) {
         const __m256i current_vec = load_vector((const char *) tok_array->token_types + i);
         const __m256i mask = _mm256_cmpeq_epi8(
@@ -115,40 +1183,19 @@ void find_keywords(TokenArray *tok_array, short *lookup) {
 
         for (int j = 0; j < size; ++j) {
             int pos = i + token_indices[j];
-            char str[9] = {0};
-            strncpy(str, tok_array->src + tok_array->token_locs[pos], 8);
 
-            const uint64_t val = *((uint64_t*) str);
-            const uint8_t hash_val = hash(val);
-            const uint8_t keyword_pos = lookup[hash_val];
+            // Types past the last token are left over from append_tokens, their locations were never written
+            if (pos >= tok_array->size)
+                break;
 
-            bool are_equal = strcmp(
-                    tok_array->src + tok_array->token_locs[pos],
-                    keywords[keyword_pos]
-                ) == 0;
-            TokenType keyword_type = keyword_types[keyword_pos];
+            const char *str = tok_array->src + tok_array->token_locs[pos];
 
-            // are_equal ? keyword_id : TOK_IDENT
-            tok_array->token_types[pos] = TOK_IDENT ^ ((keyword_type ^ TOK_IDENT) & -!!are_equal);;
+            tok_array->token_types[pos] = keyword_type(table, str);
         }
     }
 }
 void mm256_pext(__m256i *vector, __m256i mask, int *size) {
-    uint64_t mask_u64[4] __attribute__((aligned(32)));
-    uint64_t vector_u64[4] __attribute__((aligned(32)));
-    uint8_t result[32] __attribute__((aligned(32)));
-
-    _mm256_store_si256((__m256i*)mask_u64, mask);
-    _mm256_store_si256((__m256i*)vector_u64, *vector);
-
-    *size = 0;
-    for (int i = 0; i < 4; ++i) {
-        const uint64_t temp = _pext_u64(vector_u64[i], mask_u64[i]);
-        memcpy(result + *size, &temp, sizeof(uint64_t));
-        *size += _mm_popcnt_u64(mask_u64[i]) >> 3;
-    }
-
-    *vector = _mm256_load_si256((__m256i*)result);
+    kernels.pext(vector, mask, size);
 }
 
 __m256i non_zero_mask(const __m256i vector) {
@@ -228,44 +1275,257 @@ bool is_empty(__m256i vector) {
     return _mm256_movemask_epi8(c) == UINT_MAX;
 }
 
-__m256i run_sublexers(__m256i *current_vec, __m256i *next_vec, const __m256i src_current_vec, char last_char, bool *ch_continue, bool *
-                      escaped_continue, bool *str_continue, bool *ln_comm_continue, bool *block_comm_continue) {
+__m256i run_sublexers(__m256i *current_vec, __m256i *next_vec, const __m256i src_current_vec, LexState *state) {
     __m256i tags = _mm256_setzero_si256();
 
-    line_comments_sub_lex(current_vec, *next_vec, ln_comm_continue);
-    block_comments_sub_lex(current_vec, next_vec, block_comm_continue);
-
-    if (is_empty(*current_vec))
+    uint32_t splice_joined;
+    uint32_t splice_join_pos;
+    const uint32_t splices = line_splices_sub_lex(
+        *current_vec, *next_vec, state->last_char,
+        &state->splice_continue, &state->splice_join_continue,
+        &splice_joined, &splice_join_pos);
+
+    // Bytes cleared by the comment sub lexers, the first one may have been cleared with the previous vector
+    const uint32_t zero_before = _mm256_movemask_epi8(_mm256_cmpeq_epi8(*current_vec, _mm256_setzero_si256()))
+                                 & ~(uint32_t) state->comment_carry;
+    const char next_first = (char) _mm256_extract_epi8(*next_vec, 0);
+
+    // Comment openers inside literals, quotes inside comments or the other kind of literal
+    const uint32_t hidden = hidden_delimiters(*current_vec, *next_vec, splices, state);
+
+    line_comments_sub_lex(current_vec, *next_vec, splices, hidden, &state->ln_comm_continue);
+    block_comments_sub_lex(current_vec, next_vec, hidden, &state->block_comm_continue);
+
+    state->comment_region = _mm256_movemask_epi8(_mm256_cmpeq_epi8(*current_vec, _mm256_setzero_si256()))
+                            & ~zero_before;
+    state->comment_carry = next_first != 0 && _mm256_extract_epi8(*next_vec, 0) == 0;
+    state->splice_region = splices & ~state->comment_region;
+
+    if (is_empty(*current_vec)) {
+        state->lit_region = 0;
+        state->error_region = 0;
+        state->num_continue = 0;
+        state->exp_continue = 0;
+        state->splice_join_continue = 0;
+        state->cp_carry = 0;
         return tags;
+    }
+
+    const uint32_t invalid_cps = unicode_sub_lex(current_vec, *next_vec, state->last_char,
+                                                 &state->cp_carry, &state->cp_carry_invalid);
+
+    const uint32_t stray = _mm256_movemask_epi8(
+        _mm256_or_si256(
+            _mm256_or_si256(
+                _mm256_cmpeq_epi8(*current_vec, _mm256_set1_epi8('@')),
+                _mm256_cmpeq_epi8(*current_vec, _mm256_set1_epi8('$'))
+            ),
+            _mm256_cmpeq_epi8(*current_vec, _mm256_set1_epi8('`'))
+        )
+    );
+
+    // Keep only splices joining tokens outside comments
+    splice_joined &= ~_mm256_movemask_epi8(_mm256_cmpeq_epi8(*current_vec, _mm256_setzero_si256()));
+    state->splice_region &= ~splice_joined;
 
-    three_byte_punct_sub_lex(current_vec, next_vec, &tags);
-    two_byte_punct_sub_lex(current_vec, next_vec, &tags);
-    one_byte_punct_sub_lex(current_vec, *next_vec, &tags, last_char);
+    const bool num_continued = state->num_continue;
+    const uint32_t num_region = numeric_region_mask(
+        *current_vec, *next_vec, state->last_char,
+        splice_joined, splice_join_pos,
+        &state->num_continue, &state->exp_continue);
+
+    three_byte_punct_sub_lex(current_vec, next_vec, &tags, num_region, state->dialect);
+    two_byte_punct_sub_lex(current_vec, next_vec, &tags, num_region, state->dialect);
+    one_byte_punct_sub_lex(current_vec, &tags, num_region);
 
     replace_white_space(current_vec);
 
-    identifiers_sub_lex(*current_vec, &tags, last_char == 0);
-    numeric_const_sub_lex(*current_vec, &tags, last_char == 0);
+    // Put back splices inside tokens so that they are not split
+    *current_vec = _mm256_blendv_epi8(
+        *current_vec,
+        src_current_vec,
+        get_mask(splice_joined)
+    );
+
+    identifiers_sub_lex(*current_vec, &tags, state->last_char == 0);
+    numeric_const_sub_lex(num_region, num_continued, &tags);
 
-    bool dummy = *escaped_continue;
-    text_lit_sub_lex(current_vec, &tags, '\'',
-                     ch_continue, TOK_CHAR_LIT,
-                     src_current_vec, &dummy);
+    const uint32_t ident_starts = _mm256_movemask_epi8(
+        _mm256_cmpeq_epi8(tags, _mm256_set1_epi8(TOK_IDENT))
+    );
+
+    const bool lit_continued = state->ch_continue | state->str_continue;
+
+    bool dummy = state->escaped_continue;
+    uint32_t lit_region = text_lit_sub_lex(current_vec, &tags, '\'',
+                                           &state->ch_continue, TOK_CHAR_LIT,
+                                           src_current_vec, hidden, &dummy);
+
+    lit_region |= text_lit_sub_lex(current_vec, &tags, '"',
+                                   &state->str_continue, TOK_STR_LIT,
+                                   src_current_vec, hidden, &state->escaped_continue);
 
-    text_lit_sub_lex(current_vec, &tags, '"',
-                     str_continue, TOK_STR_LIT,
-                     src_current_vec, escaped_continue);
+    // Add the closing delimiters
+    state->lit_region = lit_region | (~lit_region & ((lit_region << 1) | lit_continued));
+
+    // Errors are only located if any is found: stray characters, and newlines inside literals
+    const uint32_t newlines = _mm256_movemask_epi8(_mm256_cmpeq_epi8(src_current_vec, _mm256_set1_epi8('\n')));
+    state->error_region = ((stray | invalid_cps) & ~state->lit_region) | (newlines & lit_region & ~splices);
+
+    encoding_prefix_sub_lex(*current_vec, *next_vec, &tags, ident_starts, &state->prefix_carry);
 
     replace_token_body(&tags);
 
     return tags;
 }
 
-TokenArray lex_file(char *file_path, char **file_content) {
+LexDialect dialect_from_path(const char *file_path) {
+    const char *extensions[] = {".cc", ".cpp", ".cxx", ".hh", ".hpp", ".hxx"};
+    const char *ext = strrchr(file_path, '.');
+
+    if (ext == NULL)
+        return LEX_DIALECT_C;
+
+    for (int i = 0; i < sizeof(extensions) / sizeof(extensions[0]); ++i) {
+        if (strcmp(ext, extensions[i]) == 0)
+            return LEX_DIALECT_CPP;
+    }
+
+    return LEX_DIALECT_C;
+}
+
+void print_lex_errors(const char *file_path, const LexOptions *options) {
+    const int max_errors = 64;
+    LexError errors[max_errors];
+
+    // Lexing modified the buffer, read the file again
+    long file_size;
+    char *file_content = read_file(file_path, &file_size, VECTOR_SIZE, NULL);
+
+    if (file_content == NULL)
+        return;
+
+    const int count = find_lex_errors(file_content, file_size, options, errors, max_errors);
+
+    // Errors come mostly in order, lines are counted on from the previous one
+    long scanned = 0;
+    long line = 1;
+    long line_start = 0;
+
+    for (int i = 0; i < count && i < max_errors; ++i) {
+        const long offset = errors[i].offset;
+
+        if (offset < scanned) {
+            scanned = 0;
+            line = 1;
+            line_start = 0;
+        }
+
+        for (const char *nl; (nl = memchr(file_content + scanned, '\n', offset - scanned)) != NULL;) {
+            scanned = nl - file_content + 1;
+            line_start = scanned;
+            ++line;
+        }
+
+        scanned = offset;
+
+        fprintf(stderr, "%s:%ld:%ld: error: %s.\n", file_path, line, offset - line_start + 1,
+                lex_error_message(errors[i].kind));
+    }
+
+    if (count > max_errors) {
+        fprintf(stderr, "%s: %d more errors.\n", file_path, count - max_errors);
+    }
+
+    free(file_content);
+}
+
+// Bytes a file takes in a pack, laid out like the buffer of read_file
+static long packed_size(long file_size) {
+    const long size = file_size + 1;
+    return size + (VECTOR_SIZE - size % VECTOR_SIZE) % VECTOR_SIZE + VECTOR_SIZE;
+}
+
+bool pack_files(char **paths, int count, const AllocPolicy *policy, FilePack *pack) {
+    *pack = (FilePack) {0};
+    pack->files = malloc(count * sizeof(PackedFile));
+
+    if (pack->files == NULL) {
+        fprintf(stderr, "Memory allocation failure.\n");
+        return false;
+    }
+
+    pack->count = count;
+
+    // Size every file first so that the arena is allocated once
+    for (int f = 0; f < count; ++f) {
+        struct stat file_stat;
+
+        if (stat(paths[f], &file_stat) != 0) {
+            fprintf(stderr, "Error opening file.\n");
+            free_file_pack(pack);
+            return false;
+        }
+
+        pack->files[f] = (PackedFile) {0};
+        pack->files[f].offset = pack->size;
+        pack->files[f].size = file_stat.st_size;
+        pack->size += packed_size(file_stat.st_size);
+    }
+
+    pack->arena = policy_alloc(pack->size, VECTOR_SIZE, policy);
+
+    if (pack->arena == NULL) {
+        fprintf(stderr, "Memory allocation failure.\n");
+        free_file_pack(pack);
+        return false;
+    }
+
+    for (int f = 0; f < count; ++f) {
+        const PackedFile *file = &pack->files[f];
+        char *content = pack->arena + file->offset;
+
+        FILE *stream = fopen(paths[f], "r");
+        if (!stream) {
+            fprintf(stderr, "Error opening file.\n");
+            free_file_pack(pack);
+            return false;
+        }
+
+        const size_t bytes_read = fread(content, 1, file->size, stream);
+        fclose(stream);
+
+        if (bytes_read != file->size) {
+            fprintf(stderr, "Error reading file.\n");
+            free_file_pack(pack);
+            return false;
+        }
+
+        memset(content + file->size, 0, packed_size(file->size) - file->size);  // Null-terminate and clear padding
+    }
+
+    return true;
+}
+
+void free_file_pack(FilePack *pack) {
+    free(pack->arena);
+    free(pack->files);
+    *pack = (FilePack) {0};
+}
+
+TokenArray lex_file(char *file_path, char **file_content, const LexOptions *options) {
     long file_size;
-    *file_content = read_file(file_path, &file_size, VECTOR_SIZE);
+    *file_content = read_file(file_path, &file_size, VECTOR_SIZE, &options->alloc);
 
-    TokenArray tokens = lex(*file_content, file_size);
+    return lex_file_content(file_path, *file_content, file_size, options);
+}
+
+TokenArray lex_file_content(const char *file_path, char *file_content, long file_size, const LexOptions *options) {
+    TokenArray tokens = lex(file_content, file_size, options);
+
+    if (tokens.has_errors) {
+        print_lex_errors(file_path, options);
+    }
 
     // Append end-of-file token
     append_token(
@@ -273,6 +1533,19 @@ TokenArray lex_file(char *file_path, char **file_content) {
         create_token(TOK_EOF, file_size)
     );
 
+    if (tokens.symbol_ids != NULL) {
+        tokens.symbol_ids[tokens.size - 1] = SYMBOL_NONE;
+    }
+
+    if (tokens.bracket_matches != NULL) {
+        tokens.bracket_matches[tokens.size - 1] = BRACKET_NONE;
+    }
+
+    // Clang starts the end-of-file token without flags
+    if (tokens.token_flags != NULL) {
+        tokens.token_flags[tokens.size - 1] = 0;
+    }
+
     return tokens;
 }
 
@@ -291,55 +1564,154 @@ __m256i mm256_cmpistrm_any(__m128i match, __m256i vector) {
 }
 
 __m256i mm256_cmpistrm_range(__m128i ranges, __m256i vector, int num_ranges) {
-    // Split vector in two for `_mm_cmpistrm`
-    __m128i low_vector = _mm256_extractf128_si256(vector, 0);
-    __m128i high_vector = _mm256_extractf128_si256(vector, 1);
+    return kernels.cmpistrm_range(ranges, vector, num_ranges);
+}
+
+uint32_t unicode_sub_lex(
+    __m256i *current_vec,
+    const __m256i next_vec,
+    const char last_char,
+    uint8_t *cp_carry,
+    bool *cp_carry_invalid
+) {
+    uint32_t non_ascii = _mm256_movemask_epi8(*current_vec);
 
-    __m128i low_outside_range_mask = _mm_cmpestrm(ranges, num_ranges, low_vector, 16, (1 << 6) | (1 << 2));
-    __m128i high_outside_range_mask = _mm_cmpestrm(ranges, num_ranges, high_vector, 16, (1 << 6) | (1 << 2));
+    // ASCII-only fast path
+    if (!(non_ascii | *cp_carry))
+        return 0;
 
-    return _mm256_set_m128i(
-        high_outside_range_mask,
-        low_outside_range_mask
+    uint8_t bytes[2 * VECTOR_SIZE] __attribute__((aligned(32)));
+    _mm256_store_si256((__m256i *) bytes, *current_vec);
+    _mm256_store_si256((__m256i *) (bytes + VECTOR_SIZE), next_vec);
+
+    // Bytes of a code point started in the previous vector
+    uint64_t invalid = *cp_carry_invalid ? *cp_carry : 0;
+    non_ascii &= ~(uint32_t) *cp_carry;
+    *cp_carry = 0;
+
+    while (non_ascii) {
+        const int pos = __builtin_ctz(non_ascii);
+
+        uint32_t cp;
+        const int len = utf8_decode(bytes + pos, &cp);
+        const uint64_t cp_mask = ((1ull << (len ? len : 1)) - 1) << pos;
+
+        const bool ident_before = pos ? is_ident_char((char) bytes[pos - 1]) && !((invalid >> (pos - 1)) & 1)
+                                      : is_ident_char(last_char);
+        const bool valid = len && (ident_before ? is_xid_continue(cp) : is_xid_start(cp));
+
+        invalid |= valid ? 0 : cp_mask;
+        non_ascii &= ~(uint32_t) cp_mask;
+
+        *cp_carry = cp_mask >> 32;
+        *cp_carry_invalid = !valid;
+    }
+
+    // Code points that are not identifier characters separate tokens
+    *current_vec = _mm256_blendv_epi8(
+        *current_vec,
+        _mm256_setzero_si256(),
+        get_mask(invalid)
     );
+
+    return invalid;
 }
 
-__m256i numeric_periods_mask(__m256i current_vec, __m256i next_vec, char last_char) {
-    uint64_t is_period = _mm256_movemask_epi8(
-        _mm256_cmpeq_epi8(
-            current_vec,
-            _mm256_set1_epi8('.')
+uint32_t numeric_region_mask(
+    const __m256i current_vec,
+    const __m256i next_vec,
+    const char last_char,
+    const uint32_t splice_joined,
+    const uint32_t splice_join_pos,
+    bool *num_continue,
+    bool *exp_continue
+) {
+    const __m256i shifted_1 = look_ahead_one(current_vec, next_vec);
+
+    const uint64_t is_ident = (uint32_t) _mm256_movemask_epi8(ident_char_mask(current_vec));
+    const uint64_t is_digit = (uint32_t) _mm256_movemask_epi8(num_mask(current_vec));
+    const uint64_t has_digit_after = (uint32_t) _mm256_movemask_epi8(num_mask(shifted_1));
+    const uint64_t has_ident_after = (uint32_t) _mm256_movemask_epi8(ident_char_mask(shifted_1));
+
+    const uint64_t is_period = (uint32_t) _mm256_movemask_epi8(
+        _mm256_cmpeq_epi8(current_vec, _mm256_set1_epi8('.'))
+    );
+    const uint64_t is_quote = (uint32_t) _mm256_movemask_epi8(
+        _mm256_cmpeq_epi8(current_vec, _mm256_set1_epi8('\''))
+    );
+    const uint64_t is_sign = (uint32_t) _mm256_movemask_epi8(
+        _mm256_or_si256(
+            _mm256_cmpeq_epi8(current_vec, _mm256_set1_epi8('+')),
+            _mm256_cmpeq_epi8(current_vec, _mm256_set1_epi8('-'))
         )
     );
-    uint64_t has_num_after = _mm256_movemask_epi8(num_mask(look_ahead_one(current_vec, next_vec)));
-    uint64_t has_num_before = _mm256_movemask_epi8(num_mask(current_vec));
-    has_num_before = (has_num_before << 1) | (last_char >= '0' && last_char <= '9');
+    const uint64_t is_exp = (uint32_t) _mm256_movemask_epi8(
+        _mm256_or_si256(
+            _mm256_or_si256(
+                _mm256_cmpeq_epi8(current_vec, _mm256_set1_epi8('e')),
+                _mm256_cmpeq_epi8(current_vec, _mm256_set1_epi8('E'))
+            ),
+            _mm256_or_si256(
+                _mm256_cmpeq_epi8(current_vec, _mm256_set1_epi8('p')),
+                _mm256_cmpeq_epi8(current_vec, _mm256_set1_epi8('P'))
+            )
+        )
+    );
+
+    const uint64_t has_ident_before = (is_ident << 1) | is_ident_char(last_char) | splice_join_pos;
+
+    // A pp-number starts at a digit that does not continue an identifier, or at a period followed by a digit
+    const uint64_t starts = (is_digit & ~has_ident_before)
+                            | (is_period & has_digit_after)
+                            | *num_continue;
 
-    return get_mask(is_period & (has_num_before | has_num_after));
+    // Bytes that may continue a pp-number unconditionally: [0-9A-Za-z_.] and line splices
+    const uint64_t base = is_ident | is_period | splice_joined;
+
+    /* Exponent signs and digit separators only continue a number when the byte
+       before them is already inside it, so grow the region until it is stable. */
+    uint64_t extra = 0;
+    uint64_t prev_extra;
+    uint64_t region;
+
+    do {
+        prev_extra = extra;
+
+        const uint64_t body = base | extra;
+        const uint64_t body_starts = starts & body;
+
+        // Extend every start over the run of body bytes that follows it
+        region = ((body & ~(body + body_starts)) | body_starts) & 0xFFFFFFFF;
+
+        const uint64_t in_region_before = (region << 1) | *num_continue;
+        const uint64_t exp_before = ((region & is_exp) << 1) | *exp_continue;
+
+        extra = (exp_before & is_sign)                                  // 1e-5, 0x1p+3
+                | (in_region_before & is_quote & has_ident_after);      // 1'000
+    } while (extra != prev_extra);
+
+    *num_continue = (region >> 31) & 1;
+    *exp_continue = ((region & is_exp) >> 31) & 1;
+
+    return region;
 }
 
 __m256i vectorized_classification_one_byte(__m256i input) {
-    __m256i lower_nibble_mask = _mm256_set_epi8(
-            0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F,
-            0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F,
-            0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F,
-            0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F
-    );
-    __m256i lookup1 = _mm256_set_epi8(
-            3,  15,  15,  11,  15,  3,  1,  1,
-            0,  1,  1,  0,  0,  0,  1,  0,
-            3,  15,  15,  11,  15,  3,  1,  1,
-            0,  1,  1,  0,  0,  0,  1,  0
+    __m256i lower_nibble_mask = _mm256_set1_epi8(0x0F);
+
+    // Bit per high nibble class of each low nibble (generated)
+    __m256i lookup1 = _mm256_setr_epi8(
+            ONE_BYTE_PUNCT_LOW_NIBBLES,
+            ONE_BYTE_PUNCT_LOW_NIBBLES
     );
     __m256i mask1 = _mm256_shuffle_epi8(lookup1, _mm256_and_si256(lower_nibble_mask, input));
 
     input = _mm256_srli_epi32 (input, 4);
 
-    __m256i lookup2 = _mm256_set_epi8(
-            0,  0,  0,  0,  0,  0,  0,  0,
-            8,  0,  4,  0,  2,  1,  0,  0,
-            0,  0,  0,  0,  0,  0,  0,  0,
-            8,  0,  4,  0,  2,  1,  0,  0
+    // Class bit of each high nibble (generated)
+    __m256i lookup2 = _mm256_setr_epi8(
+            ONE_BYTE_PUNCT_HIGH_NIBBLES,
+            ONE_BYTE_PUNCT_HIGH_NIBBLES
     );
 
     __m256i mask2 = _mm256_shuffle_epi8(lookup2, _mm256_and_si256(lower_nibble_mask, input));
@@ -353,13 +1725,13 @@ __m256i vectorized_classification_one_byte(__m256i input) {
         );
 }
 
-void one_byte_punct_sub_lex(__m256i *current_vec, __m256i next_vec, __m256i *tags, char last_char) {
+void one_byte_punct_sub_lex(__m256i *current_vec, __m256i *tags, const uint32_t num_region) {
     __m256i mask = vectorized_classification_one_byte(*current_vec);
 
-    // Ignore periods part of numeric constants
-    mask = _mm256_xor_si256(
-        mask,
-        numeric_periods_mask(*current_vec, next_vec, last_char)
+    // Ignore periods and exponent signs part of numeric constants
+    mask = _mm256_andnot_si256(
+        get_mask(num_region),
+        mask
     );
 
     // Overlay found one-byte punctators over tags
@@ -418,88 +1790,82 @@ void remove_prefix_64(__m256i *vector, uint64_t prefix) {
     );
 }
 
-void two_byte_punct_sub_lex(__m256i *current_vec, __m256i *next_vec, __m256i *tags) {
+void byte_masks(uint32_t *masks, const __m256i vector, const char *bytes, const int from, const int to) {
+    for (int i = from; i < to; ++i) {
+        masks[i] = _mm256_movemask_epi8(
+            _mm256_cmpeq_epi8(
+                vector,
+                _mm256_set1_epi8(bytes[i])
+            )
+        );
+    }
+}
+
+void two_byte_punct_sub_lex(__m256i *current_vec, __m256i *next_vec, __m256i *tags, const uint32_t num_region,
+                            const LexDialect dialect) {
     const __m256i shifted_1 = look_ahead_one(*current_vec, *next_vec);
 
-    // Search for first bytes: [-, %, *, <, ^, !, &, >, |, =, +, /]
     /* NOTE: I expect the compiler to optimize away these variables and
               run cmpeq in parallel to maximize throughput. */
 
-    const char *first_bytes = ">+^!&*|%<-=/";
-    uint32_t first_masks[12];
-
-    for (int i = 0; i < 12; ++i) {
-        first_masks[i] = _mm256_movemask_epi8(
-            _mm256_cmpeq_epi8(
-                *current_vec,
-                _mm256_set1_epi8(first_bytes[i])
-            )
-        );
-    }
+    // Masks of the first and second bytes, C++ only bytes last (generated)
+    const char *first_bytes = TWO_BYTE_FIRST_BYTES;
+    const char *second_bytes = TWO_BYTE_SECOND_BYTES;
+    uint32_t first_masks[TWO_BYTE_FIRST_COUNT];
+    uint32_t second_masks[TWO_BYTE_SECOND_COUNT];
 
-    // Search for second bytes: [+, &, |, <, -, =, >]
-    const char *second_bytes = "+&|<-=>";
-    uint32_t second_masks[7];
+    byte_masks(first_masks, *current_vec, first_bytes, 0, TWO_BYTE_FIRST_COUNT_C);
+    byte_masks(second_masks, shifted_1, second_bytes, 0, TWO_BYTE_SECOND_COUNT_C);
 
-    for (int i = 0; i < 7; ++i) {
-        second_masks[i] = _mm256_movemask_epi8(
-                _mm256_cmpeq_epi8(
-                shifted_1,
-                _mm256_set1_epi8(second_bytes[i])
-            )
-        );
+    if (dialect == LEX_DIALECT_CPP) {
+        byte_masks(first_masks, *current_vec, first_bytes, TWO_BYTE_FIRST_COUNT_C, TWO_BYTE_FIRST_COUNT);
+        byte_masks(second_masks, shifted_1, second_bytes, TWO_BYTE_SECOND_COUNT_C, TWO_BYTE_SECOND_COUNT);
     }
 
-    // Go through all two-byte punctuators
-    const uint8_t punct_data[19][2] = {
-        {4, 1},     // &&
-        {9, 5},     // -=
-        {0, 5},     // >=
-        {4, 5},     // &=
-        {9, 6},     // ->
-        {0, 6},     // >>
-        {5, 5},     // *=
-        {11, 5},    // /=
-        {2, 5},     // ^=
-        {1, 0},     // ++
-        {8, 3},     // <<
-        {6, 5},     // |=
-        {1, 5},     // +=
-        {8, 5},     // <=
-        {6, 2},     // ||
-        {9, 4},     // --
-        {10, 5},    // ==
-        {3, 5},     // !=
-        {7, 5},     // %=
-    };
+    // Go through all two-byte punctuators: {first, second, remapped type}
+    const uint8_t punct_data[TWO_BYTE_PUNCT_COUNT][3] = {TWO_BYTE_PUNCT_DATA};
+    const int punct_count = dialect == LEX_DIALECT_CPP ? TWO_BYTE_PUNCT_COUNT : TWO_BYTE_PUNCT_COUNT_C;
+
+    // Get token types: current_vec + shifted_1 - 2
+    __m256i tok_types = _mm256_sub_epi8(
+        _mm256_adds_epu8(
+            *current_vec,
+            shifted_1
+        ),
+        _mm256_set1_epi8(2)
+    );
 
     // Store temporary found tags here to not delete from *tags
     uint32_t mask = 0;
 
     /* NOTE: I expect the compiler to optimize away loop local variables. */
-    for (int i = 0; i < 19; ++i) {
+    for (int i = 0; i < punct_count; ++i) {
         const uint8_t x = punct_data[i][0];
         const uint8_t y = punct_data[i][1];
+        const uint32_t found = first_masks[x] & second_masks[y];
 
         // Update temporary tags
-        mask = mask | (first_masks[x] & second_masks[y]);
+        mask = mask | found;
+
+        // Punctuators whose byte sum collides with another token
+        if (punct_data[i][2]) {
+            tok_types = _mm256_blendv_epi8(
+                tok_types,
+                _mm256_set1_epi8(punct_data[i][2]),
+                get_mask(found)
+            );
+        }
     }
 
+    // Ignore punctuators starting inside numeric constants
+    mask &= ~num_region;
+
     // Remove middle tag in series of three consecutive tags
     mask = mask ^ (mask & (mask << 1) & (mask >> 1));
 
     // Remove right tag in series of two consecutive tags
     mask = mask ^ (mask & (mask << 1));
 
-    // Get token types
-    __m256i tok_types = _mm256_sub_epi8(    // current_vec + shifted_1 - 2
-        _mm256_adds_epu8(
-            *current_vec,
-            shifted_1
-        ),
-        _mm256_set1_epi8(2)
-    );
-
     // Update tags
     *tags = _mm256_blendv_epi8(
         *tags,
@@ -527,71 +1893,69 @@ void two_byte_punct_sub_lex(__m256i *current_vec, __m256i *next_vec, __m256i *ta
     remove_prefix_64(next_vec, carry);
 }
 
-void three_byte_punct_sub_lex(__m256i *current_vec, __m256i *next_vec, __m256i *tags) {
+void three_byte_punct_sub_lex(__m256i *current_vec, __m256i *next_vec, __m256i *tags, const uint32_t num_region,
+                              const LexDialect dialect) {
     // Lex [..., <<=, >>=]
     __m256i shifted_one = look_ahead_one(*current_vec, *next_vec);
     __m256i shifted_two = look_ahead_two(*current_vec, *next_vec);
 
     /* NOTE: I expect the compiler to optimize away these variables and
               run cmpeq in parallel to maximize throughput. */
-    const char *first_two_bytes = ".<>";
-
-    uint32_t first_masks[3];
-    uint32_t second_masks[3];
-    uint32_t third_mask[2];
-
-    for (int i = 0; i < 3; ++i) {
-        first_masks[i] = _mm256_movemask_epi8(
-            _mm256_cmpeq_epi8(
-                *current_vec,
-                _mm256_set1_epi8(first_two_bytes[i])
-            )
-        );
 
-        second_masks[i] = _mm256_movemask_epi8(
-            _mm256_cmpeq_epi8(
-                shifted_one,
-                _mm256_set1_epi8(first_two_bytes[i])
-            )
-        );
+    // Masks of each byte position, C++ only bytes last (generated)
+    const char *first_bytes = THREE_BYTE_FIRST_BYTES;
+    const char *second_bytes = THREE_BYTE_SECOND_BYTES;
+    const char *third_bytes = THREE_BYTE_THIRD_BYTES;
+    uint32_t first_masks[THREE_BYTE_FIRST_COUNT];
+    uint32_t second_masks[THREE_BYTE_SECOND_COUNT];
+    uint32_t third_masks[THREE_BYTE_THIRD_COUNT];
+
+    byte_masks(first_masks, *current_vec, first_bytes, 0, THREE_BYTE_FIRST_COUNT_C);
+    byte_masks(second_masks, shifted_one, second_bytes, 0, THREE_BYTE_SECOND_COUNT_C);
+    byte_masks(third_masks, shifted_two, third_bytes, 0, THREE_BYTE_THIRD_COUNT_C);
+
+    if (dialect == LEX_DIALECT_CPP) {
+        byte_masks(first_masks, *current_vec, first_bytes, THREE_BYTE_FIRST_COUNT_C, THREE_BYTE_FIRST_COUNT);
+        byte_masks(second_masks, shifted_one, second_bytes, THREE_BYTE_SECOND_COUNT_C, THREE_BYTE_SECOND_COUNT);
+        byte_masks(third_masks, shifted_two, third_bytes, THREE_BYTE_THIRD_COUNT_C, THREE_BYTE_THIRD_COUNT);
     }
 
-    const char *third_bytes = ".=";
-
-    for (int i = 0; i < 2; ++i) {
-        third_mask[i] = _mm256_movemask_epi8(
-            _mm256_cmpeq_epi8(
-                shifted_two,
-                _mm256_set1_epi8(third_bytes[i])
-            )
-        );
-    }
+    // {first, second, third, remapped type}
+    const uint8_t punct_data[THREE_BYTE_PUNCT_COUNT][4] = {THREE_BYTE_PUNCT_DATA};
+    const int punct_count = dialect == LEX_DIALECT_CPP ? THREE_BYTE_PUNCT_COUNT : THREE_BYTE_PUNCT_COUNT_C;
 
-    const uint8_t punct_data[3][3] = {
-        {0, 0, 0},  // ...
-        {1, 1, 1},  // <<=
-        {2, 2, 1},  // >>=
-    };
+    // current_vec + shifted_one + shifted_two
+    __m256i tok_types = _mm256_add_epi8(
+        *current_vec,
+        _mm256_add_epi8(
+            shifted_one,
+            shifted_two
+        )
+    );
 
     uint32_t mask = 0;
 
     /* NOTE: I expect the compiler to optimize away loop local variables. */
-    for (int i = 0; i < 3; ++i) {
+    for (int i = 0; i < punct_count; ++i) {
         const uint8_t x = punct_data[i][0];
         const uint8_t y = punct_data[i][1];
         const uint8_t z = punct_data[i][2];
+        const uint32_t found = first_masks[x] & second_masks[y] & third_masks[z];
 
-        mask = mask | (first_masks[x] & second_masks[y] & third_mask[z]);
+        mask = mask | found;
+
+        // Punctuators whose byte sum collides with another token
+        if (punct_data[i][3]) {
+            tok_types = _mm256_blendv_epi8(
+                tok_types,
+                _mm256_set1_epi8(punct_data[i][3]),
+                get_mask(found)
+            );
+        }
     }
 
-    // current_vec + shifted_one + shifted_two
-    __m256i tok_types = _mm256_add_epi8(
-        *current_vec,
-        _mm256_add_epi8(
-            shifted_one,
-            shifted_two
-        )
-    );
+    // Ignore punctuators starting inside numeric constants
+    mask &= ~num_region;
 
     // Update tags
     *tags = _mm256_blendv_epi8(
@@ -637,9 +2001,14 @@ void identifiers_sub_lex(__m256i current_vec, __m256i *tags, bool last_empty) {
         _mm256_set1_epi8('_')
     );
 
+    __m256i is_utf8_lead = _mm256_and_si256(    // Lead bytes >= 0xC0 left by unicode_sub_lex are XID_Start
+        _mm256_cmpgt_epi8(current_vec, _mm256_set1_epi8(-65)),
+        _mm256_cmpgt_epi8(_mm256_setzero_si256(), current_vec)
+    );
+
     __m256i ident_start_mask = _mm256_or_si256(
-        is_alpha,
-        is_underscore
+        _mm256_or_si256(is_alpha, is_underscore),
+        is_utf8_lead
     );
 
     uint32_t has_whitespace_before = _mm256_movemask_epi8(
@@ -671,53 +2040,65 @@ __m256i num_mask(__m256i vector) {
     return mm256_cmpistrm_range(ranges, vector, 2);
 }
 
-void numeric_const_sub_lex(
-    const __m256i current_vec,
-    __m256i *tags,
-    const bool last_empty
-) {
-    __m256i num_start_mask = num_mask(current_vec);
-
-    uint32_t has_whitespace_before = _mm256_movemask_epi8(
-        _mm256_cmpeq_epi8(
-            current_vec,
-            _mm256_setzero_si256()
-        )
+__m256i ident_char_mask(__m256i vector) {
+    __m128i ranges = _mm_set_epi8(
+        0,  0,  0,  0,  0,  0,  0,  0,
+        'z',  'a',  '_',  '_',  'Z',  'A',  '9',  '0'
     );
-    has_whitespace_before = (has_whitespace_before << 1) | last_empty;
+    const __m256i is_non_ascii = _mm256_cmpgt_epi8(_mm256_setzero_si256(), vector);
 
-    __m256i is_num_period = _mm256_cmpeq_epi8(
-        current_vec,    // All periods in current_vec are for numbers
-        _mm256_set1_epi8('.')
+    return _mm256_or_si256(
+        mm256_cmpistrm_range(ranges, vector, 8),
+        is_non_ascii
     );
+}
 
-    num_start_mask = _mm256_and_si256(
-        num_start_mask,
-        get_mask(has_whitespace_before)
-    );
+bool is_ident_char(const char c) {
+    return (c >= '0' && c <= '9') || (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || c == '_'
+           || (unsigned char) c >= 0x80;
+}
 
-    num_start_mask = _mm256_or_si256(
-        num_start_mask,
-        _mm256_and_si256(
-            is_num_period,
-            get_mask(has_whitespace_before)
-        )
+void numeric_const_sub_lex(
+    const uint32_t num_region,
+    const bool num_continued,
+    __m256i *tags
+) {
+    const uint32_t num_start = num_region & ~((num_region << 1) | num_continued);
+
+    // Hide the number body so that digit separators are not taken as char delimiters
+    *tags = _mm256_blendv_epi8(
+        *tags,
+        _mm256_set1_epi8(TOK_BODY),
+        get_mask(num_region)
     );
 
     *tags = _mm256_blendv_epi8(
         *tags,
         _mm256_set1_epi8(TOK_NUM),
-        num_start_mask
+        get_mask(num_start)
     );
 }
 
-void text_lit_sub_lex(
+// Bytes escaped by a backslash, the first one may be escaped by the previous vector
+static uint32_t escaped_bytes(uint32_t B, const bool escaped_continue) {
+    const uint32_t O = 0xAAAAAAAA;  // 10101010101010101010101010101010 in binary
+    const uint32_t E = 0x55555555;  // 01010101010101010101010101010101 in binary
+
+    B = (B ^ escaped_continue) & B;  // Remove escaped backslash
+
+    uint64_t escaped_ch = (((B + (B & ~(B << 1)& E))& ~B)& ~E) | (((B+ ((B & ~(B << 1))& O))&  ~B)& E);
+
+    return escaped_ch ^ escaped_continue;  // Add first character which might be escaped
+}
+
+uint32_t text_lit_sub_lex(
     __m256i *current_vec,
     __m256i *tags,
     const char delim,
     bool *does_continue,
     const TokenType type,
     const __m256i src_current_vec,
+    const uint32_t hidden,
     bool *escaped_continue
 ) {
     uint32_t is_delim = _mm256_movemask_epi8(  // Delimiter
@@ -740,15 +2121,8 @@ void text_lit_sub_lex(
         )
     );
 
-    const uint32_t O = 0xAAAAAAAA;  // 10101010101010101010101010101010 in binary
-    const uint32_t E = 0x55555555;  // 01010101010101010101010101010101 in binary
-
-    B = (B ^ (*escaped_continue)) & B;  // Remove escaped backslash
-
-    uint64_t escaped_ch = (((B + (B & ~(B << 1)& E))& ~B)& ~E) | (((B+ ((B & ~(B << 1))& O))&  ~B)& E);
-
-    escaped_ch ^= *escaped_continue;  // Add first character which might be escaped
-    is_delim ^= (escaped_ch & is_delim);
+    const uint32_t escaped_ch = escaped_bytes(B, *escaped_continue);
+    is_delim &= ~escaped_ch & ~hidden;
 
     uint32_t region = _mm_cvtsi128_si32(    // Literal region
         _mm_clmulepi64_si128(
@@ -788,9 +2162,406 @@ void text_lit_sub_lex(
         src_current_vec,
         get_mask(region)
     );
+
+    return region;
+}
+
+void encoding_prefix_sub_lex(
+    const __m256i current_vec,
+    const __m256i next_vec,
+    __m256i *tags,
+    const uint32_t ident_starts,
+    uint8_t *prefix_carry
+) {
+    // Remove delimiter tags of literals whose prefix ended the previous vector
+    *tags = _mm256_blendv_epi8(
+        *tags,
+        _mm256_setzero_si256(),
+        get_mask(*prefix_carry)
+    );
+
+    const __m256i shifted_1 = look_ahead_one(current_vec, next_vec);
+    const __m256i shifted_2 = look_ahead_two(current_vec, next_vec);
+
+    const __m256i is_L = _mm256_cmpeq_epi8(current_vec, _mm256_set1_epi8('L'));
+    const __m256i is_U = _mm256_cmpeq_epi8(current_vec, _mm256_set1_epi8('U'));
+    const __m256i is_u = _mm256_cmpeq_epi8(current_vec, _mm256_set1_epi8('u'));
+
+    const uint32_t str_after_1 = _mm256_movemask_epi8(_mm256_cmpeq_epi8(shifted_1, _mm256_set1_epi8('"')));
+    const uint32_t str_after_2 = _mm256_movemask_epi8(_mm256_cmpeq_epi8(shifted_2, _mm256_set1_epi8('"')));
+    const uint32_t ch_after_1 = _mm256_movemask_epi8(_mm256_cmpeq_epi8(shifted_1, _mm256_set1_epi8('\'')));
+    const uint32_t ch_after_2 = _mm256_movemask_epi8(_mm256_cmpeq_epi8(shifted_2, _mm256_set1_epi8('\'')));
+    const uint32_t eight_after = _mm256_movemask_epi8(_mm256_cmpeq_epi8(shifted_1, _mm256_set1_epi8('8')));
+
+    // Identifiers L, u, U or u8 followed by a quote, which are still outside literals
+    const uint32_t still_ident = _mm256_movemask_epi8(
+        _mm256_cmpeq_epi8(*tags, _mm256_set1_epi8(TOK_IDENT))
+    );
+
+    const uint32_t prefix_1 = ident_starts & still_ident
+                              & _mm256_movemask_epi8(_mm256_or_si256(_mm256_or_si256(is_L, is_U), is_u))
+                              & (str_after_1 | ch_after_1);
+    const uint32_t prefix_2 = ident_starts & still_ident
+                              & _mm256_movemask_epi8(is_u) & eight_after
+                              & (str_after_2 | ch_after_2);
+
+    *prefix_carry = 0;
+
+    if (!(prefix_1 | prefix_2))
+        return;
+
+    // Char literal types are followed by their string literal types (+4)
+    __m256i types = _mm256_set1_epi8(TOK_UTF16_CHAR_LIT);
+    types = _mm256_blendv_epi8(types, _mm256_set1_epi8(TOK_WIDE_CHAR_LIT), is_L);
+    types = _mm256_blendv_epi8(types, _mm256_set1_epi8(TOK_UTF32_CHAR_LIT), is_U);
+    types = _mm256_blendv_epi8(types, _mm256_set1_epi8(TOK_UTF8_CHAR_LIT), get_mask(prefix_2));
+
+    types = _mm256_add_epi8(
+        types,
+        _mm256_and_si256(
+            get_mask((prefix_1 & str_after_1) | (prefix_2 & str_after_2)),
+            _mm256_set1_epi8(4)
+        )
+    );
+
+    // Move literal tag from the delimiter to the prefix
+    *tags = _mm256_blendv_epi8(
+        *tags,
+        types,
+        get_mask(prefix_1 | prefix_2)
+    );
+
+    const uint64_t delims = ((uint64_t) prefix_1 << 1) | ((uint64_t) prefix_2 << 2);
+
+    *tags = _mm256_blendv_epi8(
+        *tags,
+        _mm256_setzero_si256(),
+        get_mask(delims)
+    );
+
+    *prefix_carry = delims >> 32;
+}
+
+long raw_string_end(const char *input, const long start, const long input_size) {
+    const char *str = input + start;
+    const int prefix_len = (str[0] == 'u' && str[1] == '8') ? 2 : (str[0] == 'L' || str[0] == 'u' || str[0] == 'U');
+
+    if (str[prefix_len] != 'R' || str[prefix_len + 1] != '"')
+        return 0;
+
+    // Delimiter of at most 16 characters, ended by (
+    const char *delim = str + prefix_len + 2;
+    int delim_len = 0;
+
+    while (delim_len < 16 && delim[delim_len] > ' ' && delim[delim_len] != '(' && delim[delim_len] != ')'
+           && delim[delim_len] != '\\' && delim[delim_len] != '"') {
+        ++delim_len;
+    }
+
+    if (delim[delim_len] != '(')
+        return 0;
+
+    // Find )delim"
+    char terminator[18];
+    terminator[0] = ')';
+    memcpy(terminator + 1, delim, delim_len);
+    terminator[delim_len + 1] = '"';
+
+    const char *body = delim + delim_len + 1;
+    const char *end = memmem(body, input + input_size - body, terminator, delim_len + 2);
+
+    return end ? end - input + delim_len + 2 : input_size + 1;
+}
+
+// Bytes of the current vector inside comments and literals once raw strings are hidden, the state is left as is
+static uint32_t comment_and_literal_region(__m256i current_vec, __m256i next_vec, const __m256i src_current_vec,
+                                           const LexState *state, const uint32_t raw_region) {
+    LexState trial = *state;
+
+    current_vec = _mm256_blendv_epi8(current_vec, _mm256_setzero_si256(), get_mask(raw_region));
+    run_sublexers(&current_vec, &next_vec, src_current_vec, &trial);
+
+    return trial.comment_region | trial.lit_region;
+}
+
+uint32_t raw_string_sub_lex(
+    const char *input,
+    const long pos,
+    const long input_size,
+    const __m256i current_vec,
+    const __m256i next_vec,
+    const __m256i src_current_vec,
+    LexState *state,
+    uint32_t *raw_starts
+) {
+    long *raw_end = &state->raw_end;
+    uint32_t region = 0;
+    *raw_starts = 0;
+
+    // Raw string continuing from previous vectors
+    if (*raw_end > pos) {
+        region = *raw_end - pos >= VECTOR_SIZE ? UINT32_MAX : (1u << (*raw_end - pos)) - 1;
+    }
+
+    const __m256i shifted_1 = look_ahead_one(current_vec, next_vec);
+    const __m256i shifted_2 = look_ahead_two(current_vec, next_vec);
+
+    const __m256i is_u = _mm256_cmpeq_epi8(current_vec, _mm256_set1_epi8('u'));
+    const __m256i is_prefix = _mm256_or_si256(
+        is_u,
+        _mm256_or_si256(
+            _mm256_cmpeq_epi8(current_vec, _mm256_set1_epi8('L')),
+            _mm256_cmpeq_epi8(current_vec, _mm256_set1_epi8('U'))
+        )
+    );
+    const __m256i r_after_1 = _mm256_cmpeq_epi8(shifted_1, _mm256_set1_epi8('R'));
+
+    // Candidates for R", LR", uR", UR" and u8R"
+    uint32_t candidates = _mm256_movemask_epi8(
+        _mm256_or_si256(
+            _mm256_or_si256(
+                _mm256_and_si256(
+                    _mm256_cmpeq_epi8(current_vec, _mm256_set1_epi8('R')),
+                    _mm256_cmpeq_epi8(shifted_1, _mm256_set1_epi8('"'))
+                ),
+                _mm256_and_si256(is_prefix, r_after_1)
+            ),
+            _mm256_and_si256(
+                _mm256_and_si256(is_u, _mm256_cmpeq_epi8(shifted_1, _mm256_set1_epi8('8'))),
+                _mm256_cmpeq_epi8(shifted_2, _mm256_set1_epi8('R'))
+            )
+        )
+    ) & ~region;
+
+    // Comments and literals carried from previous vectors or opened in this one hide candidates
+    uint32_t hidden = candidates ? comment_and_literal_region(current_vec, next_vec, src_current_vec, state, region) : 0;
+
+    while (candidates) {
+        const int p = __builtin_ctz(candidates);
+        candidates &= candidates - 1;
+
+        const long start = pos + p;
+        if (start < *raw_end || (start > 0 && is_ident_char(input[start - 1])) || (hidden >> p) & 1)
+            continue;
+
+        const long end = raw_string_end(input, start, input_size);
+        if (!end)
+            continue;
+
+        *raw_end = end > input_size ? input_size : end;    // Unterminated runs to end of input
+        state->raw_unterminated = end > input_size;
+        *raw_starts |= 1u << p;
+
+        const long region_end = *raw_end - pos;
+        region |= (region_end >= VECTOR_SIZE ? UINT32_MAX : (1u << region_end) - 1) & ~((1u << p) - 1);
+        candidates &= ~region;
+
+        // Comments and literals after the raw string are not the ones found with its bytes visible
+        if (candidates) {
+            hidden = comment_and_literal_region(current_vec, next_vec, src_current_vec, state, region);
+        }
+    }
+
+    return region;
+}
+
+void raw_string_tags(
+    __m256i *current_vec,
+    __m256i *tags,
+    const __m256i src_current_vec,
+    const __m256i src_next_vec,
+    const uint32_t raw_region,
+    const uint32_t raw_starts
+) {
+    const __m256i shifted_1 = look_ahead_one(src_current_vec, src_next_vec);
+
+    __m256i types = _mm256_set1_epi8(TOK_STR_LIT);
+    types = _mm256_blendv_epi8(types, _mm256_set1_epi8(TOK_WIDE_STR_LIT),
+                               _mm256_cmpeq_epi8(src_current_vec, _mm256_set1_epi8('L')));
+    types = _mm256_blendv_epi8(types, _mm256_set1_epi8(TOK_UTF32_STR_LIT),
+                               _mm256_cmpeq_epi8(src_current_vec, _mm256_set1_epi8('U')));
+    types = _mm256_blendv_epi8(types, _mm256_set1_epi8(TOK_UTF16_STR_LIT),
+                               _mm256_cmpeq_epi8(src_current_vec, _mm256_set1_epi8('u')));
+    types = _mm256_blendv_epi8(types, _mm256_set1_epi8(TOK_UTF8_STR_LIT),
+                               _mm256_and_si256(
+                                   _mm256_cmpeq_epi8(src_current_vec, _mm256_set1_epi8('u')),
+                                   _mm256_cmpeq_epi8(shifted_1, _mm256_set1_epi8('8'))
+                               ));
+
+    *tags = _mm256_blendv_epi8(
+        *tags,
+        _mm256_setzero_si256(),
+        get_mask(raw_region)
+    );
+
+    *tags = _mm256_blendv_epi8(
+        *tags,
+        types,
+        get_mask(raw_starts)
+    );
+
+    *current_vec = _mm256_blendv_epi8(
+        *current_vec,
+        src_current_vec,
+        get_mask(raw_region)
+    );
+}
+
+uint32_t line_splices_sub_lex(
+    const __m256i current_vec,
+    const __m256i next_vec,
+    const char last_char,
+    bool *splice_continue,
+    bool *join_continue,
+    uint32_t *joined,
+    uint32_t *join_pos
+) {
+    const __m256i shifted_1 = look_ahead_one(current_vec, next_vec);
+    const __m256i shifted_2 = look_ahead_two(current_vec, next_vec);
+
+    const uint32_t is_backslash = _mm256_movemask_epi8(_mm256_cmpeq_epi8(current_vec, _mm256_set1_epi8('\\')));
+    const uint32_t is_newline = _mm256_movemask_epi8(_mm256_cmpeq_epi8(current_vec, _mm256_set1_epi8('\n')));
+    const uint32_t nl_after_1 = _mm256_movemask_epi8(_mm256_cmpeq_epi8(shifted_1, _mm256_set1_epi8('\n')));
+    const uint32_t cr_after_1 = _mm256_movemask_epi8(_mm256_cmpeq_epi8(shifted_1, _mm256_set1_epi8('\r')));
+    const uint32_t nl_after_2 = _mm256_movemask_epi8(_mm256_cmpeq_epi8(shifted_2, _mm256_set1_epi8('\n')));
+
+    // Backslash followed by \n or \r\n
+    const uint32_t cr_splice = is_backslash & cr_after_1 & nl_after_2;
+    const uint32_t splice_start = (is_backslash & nl_after_1) | cr_splice;
+
+    uint32_t splice_end = is_newline & ((splice_start << 1) | (cr_splice << 2));
+    splice_end |= is_newline & -is_newline & -(uint32_t) *splice_continue; // First newline ends a carried splice
+
+    uint32_t region = _mm_cvtsi128_si32(    // Splice region
+        _mm_clmulepi64_si128(
+            _mm_set_epi32(0, 0, 0, splice_start ^ splice_end ^ (*splice_continue)),
+            _mm_set1_epi8(-1),
+            0
+        )
+    );
+
+    *splice_continue = (region >> 31) & 1;
+    region |= splice_end;
+
+    // Splices right after an identifier character join it with what follows
+    const uint64_t is_ident = (uint32_t) _mm256_movemask_epi8(ident_char_mask(current_vec));
+    const uint64_t join_start = (splice_start & ((is_ident << 1) | is_ident_char(last_char))) | *join_continue;
+
+    const uint64_t sum = region + join_start;
+
+    *joined = region & ~sum;
+    *join_pos = sum & ~(uint64_t) region;
+    *join_continue = (sum >> 32) & 1;
+
+    return region;
+}
+
+// Whether the quote at p of a vector separates digits, as in 1'000, rather than opening a char literal
+static bool digit_separator(const char *bytes, const int p, const LexState *state) {
+    int start = p;
+
+    while (start > 0 && (is_ident_char(bytes[start - 1]) || bytes[start - 1] == '.' || bytes[start - 1] == '\''
+                         || ((bytes[start - 1] == '+' || bytes[start - 1] == '-') && start > 1
+                             && ((bytes[start - 2] | 0x20) == 'e' || (bytes[start - 2] | 0x20) == 'p'))))
+        --start;
+
+    // The number may have started in the previous vector
+    if (start == 0 && is_ident_char(state->last_char))
+        return state->num_continue;
+
+    return start < p && ((bytes[start] >= '0' && bytes[start] <= '9')
+                         || (bytes[start] == '.' && bytes[start + 1] >= '0' && bytes[start + 1] <= '9'));
+}
+
+uint32_t hidden_delimiters(const __m256i current_vec, const __m256i next_vec, const uint32_t splices,
+                           const LexState *state) {
+    const __m256i shifted_1 = look_ahead_one(current_vec, next_vec);
+
+    const __m256i is_slash = _mm256_cmpeq_epi8(current_vec, _mm256_set1_epi8('/'));
+    const uint32_t line_starts = _mm256_movemask_epi8(
+        _mm256_and_si256(is_slash, _mm256_cmpeq_epi8(shifted_1, _mm256_set1_epi8('/'))));
+    const uint32_t block_starts = _mm256_movemask_epi8(
+        _mm256_and_si256(is_slash, _mm256_cmpeq_epi8(shifted_1, _mm256_set1_epi8('*'))));
+
+    const uint32_t escaped = escaped_bytes(
+        _mm256_movemask_epi8(_mm256_cmpeq_epi8(current_vec, _mm256_set1_epi8('\\'))), state->escaped_continue);
+    const uint32_t str_quotes = _mm256_movemask_epi8(_mm256_cmpeq_epi8(current_vec, _mm256_set1_epi8('"')))
+                                & ~escaped;
+    const uint32_t ch_quotes = _mm256_movemask_epi8(_mm256_cmpeq_epi8(current_vec, _mm256_set1_epi8('\'')))
+                               & ~escaped;
+
+    // Most vectors hold at most one kind, the sub lexers resolve those alone
+    const int kinds = (line_starts || state->ln_comm_continue) + (block_starts || state->block_comm_continue)
+                      + (str_quotes || state->str_continue) + (ch_quotes || state->ch_continue);
+
+    if (kinds < 2)
+        return 0;
+
+    const uint32_t block_ends = _mm256_movemask_epi8(
+        _mm256_and_si256(_mm256_cmpeq_epi8(current_vec, _mm256_set1_epi8('*')),
+                         _mm256_cmpeq_epi8(shifted_1, _mm256_set1_epi8('/'))));
+    const uint32_t newlines = _mm256_movemask_epi8(_mm256_cmpeq_epi8(current_vec, _mm256_set1_epi8('\n')))
+                              & ~splices;
+
+    const uint32_t openers = line_starts | block_starts | str_quotes | ch_quotes;
+    uint32_t rest = ~0u;    // Bytes not walked yet
+    uint32_t hidden = 0;
+
+    char bytes[VECTOR_SIZE];
+    _mm256_storeu_si256((__m256i *) bytes, current_vec);
+
+    // Jump from opener to closer, open is the character closing the current comment or literal, if any
+    char open = state->ln_comm_continue ? '\n' : state->block_comm_continue ? '*'
+                : state->str_continue ? '"' : state->ch_continue ? '\'' : 0;
+
+    while (true) {
+        if (open) {
+            const uint32_t closers = (open == '\n' ? newlines : open == '*' ? block_ends
+                                      : open == '"' ? str_quotes : ch_quotes) & rest;
+            const uint32_t closer = closers & -closers;
+
+            hidden |= openers & rest & (closer - 1);
+
+            if (!closer)
+                break;
+
+            rest &= -closer << 1;
+
+            // The slash of a closer does not open anything, as in */* or *//
+            if (open == '*') {
+                hidden |= (closer << 1) & openers;
+                rest &= ~(closer << 1);
+            }
+
+            open = 0;
+        }
+
+        const uint32_t opener = openers & rest & -(openers & rest);
+
+        if (!opener)
+            break;
+
+        rest &= -opener << 1;
+
+        if (opener & line_starts) {
+            open = '\n';
+        } else if (opener & block_starts) {
+            open = '*';
+
+            // Nor does the star of an opener close it, as in /*/
+            rest &= ~(opener << 1);
+        } else if (opener & str_quotes) {
+            open = '"';
+        } else if (!digit_separator(bytes, __builtin_ctz(opener), state)) {
+            open = '\'';
+        }
+    }
+
+    return hidden;
 }
 
-void line_comments_sub_lex(__m256i *current_vec, __m256i next_vec, bool *ln_comm_continue) {
+void line_comments_sub_lex(__m256i *current_vec, __m256i next_vec, const uint32_t splices, const uint32_t hidden,
+                           bool *ln_comm_continue) {
     const __m256i shifted_1 = look_ahead_one(*current_vec, next_vec);
 
     __m256i is_slash = _mm256_cmpeq_epi8(
@@ -807,72 +2578,52 @@ void line_comments_sub_lex(__m256i *current_vec, __m256i next_vec, bool *ln_comm
             has_slash_after
         );
 
-    __m256i comment_end = _mm256_cmpeq_epi8(
-        *current_vec,
-        _mm256_set1_epi8('\n')
+    // Spliced newlines do not end comments
+    __m256i comment_end = _mm256_andnot_si256(
+        get_mask(splices),
+        _mm256_cmpeq_epi8(
+            *current_vec,
+            _mm256_set1_epi8('\n')
+        )
     );
 
-    __m256i region;
+    uint32_t starts = _mm256_movemask_epi8(comment_start) & ~hidden;
+    uint32_t ends = _mm256_movemask_epi8(comment_end);
+
+    // Newlines before the first comment, most of them, do not need a pass each
+    if (!*ln_comm_continue)
+        ends &= -(starts & -starts);
 
     uint32_t region32;
-    bool ok;
+    uint32_t mistakes;
 
     do {
-        uint32_t region_mask = _mm256_movemask_epi8(
-            _mm256_or_si256(
-                comment_start,
-                comment_end
-            )
-        );
-        region_mask ^= *ln_comm_continue;
-
-        region32 = _mm_cvtsi128_si32(    // Literal region
+        region32 = _mm_cvtsi128_si32(    // Comment region, the newline ending it excluded
             _mm_clmulepi64_si128(
-                _mm_set_epi32(0, 0, 0, region_mask),
+                _mm_set_epi32(0, 0, 0, (starts | ends) ^ *ln_comm_continue),
                 _mm_set1_epi8(-1),
                 0
             )
         );
 
-        __m256i outside_region = get_mask(~region32);
-        region = get_mask(region32);
-
-        __m256i mistakes_end = _mm256_and_si256(
-            region,
-            comment_end
-        );
-        comment_end = _mm256_xor_si256(   // remove mistakes if they exist
-            comment_end,
-            mistakes_end
-        );
-
-        ok = is_empty(mistakes_end);
+        // Slashes inside comments and newlines outside them do not toggle, the first one is a real mistake
+        mistakes = (starts & ~region32) | (ends & region32);
+        mistakes &= -mistakes;
 
-        if (ok) {
-            __m256i mistakes_start = _mm256_and_si256(
-                outside_region,
-                comment_start
-            );
-            comment_start = _mm256_xor_si256(   // remove mistakes if they exist
-                comment_start,
-                mistakes_start
-            );
-
-            ok = is_empty(mistakes_start);
-        }
-
-    } while (!ok);
+        starts &= ~mistakes;
+        ends &= ~mistakes;
+    } while (mistakes);
 
     *ln_comm_continue = (region32 >> 31) & 1;
 
     *current_vec = _mm256_blendv_epi8(
         *current_vec,
         _mm256_setzero_si256(),
-        region
+        get_mask(region32)
     );
 }
 
-void block_comments_sub_lex(__m256i *current_vec, __m256i *next_vec, bool *block_comm_continue) {
+void block_comments_sub_lex(__m256i *current_vec, __m256i *next_vec, const uint32_t hidden, bool *block_comm_continue) {
     const __m256i shifted_1 = look_ahead_one(*current_vec, *next_vec);
 
     __m256i is_slash = _mm256_cmpeq_epi8(
@@ -893,62 +2644,48 @@ void block_comments_sub_lex(__m256i *current_vec, __m256i *next_vec, bool *block
         _mm256_set1_epi8('*')
     );
 
-    __m256i comment_start = _mm256_and_si256(
-        is_slash,
-        has_star_after
-    );
+    uint32_t starts = _mm256_movemask_epi8(_mm256_and_si256(is_slash, has_star_after)) & ~hidden;
+    uint32_t ends = _mm256_movemask_epi8(_mm256_and_si256(is_star, has_slash_after));
 
-    __m256i comment_end = _mm256_and_si256(
-        is_star,
-        has_slash_after
-    );
+    if (!*block_comm_continue)
+        ends &= -(starts & -starts);
 
     uint32_t region32;
-    int ok;
+    uint32_t mistakes;
 
     do {
-        uint32_t region_mask = _mm256_movemask_epi8(
-            _mm256_or_si256(
-                comment_start,
-                comment_end
-            )
-        );
-        region_mask ^= *block_comm_continue;
-
-        region32 = _mm_cvtsi128_si32(    // Literal region
+        region32 = _mm_cvtsi128_si32(    // Comment region, from the opening slash to the closing star
             _mm_clmulepi64_si128(
-                _mm_set_epi32(0, 0, 0, region_mask),
+                _mm_set_epi32(0, 0, 0, (starts | ends) ^ *block_comm_continue),
                 _mm_set1_epi8(-1),
                 0
             )
         );
 
-        __m256i outside_region = get_mask(~region32);
-
-        __m256i mistakes = _mm256_and_si256(
-            outside_region,
-            comment_start
-        );
-
-        comment_start = _mm256_xor_si256(   // remove mistakes if they exist
-            comment_start,
-            mistakes
-        );
+        // Openers inside comments and closers outside them do not toggle, the first one is a real mistake.
+        // Neither does the star of an opener, as in /*/, or the slash of a closer, as in */*
+        mistakes = (starts & ~region32) | (ends & region32)
+                   | (ends & ((starts & region32) << 1)) | (starts & ((ends & ~region32) << 1));
+        mistakes &= -mistakes;
 
-        ok = is_empty(mistakes);
+        starts &= ~mistakes;
+        ends &= ~mistakes;
+    } while (mistakes);
 
-    } while (!ok);
+    // Bytes before a closer are in the comment, so are the two bytes of the closer
+    const uint32_t before = (region32 << 1) | *block_comm_continue;
+    const bool closes_last = (before >> 31) & ~(region32 >> 31) & 1;
 
-    //TODO: here
     *block_comm_continue = (region32 >> 31) & 1;
 
     *current_vec = _mm256_blendv_epi8(
         *current_vec,
         _mm256_setzero_si256(),
-        get_mask(region32 | (region32 << 1) | (region32 << 2))
+        get_mask(region32 | before | (before << 1))
     );
 
-    uint8_t carry = ((region32 & (1 << 30)) >> 30) * 0xFF;
+    // The slash of a closer or the star of an opener split by the vector boundary
+    uint8_t carry = (closes_last || (starts >> 31)) * 0xFF;
     remove_prefix_64(next_vec, carry);
 }
 
@@ -956,7 +2693,7 @@ __m256i load_vector(const char* pos) {
     return _mm256_loadu_si256((__m256i*) pos);
 }
 
-char* read_file(const char *filename, long *file_size, long pad_multiple) {
+char* read_file(const char *filename, long *file_size, long pad_multiple, const AllocPolicy *policy) {
     // Open file
     FILE *file = fopen(filename, "r");
     if (!file) {
@@ -975,10 +2712,9 @@ char* read_file(const char *filename, long *file_size, long pad_multiple) {
     size += padding;
 
     // Allocate aligned memory
-    char *file_content;
-    int result = posix_memalign((void **)&file_content, pad_multiple, size + VECTOR_SIZE);
-    if (result != 0) {
-        fprintf(stderr, "Memory allocation failed: %s.\n", strerror(result));
+    char *file_content = policy_alloc(size + VECTOR_SIZE, pad_multiple, policy);
+    if (file_content == NULL) {
+        fprintf(stderr, "Memory allocation failure.\n");
         fclose(file);
         return NULL;
     }
@@ -992,7 +2728,7 @@ char* read_file(const char *filename, long *file_size, long pad_multiple) {
         return NULL;
     }
 
-    file_content[*file_size] = '\0';    // Null-terminate the file content
+    memset(file_content + *file_size, 0, size + VECTOR_SIZE - *file_size);  // Null-terminate and clear padding
 
     // Clean up
     fclose(file);
@@ -3,7 +3,312 @@
 
 #include <stdbool.h>
 
+#include "intern.h"
+#include "memory.h"
 #include "tokens.h"
+#include "unicode.h"
+
+#define STREAM_TOKENS_MIN_INPUT (16L << 20)    // Inputs whose tokens are written with non-temporal stores
+
+typedef enum LexDialect LexDialect;
+enum LexDialect {
+    LEX_DIALECT_C,
+    LEX_DIALECT_CPP
+};
+
+typedef struct LexOptions LexOptions;
+struct LexOptions {
+    LexDialect dialect;         // Language of the input
+    SymbolTable *symbols;       // Intern identifiers into this table if not NULL
+    const TokenFilter *filter;  // Emit only these token types if not NULL (EOF is always appended)
+    AllocPolicy alloc;          // Allocation of token arrays and of files read by lex_file
+    bool match_brackets;        // Store the matching bracket of each bracket token
+    bool token_flags;           // Store the layout flags of each token, see TOKEN_START_OF_LINE
+};
+
+/**
+ * Perfect hash table from the first 8 bytes of a keyword to its type.
+ *  Entry 0 is empty.
+ */
+typedef struct KeywordTable KeywordTable;
+struct KeywordTable {
+    uint8_t lookup[1 << KEYWORD_HASH_BITS];
+    char spellings[KEYWORD_TABLE_SIZE][KEYWORD_MAX_LEN] __attribute__((aligned(16)));
+    uint8_t lengths[KEYWORD_TABLE_SIZE];
+    TokenType types[KEYWORD_TABLE_SIZE];
+    uint32_t multiplier;
+    int size;                   // Number of keywords
+};
+
+typedef enum LexErrorKind LexErrorKind;
+enum LexErrorKind {
+    LEX_ERROR_STRAY_CHAR,               // @, $ or ` outside literals and comments
+    LEX_ERROR_INVALID_CHAR,             // Code point that cannot be part of an identifier
+    LEX_ERROR_INVALID_UTF8,
+    LEX_ERROR_UNTERMINATED_LITERAL,     // String or character literal without closing quote on its line
+    LEX_ERROR_UNTERMINATED_RAW_STRING,
+    LEX_ERROR_UNTERMINATED_COMMENT
+};
+
+typedef struct LexError LexError;
+struct LexError {
+    LexErrorKind kind;
+    long offset;
+};
+
+typedef struct LexState LexState;
+struct LexState {
+    char last_char;             // Last character of the previous vector
+    bool ch_continue;           // Char literal continues into next vector
+    bool escaped_continue;      // First character of next vector is escaped
+    bool str_continue;          // String literal continues into next vector
+    bool ln_comm_continue;      // Line comment continues into next vector
+    bool block_comm_continue;   // Block comment continues into next vector
+    bool num_continue;          // Numeric constant continues into next vector
+    bool exp_continue;          // Previous vector ended with a number exponent
+    bool splice_continue;       // Line splice continues into next vector
+    bool splice_join_continue;  // Token continues after a line splice
+    uint8_t prefix_carry;       // Delimiters in next vector fused to an encoding prefix
+    uint8_t cp_carry;           // Bytes in next vector of a code point started in this one
+    bool cp_carry_invalid;      // That code point is not an identifier character
+    LexDialect dialect;         // Language of the input
+    long raw_end;               // End offset of the last raw string literal
+    bool raw_unterminated;      // That raw string runs to the end of input
+    uint32_t lit_region;        // Bytes of the current vector inside literals, delimiters included
+    uint32_t comment_region;    // Bytes of the current vector inside comments
+    bool comment_carry;         // First byte of the next vector was cleared by a block comment
+    uint32_t splice_region;     // Line splices of the current vector outside comments and tokens
+    uint32_t error_region;      // Bytes of the current vector with lexical errors
+};
+
+/**
+ * Lexing of one input, stopped after any vector and resumed by
+ *  lex_stream_block. Holds everything carried between vectors.
+ */
+typedef struct LexStream LexStream;
+struct LexStream {
+    char *input;
+    long input_size;
+    long pos;                   // Offset of the next vector to lex
+    __m256i current_vec;
+    __m256i src_current_vec;    // Unmodified copy of current_vec
+    LexState state;
+    Utf8Checker utf8_checker;
+    uint32_t errors;            // Error bits of all vectors
+    bool filter;                // Filter tags with filter_lo and filter_hi
+    bool post_filter;           // Filter tokens again once keywords are known
+    __m256i filter_lo;
+    __m256i filter_hi;
+    bool stream_tokens;         // Write tokens with non-temporal stores
+    TokenStage stage;
+    TokenArray tokens;
+    bool line_start;            // Only white space and comments since the last newline or the start of input
+    bool space_before;          // The last vector ended with white space or a comment
+    bool backslash_before;      // The last vector ended with a backslash
+};
+
+/**
+ * Start lexing an input.
+ *
+ * @param stream Stream to initialize.
+ * @param input Input padded like for lex, modified while lexing.
+ * @param input_size Length of input.
+ * @param options Lexer options.
+ * @param keyword_table Keyword table of the dialect, for the tag filter.
+ * @param tokens Empty array tokens are appended to, with room for
+ *  VECTOR_SIZE entries past the last token. The caller may swap it
+ *  between blocks. Arrays of at least STREAM_TOKENS_MIN_INPUT tokens
+ *  are written with non-temporal stores. Layout flags are stored if
+ *  token_flags is not NULL.
+ */
+void lex_stream_init(LexStream *stream, char *input, long input_size, const LexOptions *options,
+                     const KeywordTable *keyword_table, TokenArray tokens);
+
+/**
+ * Lex another range of the input from a clean carry state, as if it was
+ *  a separate input. Tokens keep being appended to the same array.
+ *
+ * @param stream Stream to restart.
+ * @param start Offset of the range, a multiple of VECTOR_SIZE.
+ * @param end End of the range, followed by padding like for lex.
+ */
+void lex_stream_restart(LexStream *stream, long start, long end);
+
+/**
+ * Lex the next vector of a stream.
+ *
+ * @param stream Stream to advance.
+ * @return False if the stream had no input left.
+ */
+bool lex_stream_block(LexStream *stream);
+
+/**
+ * Finish a stream whose input is fully lexed: resolve keywords, filter
+ *  and intern identifiers.
+ *
+ * @param stream Lexed stream.
+ * @param options Lexer options given to lex_stream_init.
+ * @param keyword_table Keyword table of the dialect.
+ * @return Lexed tokens, without end-of-file token.
+ */
+TokenArray lex_stream_finish(LexStream *stream, const LexOptions *options, const KeywordTable *keyword_table);
+
+/**
+ * Resolve keywords and filter the tokens of the vector before the last
+ *  one. Like lex, keywords are only looked up once the vector after theirs
+ *  has rewritten its bytes. The tokens kept are moved before those of the
+ *  last vector.
+ *
+ * @param stream Stream whose last vector was just lexed.
+ * @param first Index of the first token of the vector before the last one.
+ * @param count Number of tokens of that vector, at most VECTOR_SIZE.
+ * @param keyword_table Keyword table of the dialect.
+ * @param filter Token types to keep, used if the stream post filters.
+ * @return Number of tokens kept.
+ */
+int finish_vector_tokens(LexStream *stream, int first, int count, const KeywordTable *keyword_table,
+                         const TokenFilter *filter);
+
+/**
+ * Lex several inputs with one keyword table. A convenience, not a faster
+ *  path: the inputs are lexed one after another, results are the same as
+ *  calling lex on each input.
+ *
+ * @param inputs Inputs padded like for lex.
+ * @param input_sizes Length of each input.
+ * @param count Number of inputs.
+ * @param options Lexer options.
+ * @param results Where the tokens of each input are stored.
+ */
+void lex_streams(char **inputs, const long *input_sizes, int count, const LexOptions *options, TokenArray *results);
+
+/**
+ * Called by lex_with_callback with the tokens of each vector.
+ *
+ * @param types Types of the tokens, keywords resolved.
+ * @param locs Locations of the tokens.
+ * @param count Number of tokens, at most VECTOR_SIZE.
+ * @param user User context.
+ */
+typedef void (*TokenCallback)(const TokenType *types, const uint32_t *locs, int count, void *user);
+
+/**
+ * Lex without building a token array. The tokens of each vector are
+ *  compacted into one small buffer. Once the next vector is lexed their
+ *  keywords are resolved and the filter applied, as lex does, then they
+ *  are passed to the callback while still in L1. Symbols are
+ *  not interned, brackets not matched, layout flags not stored and no
+ *  end-of-file token is passed.
+ *
+ * @param input Input padded like for lex, modified while lexing.
+ * @param input_size Length of input.
+ * @param options Lexer options.
+ * @param callback Called for each vector with at least one token.
+ * @param user User context passed to callback.
+ * @return True if the input has lexical errors.
+ */
+bool lex_with_callback(char *input, long input_size, const LexOptions *options, TokenCallback callback, void *user);
+
+/**
+ * Lexer pulled by its consumer one batch at a time. Holds no heap memory,
+ *  so it can be dropped at any point without lexing the rest.
+ */
+typedef struct LexIterator LexIterator;
+struct LexIterator {
+    LexStream stream;
+    LexOptions options;
+    KeywordTable keyword_table;
+    TokenType types[2 * VECTOR_SIZE] __attribute__((aligned(VECTOR_SIZE)));    // Tokens of the last two vectors
+    uint32_t locs[2 * VECTOR_SIZE] __attribute__((aligned(VECTOR_SIZE)));
+    int ready;                  // Tokens of the vector before the last one, keywords resolved
+    int pending;                // Of those, tokens already returned
+    bool done;                  // All input lexed
+    bool has_errors;            // Lexical errors, known once done
+};
+
+/**
+ * @param it Iterator to initialize.
+ * @param input Input padded like for lex, modified while lexing.
+ * @param input_size Length of input.
+ * @param options Lexer options, the filter must outlive the iterator.
+ *  Symbols are not interned, brackets not matched and layout flags not
+ *  stored.
+ */
+void lex_iterator_init(LexIterator *it, char *input, long input_size, const LexOptions *options);
+
+/**
+ * Lex until max tokens are returned or the next vector may not fit, so
+ *  lexing stops at a vector boundary. Keywords are resolved and the filter
+ *  applied, no end-of-file token is returned.
+ *
+ * @param it Lexer iterator.
+ * @param out_types Where the types of the tokens are stored.
+ * @param out_locs Where the locations of the tokens are stored.
+ * @param max Capacity of out_types and out_locs.
+ * @return Number of tokens stored, 0 once all input is lexed.
+ */
+int lex_next_batch(LexIterator *it, TokenType *out_types, uint32_t *out_locs, int max);
+
+/**
+ * Location of a file in a FilePack, and its tokens once lexed.
+ */
+typedef struct PackedFile PackedFile;
+struct PackedFile {
+    long offset;                // Start of the file in the arena, a multiple of VECTOR_SIZE
+    long size;                  // Length of the file
+    uint64_t first_token;       // Index of the first token of the file, set by lex_pack
+    uint64_t token_count;       // Tokens of the file, end-of-file token included
+    bool has_errors;            // Lexical errors may be present in this file
+    bool bracket_errors;        // Unmatched brackets, if matched
+};
+
+/**
+ * Small files read into one arena, each padded like read_file, so that
+ *  they are lexed in one pass without per-file allocations.
+ */
+typedef struct FilePack FilePack;
+struct FilePack {
+    char *arena;
+    long size;                  // Length of the arena, padding included
+    PackedFile *files;
+    int count;
+};
+
+/**
+ * Read files into one arena. Each file starts on a vector boundary.
+ *
+ * @param paths Paths of the files.
+ * @param count Number of files.
+ * @param policy Allocation policy of the arena, NULL for the default one.
+ * @param pack Where the pack is stored.
+ * @return False if a file could not be read.
+ */
+bool pack_files(char **paths, int count, const AllocPolicy *policy, FilePack *pack);
+
+void free_file_pack(FilePack *pack);
+
+/**
+ * Lex every file of a pack with one token array, one keyword table and
+ *  one keyword pass. The carry state is reset at the start of each file,
+ *  so the tokens of a file are the same as lex_file returns. The token
+ *  range of each file is stored in the pack, see packed_file_tokens.
+ *
+ * @param pack Files to lex, modified while lexing.
+ * @param options Lexer options, one dialect for all files.
+ * @return Tokens of all files, each followed by an end-of-file token.
+ *  Locations are relative to the start of their file.
+ */
+TokenArray lex_pack(FilePack *pack, const LexOptions *options);
+
+/**
+ * Tokens of one file of a lexed pack.
+ *
+ * @param pack Lexed pack.
+ * @param tokens Tokens returned by lex_pack.
+ * @param index Index of the file.
+ * @return View into tokens, not to be freed.
+ */
+TokenArray packed_file_tokens(const FilePack *pack, const TokenArray *tokens, int index);
 
 /**
  * Perform lexical analysis on the given file.
@@ -11,20 +316,172 @@
  * @param input A pointer to the FILE structure representing
  *  the input file.
  * @param input_size Length of input.
+ * @param options Lexer options.
  * @return A linked list of TokenNode structures.
  */
-TokenArray lex(char *input, long input_size);
+TokenArray lex(char *input, long input_size, const LexOptions *options);
+
+/**
+ * Lex one vector of input: raw strings (C++) and all sub lexers.
+ *
+ * @param input Input buffer.
+ * @param pos Offset of the current vector.
+ * @param input_size Length of input.
+ * @param current_vec A __m256i vector to tokenize.
+ * @param next_vec A __m256i vector to the next batch of characters.
+ * @param src_current_vec Unmodified copy of current_vec.
+ * @param src_next_vec Unmodified copy of next_vec.
+ * @param state Carry state between consecutive vectors.
+ * @return A __m256i holding token tags.
+ */
+__m256i lex_block(const char *input, const long pos, const long input_size, __m256i *current_vec, __m256i *next_vec,
+                  const __m256i src_current_vec, const __m256i src_next_vec, LexState *state);
+
+/**
+ * Tag filter applied before compaction. Keeps identifiers if any keyword
+ *  of the dialect is kept, since keywords are only known after lexing.
+ *
+ * @param filter Token types to emit.
+ * @param keyword_table Keyword table of the dialect.
+ * @param tag_filter Where the tag filter is stored.
+ * @return True if tokens must be filtered again after find_keywords.
+ */
+bool tag_filter_for(const TokenFilter *filter, const KeywordTable *keyword_table, TokenFilter *tag_filter);
+
+/**
+ * Test each tag against a 256-bit type bitmap with two nibble shuffles.
+ *
+ * @param tags A __m256i holding token tags.
+ * @param filter_lo Bytes 0-15 of the bitmap in both lanes.
+ * @param filter_hi Bytes 16-31 of the bitmap in both lanes.
+ * @return Byte mask of tags whose type is in the bitmap.
+ */
+__m256i filter_tag_mask(const __m256i tags, const __m256i filter_lo, const __m256i filter_hi);
+
+/**
+ * Match brackets of the same kind, ( ) [ ] and { }. The depth after each
+ *  token is a prefix sum over a vector of types, so a closer has the same
+ *  depth as its opener and is matched with the last opener of that depth.
+ *  A closer of another kind leaves both unmatched, closers without opener
+ *  do not change the depth of the brackets that follow.
+ *
+ * @param tok_array Lexed tokens. bracket_matches is filled, BRACKET_NONE
+ *  for unmatched brackets and other tokens, and bracket_errors is set if
+ *  any bracket is unmatched.
+ */
+void match_brackets(TokenArray *tok_array);
+
+/**
+ * Remove tokens whose type is not in the filter.
+ *
+ * @param tok_array Lexed tokens.
+ * @param filter Token types to keep.
+ */
+void filter_tokens(TokenArray *tok_array, const TokenFilter *filter);
+
+/**
+ * Count tokens per type without building a token array. Tags are counted
+ *  per vector and identifiers are resolved to keywords from the input, so
+ *  memory use does not depend on the input size. The input is not modified.
+ *
+ * @param input Input padded like for lex.
+ * @param input_size Length of input.
+ * @param options Lexer options (symbols and filter are ignored).
+ * @param stats Where the counts are stored.
+ */
+void lex_stats(const char *input, long input_size, const LexOptions *options, TokenStats *stats);
+
+/**
+ * Write the input back without comments. Runs of white space and comments
+ *  become one space, or one newline if they hold a newline. Uses the
+ *  comment, literal and splice regions of each vector and compacts it with
+ *  mm256_pext. The input is not modified.
+ *
+ * @param input Input padded like for lex.
+ * @param input_size Length of input.
+ * @param options Lexer options (symbols and filter are ignored).
+ * @param keep_lines Keep every newline and line splice so that line
+ *  numbers do not change.
+ * @param output Buffer of at least input_size + VECTOR_SIZE bytes.
+ * @return Length of the output.
+ */
+long minify_source(const char *input, long input_size, const LexOptions *options, bool keep_lines, char *output);
 
-uint8_t hash(uint64_t val);
+/**
+ * Lines of a source file by kind, as counted by cloc.
+ */
+typedef struct LineStats LineStats;
+struct LineStats {
+    uint64_t code;              // Lines with anything outside comments
+    uint64_t comment;           // Lines with comments and white space only
+    uint64_t blank;             // Lines with white space only, also inside comments
+};
+
+/**
+ * Classify each line of the input without building a token array. Per
+ *  vector, the bytes that are not white space and those outside comments
+ *  are carried up to the next newline with one addition each, which sets
+ *  the newline bit of every line holding such a byte. A last line without
+ *  newline is counted too. The input is not modified.
+ *
+ * @param input Input padded like for lex.
+ * @param input_size Length of input.
+ * @param options Lexer options (symbols and filter are ignored).
+ * @param stats Where the counts are stored.
+ */
+void count_lines(const char *input, long input_size, const LexOptions *options, LineStats *stats);
 
-void populate_keyword_lookup_table(short *lookup);
+/**
+ * Locate lexical errors. lex only ORs the error bits of each vector and
+ *  sets has_errors, this slow path lexes the unmodified input again and
+ *  reports each error with its offset.
+ *
+ * @param input Input padded like for lex, not modified by lex.
+ * @param input_size Length of input.
+ * @param options Lexer options (symbols and filter are ignored).
+ * @param errors Where errors are stored, in input order except for
+ *  unterminated literals and comments found at the end of input.
+ * @param max_errors Capacity of errors.
+ * @return Number of errors found, may be more than max_errors.
+ */
+int find_lex_errors(const char *input, long input_size, const LexOptions *options, LexError *errors, int max_errors);
+
+const char *lex_error_message(LexErrorKind kind);
+
+uint32_t hash(uint64_t val, uint32_t multiplier);
+
+/**
+ * Build the keyword table of a dialect.
+ *
+ * @param table Table to fill.
+ * @param dialect C or C++.
+ */
+void populate_keyword_lookup_table(KeywordTable *table, LexDialect dialect);
 
 __m256i vectorized_classification_one_byte(__m256i input);
 
-void find_keywords(TokenArray *tok_array, short *lookup);
+/**
+ * Keyword type of an identifier, or TOK_IDENT. Reads 16 bytes and does not
+ *  depend on the identifier being NUL terminated.
+ *
+ * @param table Keyword table of the dialect.
+ * @param str Start of the identifier.
+ * @return Token type.
+ */
+TokenType keyword_type(const KeywordTable *table, const char *str);
 
 /**
- * Parallel Bits Extract (PEXT) on 256 bit vectors.
+ * Replace identifier tokens that spell a keyword by the keyword type.
+ *  Does not depend on tokens being NUL terminated.
+ *
+ * @param tok_array Lexed tokens.
+ * @param table Keyword table of the dialect.
+ */
+void find_keywords(TokenArray *tok_array, const KeywordTable *table);
+
+/**
+ * Parallel Bits Extract (PEXT) on 256 bit vectors, through the variant
+ *  bound by tune_kernels.
  *
  * @param vector A __m256i vector from which it extracts.
  * @param mask A __m256i mask for each bit to extract.
@@ -58,28 +515,91 @@ void replace_token_body(__m256i *vector);
 
 bool is_empty(__m256i vector);
 
-__m256i run_sublexers(__m256i *current_vec, __m256i *next_vec, const __m256i src_current_vec, char last_char, bool *ch_continue, bool *
-                      escaped_continue, bool *str_continue, bool *ln_comm_continue, bool *block_comm_continue);
+/**
+ * Run all sub lexers on a vector of input.
+ *
+ * @param current_vec A __m256i vector to tokenize.
+ * @param next_vec A __m256i vector to the next batch of characters.
+ * @param src_current_vec Unmodified copy of current_vec.
+ * @param state Carry state between consecutive vectors.
+ * @return A __m256i holding token tags.
+ */
+__m256i run_sublexers(__m256i *current_vec, __m256i *next_vec, const __m256i src_current_vec, LexState *state);
+
+/**
+ * Dialect of a source file from its extension (.cc, .cpp, .cxx, .hh,
+ *  .hpp and .hxx are C++).
+ *
+ * @param file_path Path of the file.
+ * @return C or C++.
+ */
+LexDialect dialect_from_path(const char *file_path);
+
+TokenArray lex_file(char *file_path, char **file_content, const LexOptions *options);
 
-TokenArray lex_file(char *file_path, char **file_content);
+/**
+ * Locate the lexical errors of a file, read again, and print them at
+ *  their line and column.
+ *
+ * @param file_path Path of the file.
+ * @param options Lexer options.
+ */
+void print_lex_errors(const char *file_path, const LexOptions *options);
+
+/**
+ * Lex a file already read into a padded buffer, as lex_file does: errors
+ *  are printed and an end-of-file token is appended.
+ *
+ * @param file_path Path of the file, read again to locate errors.
+ * @param file_content Content padded like read_file, modified by lexing.
+ * @param file_size Length of the file.
+ * @param options Lexer options.
+ * @return Lexed tokens.
+ */
+TokenArray lex_file_content(const char *file_path, char *file_content, long file_size, const LexOptions *options);
 
 __m256i mm256_cmpistrm_any(__m128i match, __m256i vector);
 
+/**
+ * Byte mask of the bytes of vector inside any of the ranges, through the
+ *  variant bound by tune_kernels.
+ *
+ * @param ranges Pairs of inclusive bounds, lower bound first.
+ * @param vector A __m256i vector to test.
+ * @param num_ranges Number of bounds in ranges, twice the number of ranges.
+ * @return Byte mask of the bytes in a range.
+ */
 __m256i mm256_cmpistrm_range(__m128i ranges, __m256i vector, int num_ranges);
 
-__m256i numeric_periods_mask(__m256i current_vec, __m256i next_vec, char last_char);
+/**
+ * Find the bytes of the current vector that belong to pp-numbers
+ *  (digits, periods, identifier characters, exponent signs after
+ *  e/E/p/P and C23 digit separators).
+ *
+ * @param current_vec A __m256i vector to tokenize.
+ * @param next_vec A __m256i vector to the next batch of characters.
+ * @param last_char Last character of the previous vector.
+ * @param splice_joined Bit mask of line splices inside tokens.
+ * @param splice_join_pos Bit mask of bytes right after those splices.
+ * @param num_continue Whether a number continues from / into the
+ *  neighbouring vector. Updated for the next vector.
+ * @param exp_continue Whether the previous vector ended with the
+ *  exponent letter of a number. Updated for the next vector.
+ * @return Bit mask of the numeric region.
+ */
+uint32_t numeric_region_mask(const __m256i current_vec, const __m256i next_vec, const char last_char,
+                             const uint32_t splice_joined, const uint32_t splice_join_pos, bool *num_continue,
+                             bool *exp_continue);
 
 /**
  * Lexes single byte punctuators and overlays their ASCII code to a
  *  given vector of tags, marking start of tokens.
  *
  * @param current_vec A __m256i vector to tokenize.
- * @param next_vec
  * @param tags A __m256i holding token tags.
- * @param last_char
- * @return
+ * @param num_region Bit mask of bytes inside numeric constants.
  */
-void one_byte_punct_sub_lex(__m256i *current_vec, __m256i next_vec, __m256i *tags, char last_char);
+void one_byte_punct_sub_lex(__m256i *current_vec, __m256i *tags, const uint32_t num_region);
 
 /**
  * Shift current vector by one to the left, adding the first element
@@ -120,6 +640,17 @@ __m256i get_mask(const uint32_t mask);
  */
 void remove_prefix_64(__m256i *vector, uint64_t prefix);
 
+/**
+ * Compare a vector against bytes[from..to) and store the bit masks.
+ *
+ * @param masks Output masks, indexed like bytes.
+ * @param vector A __m256i vector to compare.
+ * @param bytes Bytes to search for.
+ * @param from First index of bytes.
+ * @param to End index of bytes.
+ */
+void byte_masks(uint32_t *masks, const __m256i vector, const char *bytes, const int from, const int to);
+
 /**
  * Lexes two byte punctuators and overlays special code to a
  *  given vector of tags, marking start of tokens.
@@ -127,9 +658,11 @@ void remove_prefix_64(__m256i *vector, uint64_t prefix);
  * @param current_vec A __m256i vector to tokenize.
  * @param next_vec A __m256i vector to the next batch of characters.
  * @param tags A __m256i holding token tags.
- * @return
+ * @param num_region Bit mask of bytes inside numeric constants.
+ * @param dialect Adds :: and .* for C++.
  */
-void two_byte_punct_sub_lex(__m256i *current_vec, __m256i *next_vec, __m256i *tags);
+void two_byte_punct_sub_lex(__m256i *current_vec, __m256i *next_vec, __m256i *tags, const uint32_t num_region,
+                            const LexDialect dialect);
 
 /**
  * Lexes three byte punctuators and overlays special code to a
@@ -138,10 +671,11 @@ void two_byte_punct_sub_lex(__m256i *current_vec, __m256i *next_vec, __m256i *ta
  * @param current_vec A __m256i vector to tokenize.
  * @param next_vec A __m256i vector to the next batch of characters.
  * @param tags A __m256i holding token tags.
- * @param
- * @return
+ * @param num_region Bit mask of bytes inside numeric constants.
+ * @param dialect Adds ->* and <=> for C++.
  */
-void three_byte_punct_sub_lex(__m256i *current_vec, __m256i *next_vec, __m256i *tags);
+void three_byte_punct_sub_lex(__m256i *current_vec, __m256i *next_vec, __m256i *tags, const uint32_t num_region,
+                              const LexDialect dialect);
 
 __m256i alpha_mask(__m256i vector);
 
@@ -149,17 +683,149 @@ void identifiers_sub_lex(__m256i current_vec, __m256i *tags, bool last_empty);
 
 __m256i num_mask(__m256i vector);
 
-void numeric_const_sub_lex(const __m256i current_vec, __m256i *tags, const bool last_empty);
+/**
+ * Check non-ASCII code points against XID_Start / XID_Continue and
+ *  remove the ones that cannot be part of an identifier. Skipped when
+ *  the vector is all ASCII.
+ *
+ * @param current_vec A __m256i vector to tokenize.
+ * @param next_vec A __m256i vector to the next batch of characters.
+ * @param last_char Last character of the previous vector.
+ * @param cp_carry Bit mask of bytes in the next vector that belong to
+ *  a code point of this one. Updated for the next vector.
+ * @param cp_carry_invalid Whether that code point was removed.
+ * @return Bit mask of the removed bytes.
+ */
+uint32_t unicode_sub_lex(__m256i *current_vec, const __m256i next_vec, const char last_char, uint8_t *cp_carry,
+                         bool *cp_carry_invalid);
+
+/**
+ * Find the mask of identifier characters [0-9A-Za-z_] and non-ASCII
+ *  bytes.
+ *
+ * @param vector A __m256i input vector.
+ * @return Mask of identifier characters of input vector.
+ */
+__m256i ident_char_mask(__m256i vector);
+
+bool is_ident_char(const char c);
+
+void numeric_const_sub_lex(const uint32_t num_region, const bool num_continued, __m256i *tags);
+
+uint32_t text_lit_sub_lex(__m256i *current_vec, __m256i *tags, const char delim, bool *does_continue, const TokenType type, const
+                      __m256i src_current_vec, const uint32_t hidden, bool *escaped_continue);
+
+/**
+ * Fuse encoding prefixes (L, u, U, u8) with the char or string
+ *  literal that follows them.
+ *
+ * @param current_vec A __m256i vector to tokenize.
+ * @param next_vec A __m256i vector to the next batch of characters.
+ * @param tags A __m256i holding token tags.
+ * @param ident_starts Bit mask of identifier tags before literals
+ *  were lexed.
+ * @param prefix_carry Bit mask of delimiters in the next vector that
+ *  belong to a prefix of this one. Updated for the next vector.
+ */
+void encoding_prefix_sub_lex(const __m256i current_vec, const __m256i next_vec, __m256i *tags, const uint32_t ident_starts,
+                             uint8_t *prefix_carry);
+
+/**
+ * End offset of a raw string literal.
+ *
+ * @param input Input buffer.
+ * @param start Offset of the literal, encoding prefix included.
+ * @param input_size Length of input.
+ * @return Offset after the closing quote, 0 if no raw string starts
+ *  there, input_size + 1 if it is not terminated.
+ */
+long raw_string_end(const char *input, long start, long input_size);
+
+/**
+ * Find C++ raw string literals (R"delim(...)delim" with optional
+ *  encoding prefix) in the current vector. Candidates are found with
+ *  vector compares, the delimiter is matched with a scalar search.
+ *  Candidates inside comments and other literals are dropped: if any,
+ *  the other sub lexers run on a copy of the state to find them.
+ *
+ * @param input Input buffer.
+ * @param pos Offset of the current vector.
+ * @param input_size Length of input.
+ * @param current_vec A __m256i vector to tokenize.
+ * @param next_vec A __m256i vector to the next batch of characters.
+ * @param src_current_vec Unmodified copy of current_vec.
+ * @param state Carry state between consecutive vectors. raw_end is
+ *  updated for raw strings starting in this vector.
+ * @param raw_starts Bit mask where raw strings start.
+ * @return Bit mask of bytes inside raw strings.
+ */
+uint32_t raw_string_sub_lex(const char *input, const long pos, const long input_size, const __m256i current_vec,
+                            const __m256i next_vec, const __m256i src_current_vec, LexState *state,
+                            uint32_t *raw_starts);
+
+/**
+ * Overlay raw string tokens on the tags of the other sub lexers and
+ *  restore their bytes.
+ *
+ * @param current_vec A __m256i vector to tokenize.
+ * @param tags A __m256i holding token tags.
+ * @param src_current_vec Unmodified copy of current_vec.
+ * @param src_next_vec Unmodified copy of the next vector.
+ * @param raw_region Bit mask of bytes inside raw strings.
+ * @param raw_starts Bit mask where raw strings start.
+ */
+void raw_string_tags(__m256i *current_vec, __m256i *tags, const __m256i src_current_vec, const __m256i src_next_vec,
+                     const uint32_t raw_region, const uint32_t raw_starts);
+
+/**
+ * Find line splices (backslash followed by a newline).
+ *
+ * @param current_vec A __m256i vector to tokenize.
+ * @param next_vec A __m256i vector to the next batch of characters.
+ * @param last_char Last character of the previous vector.
+ * @param splice_continue Whether a splice continues into the next
+ *  vector. Updated for the next vector.
+ * @param join_continue Whether a token continues after a splice
+ *  into the next vector. Updated for the next vector.
+ * @param joined Bit mask of splices inside a token.
+ * @param join_pos Bit mask of bytes right after those splices.
+ * @return Bit mask of all line splices.
+ */
+uint32_t line_splices_sub_lex(const __m256i current_vec, const __m256i next_vec, const char last_char, bool *splice_continue,
+                              bool *join_continue, uint32_t *joined, uint32_t *join_pos);
 
-void text_lit_sub_lex(__m256i *current_vec, __m256i *tags, const char delim, bool *does_continue, const TokenType type, const
-                      __m256i src_current_vec, bool *escaped_continue);
+/**
+ * Find the comment openers and quotes that open nothing because they
+ *  are inside a comment or a literal of another kind, as in "//" or
+ *  // don't. Vectors with at most one kind of comment or literal are
+ *  left to the sub lexers, the others are walked from opener to closer.
+ *
+ * @param current_vec A __m256i vector to tokenize.
+ * @param next_vec A __m256i vector to the next batch of characters.
+ * @param splices Bit mask of line splices.
+ * @param state Comments and literals continued from the previous vector.
+ * @return Bit mask of the hidden openers and quotes.
+ */
+uint32_t hidden_delimiters(const __m256i current_vec, const __m256i next_vec, const uint32_t splices,
+                           const LexState *state);
 
-void line_comments_sub_lex(__m256i *current_vec, __m256i next_vec, bool *ln_comm_continue);
+void line_comments_sub_lex(__m256i *current_vec, __m256i next_vec, const uint32_t splices, const uint32_t hidden,
+                           bool *ln_comm_continue);
 
-void block_comments_sub_lex(__m256i *current_vec, __m256i *next_vec, bool *block_comm_continue);
+void block_comments_sub_lex(__m256i *current_vec, __m256i *next_vec, const uint32_t hidden, bool *block_comm_continue);
 
 __m256i load_vector(const char* pos);
 
-char* read_file(const char *filename, long *file_size, long pad_multiple);
+/**
+ * Read a file into a zero padded buffer.
+ *
+ * @param filename Path of the file.
+ * @param file_size Where the length of the file is stored.
+ * @param pad_multiple Alignment of the buffer, its size is rounded up to
+ *  a multiple of it plus VECTOR_SIZE bytes.
+ * @param policy Allocation policy, NULL for the default one.
+ * @return The buffer, NULL on errors.
+ */
+char* read_file(const char *filename, long *file_size, long pad_multiple, const AllocPolicy *policy);
 
 #endif //LEXER_H
@@ -1,43 +1,423 @@
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <time.h>
 
 #include "lexer.h"
+#include "parallel.h"
+#include "reader.h"
+#include "search.h"
+#include "tune.h"
 
-bool parse_flags(int argc, char **argv, bool *time_flag) {
-    if (argc < 2 || argc > 3) {
-        fprintf(stderr, "Usage: simd-lexer <file path> [-t/--time].\n");
+typedef struct Flags Flags;
+struct Flags {
+    char *file_path;
+    char **file_paths;          // All files given, lexed as they are read if more than one
+    int file_count;
+    bool dialect_set;           // Dialect given with --c or --cpp
+    bool time;                  // Print average time instead of tokens
+    bool intern;                // Intern identifiers
+    bool stats;                 // Print token counts only
+    bool minify;                // Print the source without comments
+    bool keep_lines;            // Keep newlines when minifying
+    bool pack;                  // Lex all files in one pass over a shared arena
+    bool sloc;                  // Print code, comment and blank line counts
+    const char *tune_cache;     // Kernel choice cached by tune_kernels, NULL to calibrate on every run
+    TokenFilter filter;         // Token types passed with --only
+};
+
+bool parse_filter(char *names, TokenFilter *filter) {
+    token_filter_clear(filter);
+
+    for (char *name = strtok(names, ","); name != NULL; name = strtok(NULL, ",")) {
+        if (!token_filter_add_name(filter, name)) {
+            fprintf(stderr, "Unknown token type: %s.\n", name);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool parse_flags(int argc, char **argv, Flags *flags, LexOptions *options) {
+    *flags = (Flags) {0};
+    flags->file_paths = malloc(argc * sizeof(char *));
+
+    if (flags->file_paths == NULL) {
+        fprintf(stderr, "Memory allocation failure.\n");
         return false;
     }
 
-    *time_flag = false;
-    if (argc == 3 && (strcmp(argv[2], "-t") == 0 || strcmp(argv[2], "--time") == 0)) {
-        *time_flag = true;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-t") == 0 || strcmp(argv[i], "--time") == 0) {
+            flags->time = true;
+        } else if (strcmp(argv[i], "--cpp") == 0) {
+            options->dialect = LEX_DIALECT_CPP;
+            flags->dialect_set = true;
+        } else if (strcmp(argv[i], "--c") == 0) {
+            options->dialect = LEX_DIALECT_C;
+            flags->dialect_set = true;
+        } else if (strcmp(argv[i], "--intern") == 0) {
+            flags->intern = true;
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            flags->stats = true;
+        } else if (strcmp(argv[i], "--minify") == 0) {
+            flags->minify = true;
+        } else if (strcmp(argv[i], "--keep-lines") == 0) {
+            flags->minify = true;
+            flags->keep_lines = true;
+        } else if (strcmp(argv[i], "--brackets") == 0) {
+            options->match_brackets = true;
+        } else if (strcmp(argv[i], "--flags") == 0) {
+            options->token_flags = true;
+        } else if (strcmp(argv[i], "--sloc") == 0) {
+            flags->sloc = true;
+        } else if (strcmp(argv[i], "--pack") == 0) {
+            flags->pack = true;
+        } else if (strcmp(argv[i], "--huge-pages") == 0) {
+            options->alloc.huge_pages = true;
+        } else if (strcmp(argv[i], "--prefault") == 0) {
+            options->alloc.prefault = true;
+        } else if (strcmp(argv[i], "--tune-cache") == 0 && i + 1 < argc) {
+            flags->tune_cache = argv[++i];
+        } else if (strcmp(argv[i], "--only") == 0 && i + 1 < argc) {
+            if (!parse_filter(argv[++i], &flags->filter))
+                return false;
+
+            options->filter = &flags->filter;
+        } else if (argv[i][0] != '-') {
+            flags->file_paths[flags->file_count++] = argv[i];
+            flags->file_path = flags->file_paths[0];
+        } else {
+            flags->file_path = NULL;
+            break;
+        }
+    }
+
+    if (flags->file_path == NULL) {
+        fprintf(stderr, "Usage: simd-lexer <file path>... [-t/--time] [--c/--cpp] [--intern] [--brackets] [--flags] [--stats] [--sloc] [--only <type,...>] [--minify] [--keep-lines] [--pack] [--huge-pages] [--prefault] [--tune-cache <file>].\n");
+        return false;
+    }
+
+    // Pick the dialect from the file extension unless given
+    if (!flags->dialect_set) {
+        options->dialect = dialect_from_path(flags->file_path);
     }
 
     return true;
 }
 
-void print_results(TokenArray tokens, bool time_flag, double avg_time) {
-    if (time_flag) {
+void print_results(TokenArray tokens, const TokenStats *stats, const char *minified, long minified_size,
+                   const Flags *flags, double avg_time) {
+    if (flags->time) {
         printf("Avg. time: %f ms\n", avg_time);
+    } else if (flags->minify) {
+        fwrite(minified, 1, minified_size, stdout);
+    } else if (flags->stats) {
+        print_token_stats(stats);
     } else {
         print_tokens(tokens);
     };
 }
 
+// Lex each file as soon as it is read, results are printed under the file path in completion order
+int lex_files(const Flags *flags, const LexOptions *options) {
+    BatchReader *reader = batch_reader_create(flags->file_paths, flags->file_count, READER_DEPTH, &options->alloc);
+
+    if (reader == NULL) {
+        return -1;
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    int status = 0;
+    FileBuffer file;
+
+    while (batch_reader_next(reader, &file)) {
+        const char *path = flags->file_paths[file.index];
+
+        if (file.data == NULL) {
+            status = -1;
+            batch_reader_release(reader, &file);
+            continue;
+        }
+
+        LexOptions file_options = *options;
+        if (!flags->dialect_set) {
+            file_options.dialect = dialect_from_path(path);
+        }
+
+        TokenArray tokens = {0};
+        TokenStats stats;
+        char *minified = NULL;
+        long minified_size = 0;
+
+        if (flags->minify) {
+            minified = malloc(file.size + VECTOR_SIZE);
+
+            if (minified == NULL) {
+                fprintf(stderr, "Memory allocation failure.\n");
+                status = -1;
+                batch_reader_release(reader, &file);
+                continue;
+            }
+
+            minified_size = minify_source(file.data, file.size, &file_options, flags->keep_lines, minified);
+        } else if (flags->stats) {
+            lex_stats(file.data, file.size, &file_options, &stats);
+        } else {
+            tokens = lex_file_content(path, file.data, file.size, &file_options);
+        }
+
+        if (!flags->time) {
+            printf("%s:\n", path);
+            print_results(tokens, &stats, minified, minified_size, flags, 0);
+        }
+
+        free(minified);
+        free_token_array(tokens);
+        batch_reader_release(reader, &file);
+    }
+
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    batch_reader_free(reader);
+
+    if (flags->time) {
+        const double elapsed = (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6;
+        printf("Time: %f ms for %d files\n", elapsed, flags->file_count);
+    }
+
+    return status;
+}
+
+typedef struct SlocContext SlocContext;
+struct SlocContext {
+    const Flags *flags;
+    const LexOptions *options;
+    LineStats *stats;           // Counts of each file
+    bool *failed;               // Files that could not be read
+};
+
+static void count_file_lines(int index, int worker, void *ctx) {
+    (void) worker;
+    SlocContext *sloc = ctx;
+    const char *path = sloc->flags->file_paths[index];
+
+    LexOptions options = *sloc->options;
+    if (!sloc->flags->dialect_set) {
+        options.dialect = dialect_from_path(path);
+    }
+
+    long file_size;
+    char *file_content = read_file(path, &file_size, VECTOR_SIZE, &options.alloc);
+
+    if (file_content == NULL) {
+        sloc->failed[index] = true;
+        return;
+    }
+
+    count_lines(file_content, file_size, &options, &sloc->stats[index]);
+    free(file_content);
+}
+
+// Count lines of all files on a pool of threads, then print them in argument order with the total
+int count_files_lines(const Flags *flags, const LexOptions *options) {
+    SlocContext sloc = { flags, options };
+    sloc.stats = calloc(flags->file_count, sizeof(LineStats));
+    sloc.failed = calloc(flags->file_count, sizeof(bool));
+
+    if (sloc.stats == NULL || sloc.failed == NULL) {
+        fprintf(stderr, "Memory allocation failure.\n");
+        free(sloc.stats);
+        free(sloc.failed);
+        return -1;
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    parallel_for(flags->file_count, default_thread_count(), count_file_lines, &sloc);
+
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    int status = 0;
+    LineStats total = {0};
+
+    if (!flags->time) {
+        printf("%10s %10s %10s  %s\n", "code", "comment", "blank", "file");
+    }
+
+    for (int f = 0; f < flags->file_count; ++f) {
+        if (sloc.failed[f]) {
+            status = -1;
+            continue;
+        }
+
+        const LineStats *stats = &sloc.stats[f];
+        total.code += stats->code;
+        total.comment += stats->comment;
+        total.blank += stats->blank;
+
+        if (!flags->time) {
+            printf("%10lu %10lu %10lu  %s\n", stats->code, stats->comment, stats->blank, flags->file_paths[f]);
+        }
+    }
+
+    if (flags->time) {
+        const double elapsed = (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6;
+        printf("Time: %f ms for %d files\n", elapsed, flags->file_count);
+    } else {
+        printf("%10lu %10lu %10lu  total\n", total.code, total.comment, total.blank);
+    }
+
+    free(sloc.stats);
+    free(sloc.failed);
+
+    return status;
+}
+
+#define DIALECT_COUNT (LEX_DIALECT_CPP + 1)
+
+static LexDialect file_dialect(const Flags *flags, const LexOptions *options, int index) {
+    return flags->dialect_set ? options->dialect : dialect_from_path(flags->file_paths[index]);
+}
+
+// Lex all files in one pass per dialect, results are printed under the file path in argument order
+int lex_packed_files(const Flags *flags, const LexOptions *options) {
+    char **paths = malloc(flags->file_count * sizeof(char *));
+    int *pack_index = malloc(flags->file_count * sizeof(int));     // Index of each file in its pack
+
+    if (paths == NULL || pack_index == NULL) {
+        fprintf(stderr, "Memory allocation failure.\n");
+        free(paths);
+        free(pack_index);
+        return -1;
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    // A pack shares one keyword table, so files of each dialect get their own pack
+    FilePack packs[DIALECT_COUNT] = {0};
+    TokenArray tokens[DIALECT_COUNT] = {0};
+    LexOptions pack_options[DIALECT_COUNT];
+    int status = 0;
+
+    for (int d = 0; d < DIALECT_COUNT && status == 0; ++d) {
+        pack_options[d] = *options;
+        pack_options[d].dialect = d;
+
+        int count = 0;
+        for (int f = 0; f < flags->file_count; ++f) {
+            if (file_dialect(flags, options, f) == d) {
+                pack_index[f] = count;
+                paths[count++] = flags->file_paths[f];
+            }
+        }
+
+        if (count == 0)
+            continue;
+
+        if (!pack_files(paths, count, &options->alloc, &packs[d])) {
+            status = -1;
+            break;
+        }
+
+        tokens[d] = lex_pack(&packs[d], &pack_options[d]);
+    }
+
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    for (int f = 0; f < flags->file_count && status == 0; ++f) {
+        const LexDialect dialect = file_dialect(flags, options, f);
+
+        if (packs[dialect].files[pack_index[f]].has_errors) {
+            print_lex_errors(flags->file_paths[f], &pack_options[dialect]);
+        }
+
+        if (!flags->time) {
+            printf("%s:\n", flags->file_paths[f]);
+            print_tokens(packed_file_tokens(&packs[dialect], &tokens[dialect], pack_index[f]));
+        }
+    }
+
+    if (flags->time && status == 0) {
+        const double elapsed = (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6;
+        printf("Time: %f ms for %d files\n", elapsed, flags->file_count);
+    }
+
+    for (int d = 0; d < DIALECT_COUNT; ++d) {
+        free_token_array(tokens[d]);
+        free_file_pack(&packs[d]);
+    }
+
+    free(paths);
+    free(pack_index);
+
+    return status;
+}
+
 int main(int argc, char **argv) {
     const int repeat_bench = 10;
     double avg_time = 0;
-    bool time_flag;
+    Flags flags;
+    LexOptions options = {0};
 
-    if (!parse_flags(argc, argv, &time_flag)) {
+    if (argc >= 2 && strcmp(argv[1], "search") == 0) {
+        tune_kernels(NULL);
+        return search_main(argc - 2, argv + 2);
+    }
+
+    if (!parse_flags(argc, argv, &flags, &options)) {
+        free(flags.file_paths);
         return -1;
     }
 
-    char *file_content;
-    TokenArray tokens;
+    // Bind the fastest kernels before any timing
+    tune_kernels(flags.tune_cache);
+
+    SymbolTable symbols;
+    if (flags.intern) {
+        symbol_table_init(&symbols, 1024);
+        options.symbols = &symbols;
+    }
+
+    if (flags.sloc) {
+        const int status = count_files_lines(&flags, &options);
+
+        if (flags.intern) {
+            symbol_table_free(&symbols);
+        }
+
+        free(flags.file_paths);
+        return status;
+    }
+
+    if (flags.file_count > 1) {
+        // Packs hold tokens only, minified sources and stats are produced file by file
+        const bool pack = flags.pack && !flags.minify && !flags.stats;
+        const int status = pack ? lex_packed_files(&flags, &options) : lex_files(&flags, &options);
+
+        if (flags.intern) {
+            symbol_table_free(&symbols);
+        }
+
+        free(flags.file_paths);
+        return status;
+    }
+
+    char *file_content = NULL;
+    TokenArray tokens = {0};
+    TokenStats stats;
+    char *minified = NULL;
+    long minified_size = 0;
+    int status = 0;
 
     int cnt = repeat_bench;
     do {
@@ -45,7 +425,46 @@ int main(int argc, char **argv) {
         clock_t start = clock();
 
         // Run lexer
-        tokens = lex_file(argv[1], &file_content);
+        if (flags.minify) {
+            long file_size;
+            file_content = read_file(flags.file_path, &file_size, VECTOR_SIZE, &options.alloc);
+
+            if (file_content == NULL) {
+                status = -1;
+                break;
+            }
+
+            free(minified);
+            minified = malloc(file_size + VECTOR_SIZE);
+
+            if (minified == NULL) {
+                fprintf(stderr, "Memory allocation failure.\n");
+                status = -1;
+                break;
+            }
+
+            minified_size = minify_source(file_content, file_size, &options, flags.keep_lines, minified);
+        } else if (flags.stats) {
+            long file_size;
+            file_content = read_file(flags.file_path, &file_size, VECTOR_SIZE, &options.alloc);
+
+            if (file_content == NULL) {
+                status = -1;
+                break;
+            }
+
+            lex_stats(file_content, file_size, &options, &stats);
+        } else {
+            long file_size;
+            file_content = read_file(flags.file_path, &file_size, VECTOR_SIZE, &options.alloc);
+
+            if (file_content == NULL) {
+                status = -1;
+                break;
+            }
+
+            tokens = lex_file_content(flags.file_path, file_content, file_size, &options);
+        }
 
         // Stop timer
         clock_t end = clock();
@@ -53,13 +472,23 @@ int main(int argc, char **argv) {
         avg_time += cpu_time_used;
 
         --cnt;
-    } while (time_flag && cnt);
+    } while (flags.time && cnt);
 
     // Results
-    print_results(tokens, time_flag, avg_time / repeat_bench);
+    if (status == 0) {
+        print_results(tokens, &stats, minified, minified_size, &flags, avg_time / repeat_bench);
+    }
 
     // Clean up
     free(file_content);
+    free(minified);
+    free_token_array(tokens);
+
+    if (flags.intern) {
+        symbol_table_free(&symbols);
+    }
+
+    free(flags.file_paths);
 
-    return 0;
+    return status;
 }
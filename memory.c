@@ -0,0 +1,40 @@
+#define _GNU_SOURCE
+
+#include "memory.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+
+static void prefault(char *buffer, size_t size) {
+    // One write per page is enough to map it
+    for (size_t i = 0; i < size; i += PAGE_SIZE_4K) {
+        ((volatile char *) buffer)[i] = 0;
+    }
+}
+
+void *policy_alloc(size_t size, size_t alignment, const AllocPolicy *policy) {
+    const bool huge = policy != NULL && policy->huge_pages && size >= HUGE_PAGE_SIZE;
+
+    // Whole huge pages, so that no part of the buffer shares a page with other data
+    if (huge) {
+        alignment = HUGE_PAGE_SIZE;
+        size = (size + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+    }
+
+    void *buffer;
+    if (posix_memalign(&buffer, alignment, size))
+        return NULL;
+
+#ifdef MADV_HUGEPAGE
+    if (huge) {
+        madvise(buffer, size, MADV_HUGEPAGE);   // Only a hint, ignored without THP support
+    }
+#endif
+
+    if (policy != NULL && policy->prefault) {
+        prefault(buffer, size);
+    }
+
+    return buffer;
+}
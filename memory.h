@@ -0,0 +1,31 @@
+#ifndef MEMORY_H
+#define MEMORY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define HUGE_PAGE_SIZE (2UL << 20)
+#define PAGE_SIZE_4K 4096UL
+
+/**
+ * How large input and token buffers are allocated.
+ */
+typedef struct AllocPolicy AllocPolicy;
+struct AllocPolicy {
+    bool huge_pages;            // Back buffers of at least 2 MiB with transparent huge pages
+    bool prefault;              // Touch every page right after allocation
+};
+
+/**
+ * Allocate an aligned buffer that can be released with free. With huge
+ *  pages the buffer is 2 MiB aligned and advised with MADV_HUGEPAGE, so
+ *  it falls back to regular pages if the kernel does not provide them.
+ *
+ * @param size Size in bytes.
+ * @param alignment Alignment, a power of two.
+ * @param policy Allocation policy, NULL for the default one.
+ * @return The buffer, NULL if out of memory.
+ */
+void *policy_alloc(size_t size, size_t alignment, const AllocPolicy *policy);
+
+#endif //MEMORY_H
@@ -0,0 +1,68 @@
+#include "parallel.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+typedef struct ParallelWorker ParallelWorker;
+struct ParallelWorker {
+    pthread_t thread;
+    int index;
+    int count;
+    atomic_int *next;
+    ParallelTask task;
+    void *ctx;
+};
+
+static void *parallel_worker(void *arg) {
+    ParallelWorker *worker = arg;
+
+    for (int i = atomic_fetch_add(worker->next, 1); i < worker->count; i = atomic_fetch_add(worker->next, 1)) {
+        worker->task(i, worker->index, worker->ctx);
+    }
+
+    return NULL;
+}
+
+void parallel_for(int count, int threads, ParallelTask task, void *ctx) {
+    if (threads > count)
+        threads = count;
+
+    if (threads < 1)
+        threads = 1;
+
+    atomic_int next = 0;
+    ParallelWorker *workers = malloc(threads * sizeof(ParallelWorker));
+
+    if (workers == NULL) {
+        fprintf(stderr, "Memory allocation failure.\n");
+        return;
+    }
+
+    for (int i = 0; i < threads; ++i) {
+        workers[i] = (ParallelWorker) { .index = i, .count = count, .next = &next, .task = task, .ctx = ctx };
+    }
+
+    // The calling thread is worker 0
+    int started = 1;
+    for (; started < threads; ++started) {
+        if (pthread_create(&workers[started].thread, NULL, parallel_worker, &workers[started]) != 0)
+            break;
+    }
+
+    parallel_worker(&workers[0]);
+
+    for (int i = 1; i < started; ++i) {
+        pthread_join(workers[i].thread, NULL);
+    }
+
+    free(workers);
+}
+
+int default_thread_count(void) {
+    const long count = sysconf(_SC_NPROCESSORS_ONLN);
+
+    return count > 0 ? (int) count : 1;
+}
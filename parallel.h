@@ -0,0 +1,29 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+/**
+ * Task run for each index of parallel_for.
+ *
+ * @param index Index of the work item.
+ * @param worker Index of the worker thread running it.
+ * @param ctx User context.
+ */
+typedef void (*ParallelTask)(int index, int worker, void *ctx);
+
+/**
+ * Run task for indices [0, count) on a pool of threads. Workers take the
+ *  next index from a shared atomic counter, so uneven items balance out.
+ *
+ * @param count Number of work items.
+ * @param threads Number of threads (at most count are started).
+ * @param task Function run for each item.
+ * @param ctx User context passed to task.
+ */
+void parallel_for(int count, int threads, ParallelTask task, void *ctx);
+
+/**
+ * @return Number of online processors.
+ */
+int default_thread_count(void);
+
+#endif //PARALLEL_H
@@ -0,0 +1,195 @@
+#include "pipeline.h"
+
+#include <immintrin.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SPIN_LIMIT 256          // Pauses before yielding the core while waiting on the other side
+
+typedef struct PipelineConsumer PipelineConsumer;
+struct PipelineConsumer {
+    TokenRing *ring;
+    const char *src;
+    TokenBatchConsumer consumer;
+    void *user;
+};
+
+static void wait_a_bit(int *spins) {
+    if (++*spins < SPIN_LIMIT) {
+        _mm_pause();
+    } else {
+        sched_yield();
+    }
+}
+
+bool token_ring_init(TokenRing *ring, uint32_t capacity) {
+    uint32_t size = 1;
+    while (size < capacity)
+        size <<= 1;
+
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    atomic_init(&ring->closed, false);
+    ring->cached_head = 0;
+    ring->cached_tail = 0;
+    ring->capacity = size;
+
+    if (posix_memalign((void **) &ring->batches, CACHE_LINE_SIZE, size * sizeof(TokenBatch))) {
+        fprintf(stderr, "Memory allocation failure.\n");
+        ring->batches = NULL;
+        return false;
+    }
+
+    return true;
+}
+
+void token_ring_free(TokenRing *ring) {
+    free(ring->batches);
+}
+
+TokenBatch *token_ring_reserve(TokenRing *ring) {
+    const uint64_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+
+    // Backpressure: wait for the consumer to release the oldest batch
+    for (int spins = 0; tail - ring->cached_head == ring->capacity; wait_a_bit(&spins)) {
+        ring->cached_head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    }
+
+    return &ring->batches[tail & (ring->capacity - 1)];
+}
+
+void token_ring_publish(TokenRing *ring) {
+    const uint64_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+}
+
+void token_ring_close(TokenRing *ring) {
+    atomic_store_explicit(&ring->closed, true, memory_order_release);
+}
+
+const TokenBatch *token_ring_peek(TokenRing *ring) {
+    const uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+
+    for (int spins = 0; head == ring->cached_tail; wait_a_bit(&spins)) {
+        // Read closed before tail, batches published before closing are still drained
+        const bool closed = atomic_load_explicit(&ring->closed, memory_order_acquire);
+        ring->cached_tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+
+        if (closed && head == ring->cached_tail)
+            return NULL;
+    }
+
+    return &ring->batches[head & (ring->capacity - 1)];
+}
+
+void token_ring_release(TokenRing *ring) {
+    const uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+static TokenArray batch_tokens(TokenBatch *batch) {
+    TokenArray tokens = {0};
+    tokens.token_types = batch->types;
+    tokens.token_locs = batch->locs;
+    tokens.capacity = TOKEN_BATCH_SIZE;
+
+    return tokens;
+}
+
+bool lex_to_ring(char *input, long input_size, const LexOptions *options, TokenRing *ring) {
+    KeywordTable keyword_table;
+    populate_keyword_lookup_table(&keyword_table, options->dialect);
+
+    // Symbol IDs and bracket matches do not travel with the batches
+    LexOptions stream_options = *options;
+    stream_options.symbols = NULL;
+    stream_options.match_brackets = false;
+
+    TokenBatch *batch = token_ring_reserve(ring);
+
+    LexStream stream;
+    lex_stream_init(&stream, input, input_size, &stream_options, &keyword_table, batch_tokens(batch));
+
+    int ready = 0;      // Tokens of the batch with keywords resolved and filtered
+    int previous = 0;   // Tokens of the last vector, waiting for the next one
+    TokenType held_types[VECTOR_SIZE];
+    uint32_t held_locs[VECTOR_SIZE];
+
+    while (lex_stream_block(&stream)) {
+        if (previous > 0) {
+            ready += finish_vector_tokens(&stream, ready, previous, &keyword_table, options->filter);
+        }
+
+        previous = (int) stream.tokens.size - ready;
+
+        // Publish once the next vector may not fit
+        if (stream.tokens.size <= TOKEN_BATCH_SIZE - VECTOR_SIZE)
+            continue;
+
+        // Tokens of the last vector move to the next batch
+        memcpy(held_types, batch->types + ready, previous * sizeof(TokenType));
+        memcpy(held_locs, batch->locs + ready, previous * sizeof(uint32_t));
+
+        batch->size = ready;
+        token_ring_publish(ring);
+
+        batch = token_ring_reserve(ring);
+        memcpy(batch->types, held_types, previous * sizeof(TokenType));
+        memcpy(batch->locs, held_locs, previous * sizeof(uint32_t));
+
+        stream.tokens = batch_tokens(batch);
+        stream.tokens.src = input;
+        stream.tokens.size = previous;
+        ready = 0;
+    }
+
+    // Resolving the tokens already finished again leaves them unchanged
+    const TokenArray tokens = lex_stream_finish(&stream, &stream_options, &keyword_table);
+
+    if (tokens.size > 0) {
+        batch->size = tokens.size;
+        token_ring_publish(ring);
+    }
+
+    token_ring_close(ring);
+
+    return tokens.has_errors;
+}
+
+static void *consume_batches(void *arg) {
+    PipelineConsumer *pipeline = arg;
+
+    for (const TokenBatch *batch; (batch = token_ring_peek(pipeline->ring)) != NULL;) {
+        pipeline->consumer(batch, pipeline->src, pipeline->user);
+        token_ring_release(pipeline->ring);
+    }
+
+    return NULL;
+}
+
+bool lex_pipelined(char *input, long input_size, const LexOptions *options, TokenBatchConsumer consumer,
+                   void *user) {
+    TokenRing ring;
+    if (!token_ring_init(&ring, TOKEN_RING_BATCHES))
+        return true;
+
+    PipelineConsumer pipeline = { &ring, input, consumer, user };
+    pthread_t thread;
+
+    // The ring holds a few batches only, the consumer has to run alongside the lexer
+    if (pthread_create(&thread, NULL, consume_batches, &pipeline) != 0) {
+        fprintf(stderr, "Could not start the consumer thread.\n");
+        token_ring_free(&ring);
+        return true;
+    }
+
+    const bool has_errors = lex_to_ring(input, input_size, options, &ring);
+
+    pthread_join(thread, NULL);
+    token_ring_free(&ring);
+
+    return has_errors;
+}
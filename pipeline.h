@@ -0,0 +1,130 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "lexer.h"
+
+#define TOKEN_BATCH_SIZE 800    // Tokens per batch, about 4 KiB
+#define TOKEN_RING_BATCHES 16   // Batches of a ring, small enough to stay in L2
+
+/**
+ * Tokens published at once through a TokenRing, keywords resolved.
+ */
+typedef struct TokenBatch TokenBatch;
+struct TokenBatch {
+    TokenType types[TOKEN_BATCH_SIZE] __attribute__((aligned(CACHE_LINE_SIZE)));
+    uint32_t locs[TOKEN_BATCH_SIZE] __attribute__((aligned(CACHE_LINE_SIZE)));
+    uint32_t size;
+};
+
+/**
+ * Lock-free single producer, single consumer ring of token batches. Each
+ *  side owns one cache line with its index and a cached copy of the other
+ *  index, so the line of the other side is only read when the ring looks
+ *  full or empty.
+ */
+typedef struct TokenRing TokenRing;
+struct TokenRing {
+    _Alignas(CACHE_LINE_SIZE) atomic_uint_fast64_t head;   // Next batch to consume
+    uint64_t cached_tail;                                   // Consumer copy of tail
+
+    _Alignas(CACHE_LINE_SIZE) atomic_uint_fast64_t tail;   // Next batch to publish
+    uint64_t cached_head;                                   // Producer copy of head
+    atomic_bool closed;                                     // No batch will be published anymore
+
+    _Alignas(CACHE_LINE_SIZE) TokenBatch *batches;
+    uint32_t capacity;                                      // Number of batches, a power of two
+};
+
+/**
+ * Called by the consumer thread of lex_pipelined for each batch, in order.
+ *
+ * @param batch Tokens of the batch, valid until the callback returns.
+ * @param src Lexed input, still rewritten by the lexer after the vector
+ *  that follows the one of the last token of the batch.
+ * @param user User context.
+ */
+typedef void (*TokenBatchConsumer)(const TokenBatch *batch, const char *src, void *user);
+
+/**
+ * @param ring Ring to initialize.
+ * @param capacity Number of batches, rounded up to a power of two.
+ * @return False if out of memory.
+ */
+bool token_ring_init(TokenRing *ring, uint32_t capacity);
+
+void token_ring_free(TokenRing *ring);
+
+/**
+ * Producer: batch to fill next, waits while the ring is full.
+ *
+ * @param ring Token ring.
+ * @return Batch owned by the producer until token_ring_publish.
+ */
+TokenBatch *token_ring_reserve(TokenRing *ring);
+
+/**
+ * Producer: hand the reserved batch to the consumer.
+ *
+ * @param ring Token ring.
+ */
+void token_ring_publish(TokenRing *ring);
+
+/**
+ * Producer: no batch follows, the consumer stops once the ring is empty.
+ *
+ * @param ring Token ring.
+ */
+void token_ring_close(TokenRing *ring);
+
+/**
+ * Consumer: next published batch, waits while the ring is empty.
+ *
+ * @param ring Token ring.
+ * @return The batch, owned by the consumer until token_ring_release, or
+ *  NULL once the ring is closed and empty.
+ */
+const TokenBatch *token_ring_peek(TokenRing *ring);
+
+/**
+ * Consumer: give the peeked batch back to the producer.
+ *
+ * @param ring Token ring.
+ */
+void token_ring_release(TokenRing *ring);
+
+/**
+ * Lex into a ring, one batch at a time. Keywords are resolved and the
+ *  filter applied once the vector after the tokens is lexed, like
+ *  lex_with_callback does, so the tokens of the last vector of a batch
+ *  are held back to the next one. Symbols are not interned, brackets not
+ *  matched, layout flags not stored and no end-of-file token is
+ *  appended. The ring is closed at the end.
+ *
+ * @param input Input padded like for lex, modified while lexing.
+ * @param input_size Length of input.
+ * @param options Lexer options.
+ * @param ring Token ring, written by this thread only.
+ * @return True if the input has lexical errors.
+ */
+bool lex_to_ring(char *input, long input_size, const LexOptions *options, TokenRing *ring);
+
+/**
+ * Lex on the calling thread while a consumer thread drains the token
+ *  batches, so that lexing and the consumer overlap and the tokens never
+ *  leave the L2 cache. The full token array is never built.
+ *
+ * @param input Input padded like for lex, modified while lexing.
+ * @param input_size Length of input.
+ * @param options Lexer options.
+ * @param consumer Called on the consumer thread for each batch.
+ * @param user User context passed to consumer.
+ * @return True if the input has lexical errors.
+ */
+bool lex_pipelined(char *input, long input_size, const LexOptions *options, TokenBatchConsumer consumer,
+                   void *user);
+
+#endif //PIPELINE_H
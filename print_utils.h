@@ -0,0 +1,20 @@
+#ifndef PRINT_UTILS_H
+#define PRINT_UTILS_H
+
+#include <immintrin.h>
+#include <stdint.h>
+
+// Debugging helpers, not part of the library
+
+void print_array_epi8(int8_t* array, int size);
+
+void print_m128_epi8(__m128i input);
+
+void print_m256_epi8(__m256i input);
+
+/**
+ * Print the 32 characters of a vector, newlines escaped.
+ */
+void print_char(char *input);
+
+#endif //PRINT_UTILS_H
@@ -0,0 +1,628 @@
+#define _GNU_SOURCE
+
+#include "reader.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "tokens.h"
+
+#define READER_THREADS 4        // Threads of the fallback reader
+
+typedef enum SlotState SlotState;
+enum SlotState {
+    SLOT_FREE,
+    SLOT_OPENING,
+    SLOT_SIZING,
+    SLOT_READING,
+    SLOT_DONE,                  // Read, waiting for batch_reader_next
+    SLOT_IN_USE                 // Returned by batch_reader_next
+};
+
+typedef struct ReadSlot ReadSlot;
+struct ReadSlot {
+    SlotState state;
+    int index;                  // File read into this slot
+    int fd;
+    char *data;
+    long capacity;
+    long padded;                // Size of the padded buffer of the current file
+    long size;
+    long done;                  // Bytes read so far
+    bool failed;
+    struct statx stx;
+};
+
+/**
+ * Submission and completion rings shared with the kernel.
+ */
+typedef struct Uring Uring;
+struct Uring {
+    int fd;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_ring;
+    void *cq_ring;
+    size_t sq_ring_size;
+    size_t cq_ring_size;
+    size_t sqes_size;
+    unsigned to_submit;         // Queued requests not yet passed to io_uring_enter
+    int in_flight;              // Requests without completion
+};
+
+struct BatchReader {
+    char **paths;
+    int count;
+    int next_path;              // Next file to start reading
+    int returned;               // Files returned by batch_reader_next
+    AllocPolicy policy;
+    ReadSlot *slots;
+    int depth;
+    int *done_queue;            // Read slots in completion order
+    int done_head;
+    int done_size;
+
+    bool io_uring;
+    Uring ring;
+
+    // Thread fallback
+    pthread_t threads[READER_THREADS];
+    int thread_count;
+    pthread_mutex_t lock;
+    pthread_cond_t slot_freed;
+    pthread_cond_t file_read;
+    bool stopping;
+};
+
+static bool reserve_buffer(BatchReader *reader, ReadSlot *slot) {
+    // Same padding as read_file
+    long size = slot->size + 1;
+    size += (VECTOR_SIZE - (size % VECTOR_SIZE)) % VECTOR_SIZE;
+    slot->padded = size + VECTOR_SIZE;
+
+    if (slot->padded <= slot->capacity)
+        return true;
+
+    free(slot->data);
+    slot->data = policy_alloc(slot->padded, VECTOR_SIZE, &reader->policy);
+    slot->capacity = slot->data != NULL ? slot->padded : 0;
+
+    if (slot->data == NULL) {
+        fprintf(stderr, "Memory allocation failure.\n");
+        return false;
+    }
+
+    return true;
+}
+
+static void push_done(BatchReader *reader, int slot_index) {
+    reader->slots[slot_index].state = SLOT_DONE;
+    reader->done_queue[(reader->done_head + reader->done_size) % reader->depth] = slot_index;
+    ++reader->done_size;
+}
+
+static void finish_slot(BatchReader *reader, int slot_index) {
+    ReadSlot *slot = &reader->slots[slot_index];
+
+    if (slot->fd >= 0) {
+        close(slot->fd);
+        slot->fd = -1;
+    }
+
+    if (!slot->failed) {
+        memset(slot->data + slot->size, 0, slot->padded - slot->size);  // Null-terminate and clear padding
+    }
+
+    push_done(reader, slot_index);
+}
+
+static bool uring_init(Uring *ring, unsigned entries) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+
+    ring->fd = (int) syscall(__NR_io_uring_setup, entries, &params);
+    if (ring->fd < 0)
+        return false;
+
+    // Opens, sizes and reads of files need kernel 5.6
+    const size_t probe_size = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe *probe = calloc(1, probe_size);
+
+    const bool supported = probe != NULL
+        && syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_PROBE, probe, 256) == 0
+        && probe->last_op >= IORING_OP_READ
+        && (probe->ops[IORING_OP_OPENAT].flags & IO_URING_OP_SUPPORTED)
+        && (probe->ops[IORING_OP_STATX].flags & IO_URING_OP_SUPPORTED)
+        && (probe->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED);
+
+    free(probe);
+
+    if (!supported) {
+        close(ring->fd);
+        return false;
+    }
+
+    ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    // Both rings share one mapping on kernels with IORING_FEAT_SINGLE_MMAP
+    const bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap && ring->cq_ring_size > ring->sq_ring_size) {
+        ring->sq_ring_size = ring->cq_ring_size;
+    }
+
+    ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd,
+                         IORING_OFF_SQ_RING);
+    ring->cq_ring = single_mmap ? ring->sq_ring
+                                : mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                       ring->fd, IORING_OFF_CQ_RING);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd,
+                      IORING_OFF_SQES);
+
+    if (ring->sq_ring == MAP_FAILED || ring->cq_ring == MAP_FAILED || ring->sqes == MAP_FAILED) {
+        close(ring->fd);
+        return false;
+    }
+
+    char *sq = ring->sq_ring;
+    char *cq = ring->cq_ring;
+
+    ring->sq_tail = (unsigned *) (sq + params.sq_off.tail);
+    ring->sq_mask = (unsigned *) (sq + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned *) (sq + params.sq_off.array);
+    ring->cq_head = (unsigned *) (cq + params.cq_off.head);
+    ring->cq_tail = (unsigned *) (cq + params.cq_off.tail);
+    ring->cq_mask = (unsigned *) (cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *) (cq + params.cq_off.cqes);
+    ring->to_submit = 0;
+    ring->in_flight = 0;
+
+    return true;
+}
+
+static void uring_free(Uring *ring) {
+    munmap(ring->sqes, ring->sqes_size);
+
+    if (ring->cq_ring != ring->sq_ring) {
+        munmap(ring->cq_ring, ring->cq_ring_size);
+    }
+
+    munmap(ring->sq_ring, ring->sq_ring_size);
+    close(ring->fd);
+}
+
+// Each slot has at most one request in flight, so the ring never fills up
+static struct io_uring_sqe *uring_sqe(Uring *ring, int slot_index) {
+    const unsigned tail = *ring->sq_tail;
+    const unsigned index = tail & *ring->sq_mask;
+
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->user_data = slot_index;
+
+    ring->sq_array[index] = index;
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+    ++ring->to_submit;
+    ++ring->in_flight;
+
+    return sqe;
+}
+
+static void queue_open(BatchReader *reader, int slot_index) {
+    ReadSlot *slot = &reader->slots[slot_index];
+    struct io_uring_sqe *sqe = uring_sqe(&reader->ring, slot_index);
+
+    sqe->opcode = IORING_OP_OPENAT;
+    sqe->fd = AT_FDCWD;
+    sqe->addr = (uintptr_t) reader->paths[slot->index];
+    sqe->open_flags = O_RDONLY;
+
+    slot->state = SLOT_OPENING;
+}
+
+static void queue_statx(BatchReader *reader, int slot_index) {
+    ReadSlot *slot = &reader->slots[slot_index];
+    struct io_uring_sqe *sqe = uring_sqe(&reader->ring, slot_index);
+
+    sqe->opcode = IORING_OP_STATX;
+    sqe->fd = slot->fd;
+    sqe->addr = (uintptr_t) "";
+    sqe->statx_flags = AT_EMPTY_PATH;
+    sqe->len = STATX_SIZE;
+    sqe->off = (uintptr_t) &slot->stx;
+
+    slot->state = SLOT_SIZING;
+}
+
+static void queue_read(BatchReader *reader, int slot_index) {
+    ReadSlot *slot = &reader->slots[slot_index];
+    struct io_uring_sqe *sqe = uring_sqe(&reader->ring, slot_index);
+
+    // Short reads are queued again for the rest
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = slot->fd;
+    sqe->addr = (uintptr_t) (slot->data + slot->done);
+    sqe->len = slot->size - slot->done;
+    sqe->off = slot->done;
+
+    slot->state = SLOT_READING;
+}
+
+static void start_file(BatchReader *reader, int slot_index) {
+    ReadSlot *slot = &reader->slots[slot_index];
+
+    slot->index = reader->next_path++;
+    slot->fd = -1;
+    slot->size = 0;
+    slot->done = 0;
+    slot->failed = false;
+
+    queue_open(reader, slot_index);
+}
+
+static void fail_slot(BatchReader *reader, int slot_index, const char *message) {
+    ReadSlot *slot = &reader->slots[slot_index];
+
+    fprintf(stderr, "%s %s.\n", message, reader->paths[slot->index]);
+    slot->failed = true;
+
+    finish_slot(reader, slot_index);
+}
+
+static void handle_completion(BatchReader *reader, int slot_index, int res) {
+    ReadSlot *slot = &reader->slots[slot_index];
+
+    switch (slot->state) {
+        case SLOT_OPENING:
+            if (res < 0) {
+                fail_slot(reader, slot_index, "Error opening file");
+                return;
+            }
+
+            slot->fd = res;
+            queue_statx(reader, slot_index);
+            return;
+
+        case SLOT_SIZING:
+            if (res < 0) {
+                fail_slot(reader, slot_index, "Error reading file");
+                return;
+            }
+
+            slot->size = (long) slot->stx.stx_size;
+
+            if (!reserve_buffer(reader, slot)) {
+                slot->failed = true;
+                finish_slot(reader, slot_index);
+            } else if (slot->size == 0) {
+                finish_slot(reader, slot_index);
+            } else {
+                queue_read(reader, slot_index);
+            }
+            return;
+
+        case SLOT_READING:
+            if (res < 0) {
+                fail_slot(reader, slot_index, "Error reading file");
+                return;
+            }
+
+            // The file shrank since it was sized
+            if (res == 0) {
+                slot->size = slot->done;
+            }
+
+            slot->done += res;
+
+            if (slot->done < slot->size) {
+                queue_read(reader, slot_index);
+            } else {
+                finish_slot(reader, slot_index);
+            }
+            return;
+
+        default:
+            return;
+    }
+}
+
+// Submit queued requests and wait for at least one completion
+static bool uring_wait(BatchReader *reader) {
+    Uring *ring = &reader->ring;
+
+    while (true) {
+        const long ret = syscall(__NR_io_uring_enter, ring->fd, ring->to_submit, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+
+        if (ret >= 0) {
+            ring->to_submit -= ret;
+            break;
+        }
+
+        if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+            fprintf(stderr, "io_uring_enter failed: %s.\n", strerror(errno));
+            return false;
+        }
+    }
+
+    unsigned head = *ring->cq_head;
+    const unsigned tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+
+    for (; head != tail; ++head) {
+        const struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+
+        --ring->in_flight;
+        handle_completion(reader, (int) cqe->user_data, cqe->res);
+    }
+
+    __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+
+    return true;
+}
+
+// Read a file with blocking calls, used by the fallback threads
+static void read_slot(BatchReader *reader, ReadSlot *slot, const char *path) {
+    slot->failed = true;
+
+    const int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Error opening file %s.\n", path);
+        return;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        fprintf(stderr, "Error reading file %s.\n", path);
+        close(fd);
+        return;
+    }
+
+    slot->size = st.st_size;
+
+    if (!reserve_buffer(reader, slot)) {
+        close(fd);
+        return;
+    }
+
+    for (slot->done = 0; slot->done < slot->size;) {
+        const ssize_t res = pread(fd, slot->data + slot->done, slot->size - slot->done, slot->done);
+
+        if (res < 0 && errno == EINTR)
+            continue;
+
+        if (res < 0) {
+            fprintf(stderr, "Error reading file %s.\n", path);
+            close(fd);
+            return;
+        }
+
+        // The file shrank since it was sized
+        if (res == 0) {
+            slot->size = slot->done;
+        }
+
+        slot->done += res;
+    }
+
+    close(fd);
+
+    memset(slot->data + slot->size, 0, slot->padded - slot->size);  // Null-terminate and clear padding
+    slot->failed = false;
+}
+
+static void *reader_thread(void *arg) {
+    BatchReader *reader = arg;
+
+    pthread_mutex_lock(&reader->lock);
+
+    while (true) {
+        int slot_index = -1;
+
+        for (int i = 0; i < reader->depth && slot_index < 0; ++i) {
+            if (reader->slots[i].state == SLOT_FREE)
+                slot_index = i;
+        }
+
+        if (reader->stopping || reader->next_path == reader->count)
+            break;
+
+        if (slot_index < 0) {
+            pthread_cond_wait(&reader->slot_freed, &reader->lock);
+            continue;
+        }
+
+        ReadSlot *slot = &reader->slots[slot_index];
+        slot->index = reader->next_path++;
+        slot->state = SLOT_READING;
+
+        pthread_mutex_unlock(&reader->lock);
+        read_slot(reader, slot, reader->paths[slot->index]);
+        pthread_mutex_lock(&reader->lock);
+
+        push_done(reader, slot_index);
+        pthread_cond_signal(&reader->file_read);
+    }
+
+    pthread_mutex_unlock(&reader->lock);
+
+    return NULL;
+}
+
+BatchReader *batch_reader_create(char **paths, int count, int depth, const AllocPolicy *policy) {
+    BatchReader *reader = calloc(1, sizeof(BatchReader));
+
+    if (depth < 1)
+        depth = 1;
+
+    if (reader != NULL) {
+        reader->slots = calloc(depth, sizeof(ReadSlot));
+        reader->done_queue = calloc(depth, sizeof(int));
+    }
+
+    if (reader == NULL || reader->slots == NULL || reader->done_queue == NULL) {
+        fprintf(stderr, "Memory allocation failure.\n");
+
+        if (reader != NULL) {
+            free(reader->slots);
+            free(reader->done_queue);
+            free(reader);
+        }
+
+        return NULL;
+    }
+
+    reader->paths = paths;
+    reader->count = count;
+    reader->depth = depth;
+
+    if (policy != NULL) {
+        reader->policy = *policy;
+    }
+
+    reader->io_uring = uring_init(&reader->ring, 2 * depth);
+
+    if (reader->io_uring) {
+        for (int i = 0; i < depth && reader->next_path < count; ++i) {
+            start_file(reader, i);
+        }
+
+        return reader;
+    }
+
+    // Blocking reads on a few threads
+    pthread_mutex_init(&reader->lock, NULL);
+    pthread_cond_init(&reader->slot_freed, NULL);
+    pthread_cond_init(&reader->file_read, NULL);
+
+    const int threads = depth < READER_THREADS ? depth : READER_THREADS;
+
+    for (; reader->thread_count < threads; ++reader->thread_count) {
+        if (pthread_create(&reader->threads[reader->thread_count], NULL, reader_thread, reader) != 0)
+            break;
+    }
+
+    if (reader->thread_count == 0) {
+        fprintf(stderr, "Could not start reader threads.\n");
+        batch_reader_free(reader);
+        return NULL;
+    }
+
+    return reader;
+}
+
+static void pop_done(BatchReader *reader, FileBuffer *file) {
+    const int slot_index = reader->done_queue[reader->done_head];
+    ReadSlot *slot = &reader->slots[slot_index];
+
+    reader->done_head = (reader->done_head + 1) % reader->depth;
+    --reader->done_size;
+    ++reader->returned;
+
+    slot->state = SLOT_IN_USE;
+
+    file->index = slot->index;
+    file->data = slot->failed ? NULL : slot->data;
+    file->size = slot->failed ? 0 : slot->size;
+    file->slot = slot_index;
+}
+
+bool batch_reader_next(BatchReader *reader, FileBuffer *file) {
+    if (reader->io_uring) {
+        while (reader->done_size == 0) {
+            if (reader->returned == reader->count || reader->ring.in_flight == 0)
+                return false;
+
+            if (!uring_wait(reader))
+                return false;
+        }
+
+        pop_done(reader, file);
+        return true;
+    }
+
+    pthread_mutex_lock(&reader->lock);
+
+    while (reader->done_size == 0 && reader->returned < reader->count) {
+        pthread_cond_wait(&reader->file_read, &reader->lock);
+    }
+
+    const bool found = reader->done_size > 0;
+    if (found) {
+        pop_done(reader, file);
+    }
+
+    pthread_mutex_unlock(&reader->lock);
+
+    return found;
+}
+
+void batch_reader_release(BatchReader *reader, const FileBuffer *file) {
+    if (reader->io_uring) {
+        reader->slots[file->slot].state = SLOT_FREE;
+
+        if (reader->next_path < reader->count) {
+            start_file(reader, file->slot);
+        }
+
+        return;
+    }
+
+    pthread_mutex_lock(&reader->lock);
+    reader->slots[file->slot].state = SLOT_FREE;
+    pthread_cond_signal(&reader->slot_freed);
+    pthread_mutex_unlock(&reader->lock);
+}
+
+void batch_reader_free(BatchReader *reader) {
+    if (reader == NULL)
+        return;
+
+    if (reader->io_uring) {
+        // Buffers may still be written by the kernel
+        while (reader->ring.in_flight > 0 && uring_wait(reader));
+
+        uring_free(&reader->ring);
+    } else {
+        pthread_mutex_lock(&reader->lock);
+        reader->stopping = true;
+        pthread_cond_broadcast(&reader->slot_freed);
+        pthread_mutex_unlock(&reader->lock);
+
+        for (int i = 0; i < reader->thread_count; ++i) {
+            pthread_join(reader->threads[i], NULL);
+        }
+
+        pthread_mutex_destroy(&reader->lock);
+        pthread_cond_destroy(&reader->slot_freed);
+        pthread_cond_destroy(&reader->file_read);
+    }
+
+    for (int i = 0; i < reader->depth; ++i) {
+        free(reader->slots[i].data);
+    }
+
+    free(reader->slots);
+    free(reader->done_queue);
+    free(reader);
+}
+
+bool batch_reader_uses_io_uring(const BatchReader *reader) {
+    return reader->io_uring;
+}
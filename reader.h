@@ -0,0 +1,69 @@
+#ifndef READER_H
+#define READER_H
+
+#include <stdbool.h>
+
+#include "memory.h"
+
+#define READER_DEPTH 8          // Files read ahead of the consumer
+
+/**
+ * Content of a file returned by batch_reader_next. The buffer is zero
+ *  padded like read_file and belongs to the reader until released.
+ */
+typedef struct FileBuffer FileBuffer;
+struct FileBuffer {
+    int index;                  // Index of the file in the paths given to the reader
+    char *data;                 // NULL if the file could not be read
+    long size;                  // Length of the file
+    int slot;                   // Buffer of the pool
+};
+
+typedef struct BatchReader BatchReader;
+
+/**
+ * Start reading files in the background. Opens, sizes and reads are
+ *  queued through io_uring, or run by a few threads if io_uring is not
+ *  available. Each file in flight holds one buffer of a pool of depth
+ *  buffers, reused once released, so reading stays at most depth files
+ *  ahead of the consumer.
+ *
+ * @param paths Paths of the files, must outlive the reader.
+ * @param count Number of files.
+ * @param depth Number of buffers in the pool.
+ * @param policy Allocation policy of the buffers, NULL for the default one.
+ * @return The reader, NULL on errors.
+ */
+BatchReader *batch_reader_create(char **paths, int count, int depth, const AllocPolicy *policy);
+
+/**
+ * Wait for the next file to be read, in completion order. Files are only
+ *  started in released buffers, so the caller must release a file before
+ *  asking for more than depth of them.
+ *
+ * @param reader Batch reader.
+ * @param file Where the file is stored.
+ * @return False once every file was returned.
+ */
+bool batch_reader_next(BatchReader *reader, FileBuffer *file);
+
+/**
+ * Give the buffer of a file back to the pool, to read the next file into.
+ *
+ * @param reader Batch reader.
+ * @param file File returned by batch_reader_next.
+ */
+void batch_reader_release(BatchReader *reader, const FileBuffer *file);
+
+/**
+ * @param reader Batch reader, waits for files still being read.
+ */
+void batch_reader_free(BatchReader *reader);
+
+/**
+ * @param reader Batch reader.
+ * @return True if files are read through io_uring.
+ */
+bool batch_reader_uses_io_uring(const BatchReader *reader);
+
+#endif //READER_H
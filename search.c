@@ -0,0 +1,218 @@
+#define _GNU_SOURCE
+
+#include "search.h"
+
+#include <ctype.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lexer.h"
+#include "parallel.h"
+
+typedef struct SearchContext SearchContext;
+struct SearchContext {
+    const SearchPattern *pattern;
+    char **files;
+    pthread_mutex_t output_lock;
+    atomic_long matches;
+};
+
+bool search_pattern_parse(char *str, SearchPattern *pattern) {
+    pattern->size = 0;
+    pattern->prefilter = NULL;
+    pattern->prefilter_len = 0;
+
+    for (char *item_str = strtok(str, " \t"); item_str != NULL; item_str = strtok(NULL, " \t")) {
+        if (pattern->size == SEARCH_MAX_ITEMS) {
+            fprintf(stderr, "Search pattern longer than %d tokens.\n", SEARCH_MAX_ITEMS);
+            return false;
+        }
+
+        SearchItem *item = &pattern->items[pattern->size++];
+        token_filter_clear(&item->types);
+        item->text = NULL;
+        item->len = 0;
+
+        // Token kind
+        if (item_str[0] == ':' && item_str[1] != '\0') {
+            if (!token_filter_add_name(&item->types, item_str + 1)) {
+                fprintf(stderr, "Unknown token type: %s.\n", item_str + 1);
+                return false;
+            }
+
+            continue;
+        }
+
+        // Token text: types spelled like it, or read from the source
+        item->text = item_str;
+        item->len = strlen(item_str);
+
+        for (int type = 0; type < 256; ++type) {
+            if (token_names[type] == NULL || type == TOK_EOF)
+                continue;
+
+            if (token_spellings[type] == NULL || strcmp(token_spellings[type], item_str) == 0)
+                token_filter_add(&item->types, type);
+        }
+
+        // Longest identifier or number is the prefilter
+        if ((isalnum((unsigned char) item_str[0]) || item_str[0] == '_') && item->len > pattern->prefilter_len) {
+            pattern->prefilter = item->text;
+            pattern->prefilter_len = item->len;
+        }
+    }
+
+    return pattern->size > 0;
+}
+
+bool contains_substring(const char *haystack, long size, const char *needle, int len) {
+    if (len == 0)
+        return true;
+
+    const __m256i first = _mm256_set1_epi8(needle[0]);
+    const __m256i last = _mm256_set1_epi8(needle[len - 1]);
+
+    long i = 0;
+    for (; i + VECTOR_SIZE + len - 1 <= size; i += VECTOR_SIZE) {
+        const __m256i block_first = _mm256_loadu_si256((const __m256i *) (haystack + i));
+        const __m256i block_last = _mm256_loadu_si256((const __m256i *) (haystack + i + len - 1));
+
+        uint32_t candidates = _mm256_movemask_epi8(
+            _mm256_and_si256(
+                _mm256_cmpeq_epi8(block_first, first),
+                _mm256_cmpeq_epi8(block_last, last)
+            )
+        );
+
+        while (candidates) {
+            const int pos = __builtin_ctz(candidates);
+
+            if (len <= 2 || memcmp(haystack + i + pos + 1, needle + 1, len - 2) == 0)
+                return true;
+
+            candidates &= candidates - 1;
+        }
+    }
+
+    return memmem(haystack + i, size - i, needle, len) != NULL;
+}
+
+static bool token_text_equals(const TokenArray *tokens, uint64_t i, long file_size, const char *text, int len) {
+    const char *spelling = token_spellings[tokens->token_types[i]];
+
+    if (spelling != NULL)
+        return strcmp(spelling, text) == 0;
+
+    const uint32_t loc = tokens->token_locs[i];
+    if (loc + len > file_size || memcmp(tokens->src + loc, text, len) != 0)
+        return false;
+
+    // The token must end with the text, lexing put a NUL after the text of every token read from the source
+    return tokens->src[loc + len] == '\0';
+}
+
+static bool matches_at(const TokenArray *tokens, uint64_t i, long file_size, const SearchPattern *pattern) {
+    for (int j = 0; j < pattern->size; ++j) {
+        const SearchItem *item = &pattern->items[j];
+
+        if (!token_filter_has(&item->types, tokens->token_types[i + j]))
+            return false;
+
+        if (item->text != NULL && !token_text_equals(tokens, i + j, file_size, item->text, item->len))
+            return false;
+    }
+
+    return true;
+}
+
+static void search_file(int index, int worker, void *ctx) {
+    SearchContext *search = ctx;
+    const SearchPattern *pattern = search->pattern;
+    const char *file_path = search->files[index];
+
+    long file_size;
+    char *file_content = read_file(file_path, &file_size, VECTOR_SIZE, NULL);
+
+    if (file_content == NULL)
+        return;
+
+    // Skip files that cannot match without lexing them
+    if (pattern->prefilter != NULL
+        && !contains_substring(file_content, file_size, pattern->prefilter, pattern->prefilter_len)) {
+        free(file_content);
+        return;
+    }
+
+    LexOptions options = {0};
+    options.dialect = dialect_from_path(file_path);
+
+    // A single token pattern only needs its own types
+    if (pattern->size == 1) {
+        options.filter = &pattern->items[0].types;
+    }
+
+    TokenArray tokens = lex(file_content, file_size, &options);
+
+    char *output = NULL;
+    size_t output_size = 0;
+    FILE *stream = open_memstream(&output, &output_size);
+    long matches = 0;
+
+    for (uint64_t i = 0; i + pattern->size <= tokens.size; ++i) {
+        if (matches_at(&tokens, i, file_size, pattern)) {
+            fprintf(stream, "%s:%u\n", file_path, tokens.token_locs[i]);
+            ++matches;
+        }
+    }
+
+    fclose(stream);
+
+    // Print the results of a file together
+    if (matches) {
+        pthread_mutex_lock(&search->output_lock);
+        fwrite(output, 1, output_size, stdout);
+        pthread_mutex_unlock(&search->output_lock);
+
+        atomic_fetch_add(&search->matches, matches);
+    }
+
+    free(output);
+    free_token_array(tokens);
+    free(file_content);
+}
+
+int search_main(int argc, char **argv) {
+    int threads = default_thread_count();
+    int arg = 0;
+
+    if (arg + 1 < argc && strcmp(argv[arg], "-j") == 0) {
+        threads = atoi(argv[arg + 1]);
+        arg += 2;
+    }
+
+    if (argc - arg < 2 || threads < 1) {
+        fprintf(stderr, "Usage: simd-lexer search [-j <threads>] <pattern> <file>...\n");
+        return 2;
+    }
+
+    SearchPattern pattern;
+    if (!search_pattern_parse(argv[arg], &pattern)) {
+        fprintf(stderr, "Invalid search pattern.\n");
+        return 2;
+    }
+
+    SearchContext search;
+    search.pattern = &pattern;
+    search.files = argv + arg + 1;
+    pthread_mutex_init(&search.output_lock, NULL);
+    atomic_init(&search.matches, 0);
+
+    parallel_for(argc - arg - 1, threads, search_file, &search);
+
+    pthread_mutex_destroy(&search.output_lock);
+
+    return atomic_load(&search.matches) ? 0 : 1;
+}
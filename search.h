@@ -0,0 +1,63 @@
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include <stdbool.h>
+
+#include "tokens.h"
+
+#define SEARCH_MAX_ITEMS 16
+
+/**
+ * One token of a search pattern. Matches a token whose type is in types
+ *  and, if text is not NULL, whose text equals text.
+ */
+typedef struct SearchItem SearchItem;
+struct SearchItem {
+    TokenFilter types;
+    const char *text;
+    int len;
+};
+
+/**
+ * Sequence of consecutive tokens to search for. Written as space separated
+ *  items: ":name" matches any token of that kind (e.g. ":string_literal"),
+ *  anything else matches a token with that text (e.g. "memcpy ( :identifier").
+ */
+typedef struct SearchPattern SearchPattern;
+struct SearchPattern {
+    SearchItem items[SEARCH_MAX_ITEMS];
+    int size;
+    const char *prefilter;      // Text every matching file contains, or NULL
+    int prefilter_len;
+};
+
+/**
+ * Parse a search pattern. Items point into str.
+ *
+ * @param str Pattern text, modified.
+ * @param pattern Where the pattern is stored.
+ * @return False if the pattern is empty or invalid.
+ */
+bool search_pattern_parse(char *str, SearchPattern *pattern);
+
+/**
+ * Search for a substring with 32-byte compares of its first and last
+ *  bytes, checking candidates with memcmp.
+ *
+ * @param haystack Text to search, padded by VECTOR_SIZE bytes.
+ * @param size Length of haystack.
+ * @param needle Text to search for.
+ * @param len Length of needle.
+ * @return True if haystack contains needle.
+ */
+bool contains_substring(const char *haystack, long size, const char *needle, int len);
+
+/**
+ * Entry point of "simd-lexer search [-j <threads>] <pattern> <file>...".
+ *  Files are lexed in parallel and matches printed as file:offset.
+ *
+ * @return 0 if anything matched, 1 if nothing matched, 2 on errors.
+ */
+int search_main(int argc, char **argv);
+
+#endif //SEARCH_H
@@ -0,0 +1,182 @@
+#include "simdlex.h"
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lexer.h"
+#include "tune.h"
+
+struct SimdLex {
+    LexOptions options;
+    char *buffer;               // Padded copy of the input, modified by lex
+    long buffer_capacity;
+    long size;                  // Length of the input
+    TokenArray tokens;
+    LexError *errors;
+    int error_count;
+    int error_capacity;
+};
+
+// Padding read past the end of input, see read_file
+static long padded_size(long size) {
+    return (size + 1 + VECTOR_SIZE - 1) / VECTOR_SIZE * VECTOR_SIZE + VECTOR_SIZE;
+}
+
+static char *padded_copy(const char *input, long size, char *buffer, long *capacity) {
+    const long needed = padded_size(size);
+
+    if (needed > *capacity) {
+        free(buffer);
+
+        if (posix_memalign((void **) &buffer, VECTOR_SIZE, needed))
+            return NULL;
+
+        *capacity = needed;
+    }
+
+    memcpy(buffer, input, size);
+    memset(buffer + size, 0, needed - size);
+
+    return buffer;
+}
+
+SimdLex *simdlex_create(SimdLexDialect dialect) {
+    SimdLex *ctx = calloc(1, sizeof(SimdLex));
+
+    if (ctx == NULL)
+        return NULL;
+
+    ctx->options.dialect = dialect == SIMDLEX_DIALECT_CPP ? LEX_DIALECT_CPP : LEX_DIALECT_C;
+
+    // Calibrated once per process, on the first context
+    tune_kernels(NULL);
+
+    return ctx;
+}
+
+void simdlex_free(SimdLex *ctx) {
+    if (ctx == NULL)
+        return;
+
+    free_token_array(ctx->tokens);
+    free(ctx->buffer);
+    free(ctx->errors);
+    free(ctx);
+}
+
+// Slow path, only taken if lex found errors: lex an unmodified copy again
+static int find_errors(SimdLex *ctx, const char *input) {
+    long capacity = 0;
+    char *copy = padded_copy(input, ctx->size, NULL, &capacity);
+
+    if (copy == NULL)
+        return -1;
+
+    int count;
+    while ((count = find_lex_errors(copy, ctx->size, &ctx->options, ctx->errors, ctx->error_capacity))
+           > ctx->error_capacity) {
+        LexError *errors = realloc(ctx->errors, count * sizeof(LexError));
+
+        if (errors == NULL) {
+            free(copy);
+            return -1;
+        }
+
+        ctx->errors = errors;
+        ctx->error_capacity = count;
+    }
+
+    ctx->error_count = count;
+    free(copy);
+
+    return 0;
+}
+
+int simdlex_lex(SimdLex *ctx, const char *input, size_t size) {
+    free_token_array(ctx->tokens);
+    ctx->tokens = (TokenArray) {0};
+
+    ctx->error_count = 0;
+    ctx->size = 0;
+
+    // Token offsets are 32 bits and lex takes a long size
+    if (size > SIMDLEX_MAX_INPUT_SIZE || size > LONG_MAX)
+        return -1;
+
+    ctx->size = size;
+
+    char *buffer = padded_copy(input, size, ctx->buffer, &ctx->buffer_capacity);
+    if (buffer == NULL) {
+        ctx->buffer = NULL;
+        ctx->buffer_capacity = 0;
+        return -1;
+    }
+
+    ctx->buffer = buffer;
+    ctx->tokens = lex(buffer, size, &ctx->options);
+    append_token(&ctx->tokens, create_token(TOK_EOF, size));
+
+    // Public codes in place, the internal ones are only known to the lexer
+    for (uint64_t i = 0; i < ctx->tokens.size; ++i)
+        ctx->tokens.token_types[i] = public_token_types[ctx->tokens.token_types[i]];
+
+    if (ctx->tokens.has_errors)
+        return find_errors(ctx, input);
+
+    return 0;
+}
+
+size_t simdlex_token_count(const SimdLex *ctx) {
+    return ctx->tokens.size;
+}
+
+uint8_t simdlex_token_type(const SimdLex *ctx, size_t index) {
+    return ctx->tokens.token_types[index];
+}
+
+uint32_t simdlex_token_offset(const SimdLex *ctx, size_t index) {
+    return ctx->tokens.token_locs[index];
+}
+
+const uint8_t *simdlex_token_types(const SimdLex *ctx) {
+    return (const uint8_t *) ctx->tokens.token_types;
+}
+
+const uint32_t *simdlex_token_offsets(const SimdLex *ctx) {
+    return ctx->tokens.token_locs;
+}
+
+const char *simdlex_token_text(const SimdLex *ctx, size_t index, size_t *length) {
+    const TokenType type = internal_token_types[ctx->tokens.token_types[index]];
+
+    if (token_spellings[type] != NULL) {
+        *length = strlen(token_spellings[type]);
+        return token_spellings[type];
+    }
+
+    // Separators were replaced by NUL bytes
+    const char *text = ctx->buffer + ctx->tokens.token_locs[index];
+    *length = strnlen(text, ctx->size - ctx->tokens.token_locs[index]);
+
+    return text;
+}
+
+const char *simdlex_token_name(uint8_t type) {
+    if (type >= SIMDLEX_TOKEN_COUNT)
+        return NULL;
+
+    return token_names[internal_token_types[type]];
+}
+
+size_t simdlex_error_count(const SimdLex *ctx) {
+    return ctx->error_count;
+}
+
+uint32_t simdlex_error_offset(const SimdLex *ctx, size_t index) {
+    return ctx->errors[index].offset;
+}
+
+const char *simdlex_error_message(const SimdLex *ctx, size_t index) {
+    return lex_error_message(ctx->errors[index].kind);
+}
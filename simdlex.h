@@ -0,0 +1,106 @@
+#ifndef SIMDLEX_H
+#define SIMDLEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// SimdLexToken, generated from tokens.def
+#include "simdlex_tokens.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SIMDLEX_API __attribute__((visibility("default")))
+
+/**
+ * Lexer context. Keeps a padded copy of the last input and its tokens,
+ *  both reused by the next call to simdlex_lex.
+ */
+typedef struct SimdLex SimdLex;
+
+typedef enum SimdLexDialect SimdLexDialect;
+enum SimdLexDialect {
+    SIMDLEX_DIALECT_C,
+    SIMDLEX_DIALECT_CPP
+};
+
+/**
+ * Create a lexer context.
+ *
+ * @param dialect Language of the inputs.
+ * @return New context, NULL if out of memory.
+ */
+SIMDLEX_API SimdLex *simdlex_create(SimdLexDialect dialect);
+
+SIMDLEX_API void simdlex_free(SimdLex *ctx);
+
+// Largest input simdlex_lex accepts, token offsets are 32 bits
+#define SIMDLEX_MAX_INPUT_SIZE ((size_t) UINT32_MAX)
+
+/**
+ * Lex a buffer. The input is copied and not modified. Tokens of the
+ *  previous call are released.
+ *
+ * @param ctx Lexer context.
+ * @param input Source text.
+ * @param size Length of input, at most SIMDLEX_MAX_INPUT_SIZE.
+ * @return 0 on success, -1 if out of memory or the input is too large.
+ */
+SIMDLEX_API int simdlex_lex(SimdLex *ctx, const char *input, size_t size);
+
+/**
+ * Number of tokens of the last input, the last one is an EOF token.
+ */
+SIMDLEX_API size_t simdlex_token_count(const SimdLex *ctx);
+
+/**
+ * Type of a token, a SimdLexToken. The codes are kept across releases,
+ *  unlike the lexer internal ones.
+ */
+SIMDLEX_API uint8_t simdlex_token_type(const SimdLex *ctx, size_t index);
+
+/**
+ * Offset of a token in the input.
+ */
+SIMDLEX_API uint32_t simdlex_token_offset(const SimdLex *ctx, size_t index);
+
+/**
+ * Token types (SimdLexToken) and offsets as arrays of simdlex_token_count elements,
+ *  valid until the next call to simdlex_lex or simdlex_free.
+ */
+SIMDLEX_API const uint8_t *simdlex_token_types(const SimdLex *ctx);
+SIMDLEX_API const uint32_t *simdlex_token_offsets(const SimdLex *ctx);
+
+/**
+ * Text of a token, valid until the next call to simdlex_lex or
+ *  simdlex_free.
+ *
+ * @param ctx Lexer context.
+ * @param index Token index.
+ * @param length Where the length of the text is stored.
+ * @return Start of the text, not NUL terminated.
+ */
+SIMDLEX_API const char *simdlex_token_text(const SimdLex *ctx, size_t index, size_t *length);
+
+/**
+ * Clang name of a token type (e.g. "identifier", "l_paren").
+ *
+ * @param type A SimdLexToken.
+ * @return Name, NULL for unknown types.
+ */
+SIMDLEX_API const char *simdlex_token_name(uint8_t type);
+
+/**
+ * Lexical errors of the last input (stray characters, invalid UTF-8,
+ *  unterminated literals and comments).
+ */
+SIMDLEX_API size_t simdlex_error_count(const SimdLex *ctx);
+SIMDLEX_API uint32_t simdlex_error_offset(const SimdLex *ctx, size_t index);
+SIMDLEX_API const char *simdlex_error_message(const SimdLex *ctx, size_t index);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //SIMDLEX_H
@@ -0,0 +1,62 @@
+#!/bin/bash
+
+# Compare the output of simd_lexer with the expected outputs in data/golden.
+# <input>.<mode>.out holds the output of "simd_lexer --<mode> <input>", or of
+# "simd_lexer <input>" for the tokens mode. Modes joined with + pass several
+# flags. Inputs are looked up in data/golden, then in data/. Arguments that
+# do not fit a file name, like "--only <types>" or "search <pattern>", are
+# read from <input>.<mode>.args instead, one per line, before the input.
+#
+# --pack on files of both dialects is compared with the files lexed one by one.
+#
+# Usage: golden.sh <simd_lexer> <data dir>
+
+SIMD_LEXER=$(realpath "$1")
+DATA_DIR=$(realpath "$2")
+FAILED=0
+
+for EXPECTED in "$DATA_DIR"/golden/*.out; do
+    NAME=$(basename "$EXPECTED" .out)
+    MODE=${NAME##*.}
+    INPUT=${NAME%.*}
+
+    INPUT_DIR="$DATA_DIR/golden"
+    if [[ ! -f "$INPUT_DIR/$INPUT" ]]; then
+        INPUT_DIR="$DATA_DIR"
+    fi
+
+    ARGS=()
+    if [[ -f "${EXPECTED%.out}.args" ]]; then
+        mapfile -t ARGS < "${EXPECTED%.out}.args"
+    elif [[ "$MODE" != tokens ]]; then
+        IFS=+ read -ra FLAGS <<< "$MODE"
+        ARGS=("${FLAGS[@]/#/--}")
+    fi
+
+    # Run next to the input so that file names in the output do not depend on the checkout
+    if ! diff <(cd "$INPUT_DIR" && "$SIMD_LEXER" "${ARGS[@]}" "$INPUT" 2>&1) "$EXPECTED" > /dev/null; then
+        echo "FAILED: $NAME"
+        diff <(cd "$INPUT_DIR" && "$SIMD_LEXER" "${ARGS[@]}" "$INPUT" 2>&1) "$EXPECTED"
+        FAILED=1
+    fi
+done
+
+# C and C++ files interleaved, so that each dialect's pack has several files
+PACKED=(hello_world.c cpp_features.cpp numeric_literals.c raw_in_comments.cpp)
+
+lex_one_by_one() {
+    for INPUT in "$@"; do
+        echo "$INPUT:"
+        "$SIMD_LEXER" "$INPUT" 2>&1
+    done
+}
+
+cd "$DATA_DIR" || exit 1
+
+if ! diff <("$SIMD_LEXER" --pack "${PACKED[@]}" 2>&1) <(lex_one_by_one "${PACKED[@]}") > /dev/null; then
+    echo "FAILED: --pack ${PACKED[*]}"
+    diff <("$SIMD_LEXER" --pack "${PACKED[@]}" 2>&1) <(lex_one_by_one "${PACKED[@]}")
+    FAILED=1
+fi
+
+exit $FAILED
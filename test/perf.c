@@ -0,0 +1,587 @@
+#include <dirent.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <x86intrin.h>
+
+#include "lexer.h"
+#include "pipeline.h"
+#include "tune.h"
+
+#define CORPUS_SIZE (4L << 20)
+#define MAX_CORPORA 8
+#define STREAM_CORPORA 4        // Corpora lexed together by lex_streams
+#define MACHINE_KEY_SIZE 256
+#define PERF_SKIPPED 77         // No baseline for this machine, CTest reports the test as skipped
+
+#if defined(__clang__)
+#define COMPILER_NAME "clang " __clang_version__
+#elif defined(__GNUC__)
+#define COMPILER_NAME "gcc " __VERSION__
+#else
+#define COMPILER_NAME "unknown"
+#endif
+
+typedef struct Corpus Corpus;
+struct Corpus {
+    const char *name;
+    LexDialect dialect;
+    char *text;
+    long size;
+};
+
+typedef struct Result Result;
+struct Result {
+    double gb_per_s;
+    double cycles_per_byte;
+};
+
+typedef struct Buffer Buffer;
+struct Buffer {
+    char *data;
+    long size;
+    long capacity;
+};
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15ull;
+
+// xorshift64*, fixed seed so corpora are the same on every run
+static uint32_t next_random(void) {
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+
+    return (rng_state * 0x2545F4914F6CDD1Dull) >> 32;
+}
+
+static const char *pick(const char *const *words, int count) {
+    return words[next_random() % count];
+}
+
+#define PICK(words) pick(words, sizeof(words) / sizeof(words[0]))
+
+static void append(Buffer *buffer, const char *format, ...) {
+    va_list args;
+
+    while (true) {
+        va_start(args, format);
+        const int len = vsnprintf(buffer->data + buffer->size, buffer->capacity - buffer->size, format, args);
+        va_end(args);
+
+        if (buffer->size + len < buffer->capacity) {
+            buffer->size += len;
+            return;
+        }
+
+        buffer->capacity = buffer->capacity ? buffer->capacity * 2 : 1 << 20;
+        buffer->data = realloc(buffer->data, buffer->capacity);
+
+        if (buffer->data == NULL) {
+            fprintf(stderr, "Memory allocation failure.\n");
+            exit(1);
+        }
+    }
+}
+
+static const char *const identifiers[] = {
+    "dev", "ret", "flags", "len", "buf", "priv", "skb", "page", "inode", "node", "entry", "count", "offset",
+    "base", "mask", "irq", "lock", "queue", "ctx", "state", "next", "prev", "head", "data", "size", "index"
+};
+
+static const char *const functions[] = {
+    "spin_lock_irqsave", "spin_unlock_irqrestore", "kfree", "kmalloc", "memcpy", "memset", "readl", "writel",
+    "list_add_tail", "list_del", "mutex_lock", "mutex_unlock", "atomic_inc", "wake_up", "dev_err", "pr_debug"
+};
+
+static const char *const types[] = {
+    "int", "unsigned long", "struct device *", "u32", "size_t", "const char *", "struct list_head *", "bool"
+};
+
+static const char *const operators[] = {
+    "+", "-", "*", "&", "|", "^", "<<", ">>", "&&", "||", "==", "!=", "<", ">=", "%"
+};
+
+static const char *const words[] = {
+    "the", "buffer", "is", "released", "when", "queue", "empty", "lock", "must", "be", "held", "by", "caller",
+    "returns", "zero", "on", "success", "or", "a", "negative", "error", "code", "see", "below", "for", "details"
+};
+
+static void append_expression(Buffer *buffer, int depth) {
+    if (depth == 0 || next_random() % 3 == 0) {
+        if (next_random() % 4 == 0) {
+            append(buffer, "0x%x", next_random() % 4096);
+        } else {
+            append(buffer, "%s->%s", PICK(identifiers), PICK(identifiers));
+        }
+
+        return;
+    }
+
+    append(buffer, "(");
+    append_expression(buffer, depth - 1);
+    append(buffer, " %s ", PICK(operators));
+    append_expression(buffer, depth - 1);
+    append(buffer, ")");
+}
+
+static void append_comment(Buffer *buffer, int words_count) {
+    for (int i = 0; i < words_count; ++i) {
+        append(buffer, i % 10 == 9 ? "\n * %s" : " %s", PICK(words));
+    }
+}
+
+// Functions with control flow, member accesses and calls
+static void kernel_style(Buffer *buffer) {
+    for (int f = 0; buffer->size < CORPUS_SIZE; ++f) {
+        append(buffer, "static int %s_%s_%d(%s%s, %s %s)\n{\n",
+               PICK(identifiers), PICK(identifiers), f, PICK(types), PICK(identifiers), PICK(types), PICK(identifiers));
+        append(buffer, "\tint ret = 0;\n\tunsigned long i;\n\n");
+
+        for (int s = next_random() % 8 + 2; s > 0; --s) {
+            switch (next_random() % 4) {
+                case 0:
+                    append(buffer, "\tif (");
+                    append_expression(buffer, 2);
+                    append(buffer, ") {\n\t\t%s(&%s->%s);\n\t\treturn -EINVAL;\n\t}\n", PICK(functions),
+                           PICK(identifiers), PICK(identifiers));
+                    break;
+                case 1:
+                    append(buffer, "\tfor (i = 0; i < %s->%s; i++)\n\t\tret |= ", PICK(identifiers), PICK(identifiers));
+                    append_expression(buffer, 3);
+                    append(buffer, ";\n");
+                    break;
+                case 2:
+                    append(buffer, "\t%s(%s, %s, sizeof(*%s));\n", PICK(functions), PICK(identifiers),
+                           PICK(identifiers), PICK(identifiers));
+                    break;
+                default:
+                    append(buffer, "\t%s->%s = ", PICK(identifiers), PICK(identifiers));
+                    append_expression(buffer, 2);
+                    append(buffer, ";\n");
+            }
+        }
+
+        append(buffer, "\treturn ret;\n}\n\n");
+    }
+}
+
+// Function-like macros with line splices, token pasting and conditionals
+static void macro_heavy(Buffer *buffer) {
+    for (int m = 0; buffer->size < CORPUS_SIZE; ++m) {
+        append(buffer, "#if defined(CONFIG_%s_%d) && CONFIG_%s > %u\n", PICK(identifiers), m, PICK(identifiers),
+               next_random() % 16);
+        append(buffer, "#define %s_%d(x, y) \\\n\tdo { \\\n", PICK(functions), m);
+
+        for (int s = next_random() % 4 + 1; s > 0; --s) {
+            append(buffer, "\t\t(x)->%s##_%s = (y) %s ", PICK(identifiers), PICK(identifiers), PICK(operators));
+            append_expression(buffer, 1);
+            append(buffer, "; \\\n");
+        }
+
+        append(buffer, "\t} while (0)\n#else\n#define %s_%d(x, y) ((void) #x)\n#endif\n\n", PICK(functions), m);
+    }
+}
+
+// Mostly block and line comments around short declarations
+static void comment_heavy(Buffer *buffer) {
+    for (int c = 0; buffer->size < CORPUS_SIZE; ++c) {
+        append(buffer, "/**\n *");
+        append_comment(buffer, next_random() % 60 + 10);
+        append(buffer, "\n */\n%s %s_%d; // %s %s %s\n", PICK(types), PICK(identifiers), c, PICK(words),
+               PICK(words), PICK(words));
+
+        if (next_random() % 2) {
+            append(buffer, "/*");
+            append_comment(buffer, next_random() % 20 + 1);
+            append(buffer, " */\n");
+        }
+    }
+}
+
+// Format strings, escapes and character literals
+static void string_heavy(Buffer *buffer) {
+    for (int s = 0; buffer->size < CORPUS_SIZE; ++s) {
+        append(buffer, "\tdev_err(%s, \"%s %s: %%d \\\"%s\\\" %s\\n\", %s);\n", PICK(identifiers), PICK(words),
+               PICK(words), PICK(words), PICK(words), PICK(identifiers));
+        append(buffer, "\tstatic const char %s_%d[] = u8\"%s %s\\t%s\" \"%s\";\n", PICK(identifiers), s, PICK(words),
+               PICK(words), PICK(words), PICK(words));
+        append(buffer, "\tif (c == '\\\\' || c == '\\'' || c == '%c')\n\t\treturn L\"%s\";\n",
+               'a' + next_random() % 26, PICK(words));
+    }
+}
+
+// Every file of a directory with the given extension, repeated to the corpus size
+static void real_sources(Buffer *buffer, const char *dir_path, const char *extension) {
+    DIR *dir = opendir(dir_path);
+
+    if (dir == NULL)
+        return;
+
+    Buffer sources = {0};
+
+    for (struct dirent *entry; (entry = readdir(dir)) != NULL;) {
+        const char *ext = strrchr(entry->d_name, '.');
+        if (ext == NULL || strcmp(ext, extension) != 0)
+            continue;
+
+        char path[4096];
+        snprintf(path, sizeof(path), "%s/%s", dir_path, entry->d_name);
+
+        long file_size;
+        char *content = read_file(path, &file_size, VECTOR_SIZE, NULL);
+
+        if (content != NULL) {
+            append(&sources, "%s\n", content);
+            free(content);
+        }
+    }
+
+    closedir(dir);
+
+    while (sources.size && buffer->size < CORPUS_SIZE) {
+        append(buffer, "%s", sources.data);
+    }
+
+    free(sources.data);
+}
+
+static void add_corpus(Corpus *corpora, int *count, const char *name, LexDialect dialect, Buffer *buffer) {
+    if (buffer->size == 0)
+        return;
+
+    corpora[*count] = (Corpus) { name, dialect, buffer->data, buffer->size };
+    ++*count;
+}
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Stand-in for a parser on the consumer thread
+static void count_batch(const TokenBatch *batch, const char *src, void *user) {
+    *(uint64_t *) user += batch->size;
+}
+
+// Best of repeat runs of lex, or of lex_pipelined with a consumer thread, on a fresh padded copy
+static Result measure(const Corpus *corpus, bool pipelined, int repeat) {
+    const long padded = (corpus->size + 1 + VECTOR_SIZE - 1) / VECTOR_SIZE * VECTOR_SIZE + VECTOR_SIZE;
+    char *input;
+
+    if (posix_memalign((void **) &input, VECTOR_SIZE, padded)) {
+        fprintf(stderr, "Memory allocation failure.\n");
+        exit(1);
+    }
+
+    LexOptions options = {0};
+    options.dialect = corpus->dialect;
+
+    double best_ns = 0;
+    uint64_t best_cycles = 0;
+
+    for (int r = 0; r < repeat; ++r) {
+        memcpy(input, corpus->text, corpus->size);
+        memset(input + corpus->size, 0, padded - corpus->size);
+
+        const double start_ns = now_ns();
+        const uint64_t start_cycles = __rdtsc();
+
+        if (pipelined) {
+            uint64_t count = 0;
+            lex_pipelined(input, corpus->size, &options, count_batch, &count);
+        } else {
+            free_token_array(lex(input, corpus->size, &options));
+        }
+
+        const uint64_t cycles = __rdtsc() - start_cycles;
+        const double ns = now_ns() - start_ns;
+
+        if (r == 0 || ns < best_ns) {
+            best_ns = ns;
+            best_cycles = cycles;
+        }
+    }
+
+    free(input);
+
+    return (Result) { corpus->size / best_ns, (double) best_cycles / corpus->size };
+}
+
+// Best of repeat runs of lex_streams on the first count corpora at once
+static Result measure_streams(const Corpus *corpora, int count, int repeat) {
+    char *inputs[STREAM_CORPORA];
+    long sizes[STREAM_CORPORA];
+    long padded[STREAM_CORPORA];
+    long total_size = 0;
+
+    for (int s = 0; s < count; ++s) {
+        sizes[s] = corpora[s].size;
+        padded[s] = (corpora[s].size + 1 + VECTOR_SIZE - 1) / VECTOR_SIZE * VECTOR_SIZE + VECTOR_SIZE;
+        total_size += corpora[s].size;
+
+        if (posix_memalign((void **) &inputs[s], VECTOR_SIZE, padded[s])) {
+            fprintf(stderr, "Memory allocation failure.\n");
+            exit(1);
+        }
+    }
+
+    LexOptions options = {0};
+    options.dialect = corpora[0].dialect;
+
+    double best_ns = 0;
+    uint64_t best_cycles = 0;
+
+    for (int r = 0; r < repeat; ++r) {
+        for (int s = 0; s < count; ++s) {
+            memcpy(inputs[s], corpora[s].text, corpora[s].size);
+            memset(inputs[s] + corpora[s].size, 0, padded[s] - corpora[s].size);
+        }
+
+        TokenArray tokens[STREAM_CORPORA];
+
+        const double start_ns = now_ns();
+        const uint64_t start_cycles = __rdtsc();
+
+        lex_streams(inputs, sizes, count, &options, tokens);
+
+        const uint64_t cycles = __rdtsc() - start_cycles;
+        const double ns = now_ns() - start_ns;
+
+        for (int s = 0; s < count; ++s) {
+            free_token_array(tokens[s]);
+        }
+
+        if (r == 0 || ns < best_ns) {
+            best_ns = ns;
+            best_cycles = cycles;
+        }
+    }
+
+    for (int s = 0; s < count; ++s) {
+        free(inputs[s]);
+    }
+
+    return (Result) { total_size / best_ns, (double) best_cycles / total_size };
+}
+
+// Timings only compare on the same CPU model built by the same compiler
+static void machine_key(char key[MACHINE_KEY_SIZE]) {
+    char cpu[CPU_NAME_SIZE];
+    cpu_name(cpu);
+
+    snprintf(key, MACHINE_KEY_SIZE, "%s | %s", cpu, COMPILER_NAME);
+}
+
+// Whether a line starts the rows of a machine, and of which one
+static bool machine_line(const char *line, const char *key, bool *matches) {
+    if (strncmp(line, "machine ", 8) != 0)
+        return false;
+
+    const char *name = line + 8;
+    const size_t length = strcspn(name, "\n");
+    *matches = length == strlen(key) && strncmp(name, key, length) == 0;
+
+    return true;
+}
+
+static bool find_baseline(FILE *file, const char *key, const char *name, Result *baseline) {
+    char line[512];
+    char entry[64];
+    bool in_machine = false;
+
+    rewind(file);
+
+    while (fgets(line, sizeof(line), file)) {
+        if (line[0] == '#' || machine_line(line, key, &in_machine))
+            continue;
+
+        if (in_machine && sscanf(line, "%63s %lf %lf", entry, &baseline->gb_per_s, &baseline->cycles_per_byte) == 3
+            && strcmp(entry, name) == 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Replace the rows of this machine, the rows of other machines are kept
+static bool write_baseline(const char *path, const char *key, const char **names, const Result *results, int rows) {
+    Buffer kept = {0};
+    FILE *file = fopen(path, "r");
+
+    if (file != NULL) {
+        char line[512];
+        bool in_machine = false;
+
+        while (fgets(line, sizeof(line), file)) {
+            const bool machine_start = machine_line(line, key, &in_machine);
+
+            // One blank line before each machine, as written below
+            if (in_machine || line[0] == '\n')
+                continue;
+
+            append(&kept, machine_start ? "\n%s" : "%s", line);
+        }
+
+        fclose(file);
+    }
+
+    file = fopen(path, "w");
+
+    if (file == NULL) {
+        fprintf(stderr, "Error opening file.\n");
+        free(kept.data);
+        return false;
+    }
+
+    if (kept.size == 0) {
+        fprintf(file, "# corpus GB/s cycles/byte, written by simd_lexer_perf\n");
+        fprintf(file, "# Rows follow the CPU and compiler that measured them, refresh with --update.\n");
+    } else {
+        fwrite(kept.data, 1, kept.size, file);
+    }
+
+    fprintf(file, "\nmachine %s\n", key);
+    for (int i = 0; i < rows; ++i) {
+        fprintf(file, "%s %.3f %.3f\n", names[i], results[i].gb_per_s, results[i].cycles_per_byte);
+    }
+
+    fclose(file);
+    free(kept.data);
+
+    return true;
+}
+
+int main(int argc, char **argv) {
+    const char *baseline_path = NULL;
+    const char *data_dir = "data";
+    double tolerance = 0.15;
+    int repeat = 20;
+    bool update = false;
+
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) {
+            baseline_path = argv[++i];
+        } else if (strcmp(argv[i], "--data") == 0 && i + 1 < argc) {
+            data_dir = argv[++i];
+        } else if (strcmp(argv[i], "--tolerance") == 0 && i + 1 < argc) {
+            tolerance = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--repeat") == 0 && i + 1 < argc) {
+            repeat = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--update") == 0) {
+            update = true;
+        } else {
+            fprintf(stderr, "Usage: simd_lexer_perf [--baseline <file>] [--update] [--tolerance <fraction>] "
+                            "[--data <dir>] [--repeat <runs>]\n");
+            return 2;
+        }
+    }
+
+    Buffer buffers[MAX_CORPORA] = {0};
+    Corpus corpora[MAX_CORPORA];
+    int count = 0;
+
+    kernel_style(&buffers[0]);
+    add_corpus(corpora, &count, "kernel", LEX_DIALECT_C, &buffers[0]);
+    macro_heavy(&buffers[1]);
+    add_corpus(corpora, &count, "macro", LEX_DIALECT_C, &buffers[1]);
+    comment_heavy(&buffers[2]);
+    add_corpus(corpora, &count, "comment", LEX_DIALECT_C, &buffers[2]);
+    string_heavy(&buffers[3]);
+    add_corpus(corpora, &count, "string", LEX_DIALECT_C, &buffers[3]);
+    real_sources(&buffers[4], data_dir, ".c");
+    add_corpus(corpora, &count, "real_c", LEX_DIALECT_C, &buffers[4]);
+    real_sources(&buffers[5], data_dir, ".cpp");
+    add_corpus(corpora, &count, "real_cpp", LEX_DIALECT_CPP, &buffers[5]);
+
+    // Rows after the corpora: the four generated C corpora lexed together by lex_streams, and the
+    // kernel corpus lexed with a consumer thread
+    const int streams = count < STREAM_CORPORA ? count : STREAM_CORPORA;
+    const int rows = count + 2;
+    const char *names[MAX_CORPORA + 2];
+
+    for (int i = 0; i < count; ++i) {
+        names[i] = corpora[i].name;
+    }
+
+    names[count] = "streams";
+    names[count + 1] = "pipeline";
+
+    char key[MACHINE_KEY_SIZE];
+    machine_key(key);
+
+    FILE *baseline_file = NULL;
+    if (baseline_path != NULL && !update) {
+        baseline_file = fopen(baseline_path, "r");
+    }
+
+    if (update && baseline_path == NULL) {
+        fprintf(stderr, "--update needs --baseline.\n");
+        return 2;
+    }
+
+    // Rows are only written with --update, a machine without rows is skipped
+    Result baseline;
+    const bool has_baseline = baseline_file != NULL && find_baseline(baseline_file, key, names[0], &baseline);
+
+    if (baseline_path != NULL && !update && !has_baseline) {
+        fprintf(stderr, "SKIPPED: no baseline for %s in %s, record one with --update.\n", key, baseline_path);
+
+        if (baseline_file != NULL)
+            fclose(baseline_file);
+
+        return PERF_SKIPPED;
+    }
+
+    Result results[MAX_CORPORA + 2];
+    int regressions = 0;
+
+    // Measure the kernels the lexer binds on this CPU
+    tune_kernels(NULL);
+    printf("Kernels: %s\n", tuned_kernel_names());
+
+    printf("%-10s %8s %10s %8s %10s\n", "corpus", "GB/s", "cycles/B", "base", "base c/B");
+
+    for (int i = 0; i < rows; ++i) {
+        if (i < count) {
+            results[i] = measure(&corpora[i], false, repeat);
+        } else if (i == count) {
+            results[i] = measure_streams(corpora, streams, repeat);
+        } else {
+            results[i] = measure(&corpora[0], true, repeat);
+        }
+
+        printf("%-10s %8.3f %10.3f", names[i], results[i].gb_per_s, results[i].cycles_per_byte);
+
+        if (has_baseline && find_baseline(baseline_file, key, names[i], &baseline)) {
+            const bool slower = results[i].gb_per_s < baseline.gb_per_s * (1 - tolerance)
+                                || results[i].cycles_per_byte > baseline.cycles_per_byte * (1 + tolerance);
+
+            printf(" %8.3f %10.3f%s", baseline.gb_per_s, baseline.cycles_per_byte, slower ? "  REGRESSION" : "");
+            regressions += slower;
+        }
+
+        printf("\n");
+    }
+
+    if (baseline_file != NULL)
+        fclose(baseline_file);
+
+    if (update && !write_baseline(baseline_path, key, names, results, rows))
+        return 2;
+
+    for (int i = 0; i < MAX_CORPORA; ++i) {
+        free(buffers[i].data);
+    }
+
+    if (regressions) {
+        fprintf(stderr, "%d corpora slower than the baseline by more than %.0f%%.\n", regressions, tolerance * 100);
+        return 1;
+    }
+
+    return 0;
+}
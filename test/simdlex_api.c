@@ -0,0 +1,153 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "simdlex.h"
+
+typedef struct Expected Expected;
+struct Expected {
+    uint8_t type;
+    const char *name;
+    const char *text;
+};
+
+// Public codes are part of the ABI: these must never change
+static int check_codes(void) {
+    static const struct {
+        uint8_t type;
+        uint8_t code;
+    } pinned[] = {
+        {SIMDLEX_TOKEN_EOF, 0},
+        {SIMDLEX_TOKEN_IDENT, 1},
+        {SIMDLEX_TOKEN_NUM, 2},
+        {SIMDLEX_TOKEN_L_PAREN, 3},
+        {SIMDLEX_TOKEN_SEMI, 10},
+        {SIMDLEX_TOKEN_AMP_AMP, 27},
+        {SIMDLEX_TOKEN_INT, 70},
+        {SIMDLEX_TOKEN_RETURN, 74},
+        {SIMDLEX_TOKEN_NAMESPACE, 122},
+        {SIMDLEX_TOKEN_STR_LIT, 146},
+    };
+
+    int failed = 0;
+
+    for (int i = 0; i < (int) (sizeof(pinned) / sizeof(pinned[0])); ++i) {
+        if (pinned[i].type != pinned[i].code) {
+            fprintf(stderr, "FAILED: token code %d moved to %d\n", pinned[i].code, pinned[i].type);
+            ++failed;
+        }
+    }
+
+    if (simdlex_token_name(SIMDLEX_TOKEN_COUNT) != NULL) {
+        fprintf(stderr, "FAILED: SIMDLEX_TOKEN_COUNT has a name\n");
+        ++failed;
+    }
+
+    return failed;
+}
+
+static int check_tokens(SimdLexDialect dialect, const char *input, const Expected *expected, size_t count) {
+    SimdLex *ctx = simdlex_create(dialect);
+
+    if (ctx == NULL || simdlex_lex(ctx, input, strlen(input)) != 0) {
+        fprintf(stderr, "FAILED: cannot lex \"%s\"\n", input);
+        simdlex_free(ctx);
+        return 1;
+    }
+
+    int failed = 0;
+
+    if (simdlex_token_count(ctx) != count) {
+        fprintf(stderr, "FAILED: %zu tokens instead of %zu in \"%s\"\n", simdlex_token_count(ctx), count, input);
+        failed = 1;
+    }
+
+    for (size_t i = 0; i < count && i < simdlex_token_count(ctx); ++i) {
+        const uint8_t type = simdlex_token_type(ctx, i);
+        const char *name = simdlex_token_name(type);
+
+        size_t length;
+        const char *text = simdlex_token_text(ctx, i, &length);
+
+        if (type != expected[i].type || simdlex_token_types(ctx)[i] != type || name == NULL
+            || strcmp(name, expected[i].name) != 0 || length != strlen(expected[i].text)
+            || memcmp(text, expected[i].text, length) != 0) {
+            fprintf(stderr, "FAILED: token %zu of \"%s\" is %d %s \"%.*s\" instead of %d %s \"%s\"\n", i, input,
+                    type, name ? name : "(null)", (int) length, text, expected[i].type, expected[i].name,
+                    expected[i].text);
+            failed = 1;
+        }
+    }
+
+    simdlex_free(ctx);
+
+    return failed;
+}
+
+// Inputs whose offsets do not fit in 32 bits are rejected before being read
+static int check_size_limit(void) {
+    SimdLex *ctx = simdlex_create(SIMDLEX_DIALECT_C);
+    const char input[] = "int x;";
+    int failed = 0;
+
+    if (ctx == NULL)
+        return 1;
+
+    if (simdlex_lex(ctx, input, SIMDLEX_MAX_INPUT_SIZE + 1) != -1 || simdlex_lex(ctx, input, SIZE_MAX) != -1) {
+        fprintf(stderr, "FAILED: input larger than SIMDLEX_MAX_INPUT_SIZE accepted\n");
+        failed = 1;
+    }
+
+    if (simdlex_token_count(ctx) != 0) {
+        fprintf(stderr, "FAILED: rejected input left tokens\n");
+        failed = 1;
+    }
+
+    // The context is still usable
+    if (simdlex_lex(ctx, input, sizeof(input) - 1) != 0 || simdlex_token_count(ctx) != 4) {
+        fprintf(stderr, "FAILED: cannot lex after a rejected input\n");
+        failed = 1;
+    }
+
+    simdlex_free(ctx);
+
+    return failed;
+}
+
+int main(void) {
+    int failed = check_codes();
+    failed += check_size_limit();
+
+    static const Expected c_tokens[] = {
+        {SIMDLEX_TOKEN_INT, "int", "int"},
+        {SIMDLEX_TOKEN_IDENT, "identifier", "f"},
+        {SIMDLEX_TOKEN_L_PAREN, "l_paren", "("},
+        {SIMDLEX_TOKEN_R_PAREN, "r_paren", ")"},
+        {SIMDLEX_TOKEN_L_BRACE, "l_brace", "{"},
+        {SIMDLEX_TOKEN_RETURN, "return", "return"},
+        {SIMDLEX_TOKEN_IDENT, "identifier", "x"},
+        {SIMDLEX_TOKEN_AMP_AMP, "ampamp", "&&"},
+        {SIMDLEX_TOKEN_NUM, "numeric_constant", "0x1"},
+        {SIMDLEX_TOKEN_SEMI, "semi", ";"},
+        {SIMDLEX_TOKEN_R_BRACE, "r_brace", "}"},
+        {SIMDLEX_TOKEN_EOF, "eof", ""},
+    };
+    failed += check_tokens(SIMDLEX_DIALECT_C, "int f() { return x && 0x1; } // and\n", c_tokens,
+                           sizeof(c_tokens) / sizeof(c_tokens[0]));
+
+    // Alternative tokens have the type of their punctuator
+    static const Expected cpp_tokens[] = {
+        {SIMDLEX_TOKEN_NAMESPACE, "namespace", "namespace"},
+        {SIMDLEX_TOKEN_IDENT, "identifier", "n"},
+        {SIMDLEX_TOKEN_L_BRACE, "l_brace", "{"},
+        {SIMDLEX_TOKEN_IDENT, "identifier", "a"},
+        {SIMDLEX_TOKEN_AMP_AMP, "ampamp", "&&"},
+        {SIMDLEX_TOKEN_STR_LIT, "string_literal", "\"s\""},
+        {SIMDLEX_TOKEN_R_BRACE, "r_brace", "}"},
+        {SIMDLEX_TOKEN_EOF, "eof", ""},
+    };
+    failed += check_tokens(SIMDLEX_DIALECT_CPP, "namespace n { a and \"s\" }\n", cpp_tokens,
+                           sizeof(cpp_tokens) / sizeof(cpp_tokens[0]));
+
+    return failed != 0;
+}
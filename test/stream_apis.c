@@ -0,0 +1,236 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lexer.h"
+#include "pipeline.h"
+
+#define MAX_PADDING 64
+#define MAX_TOKENS 1024
+#define RING_PREFIX (24 * VECTOR_SIZE + 29)  // Semicolons putting the cases on the last vector of a ring batch
+
+typedef struct Case Case;
+struct Case {
+    const char *text;
+    LexDialect dialect;
+};
+
+// Identifiers, keywords and literals that end near a vector boundary once shifted by the padding
+static const Case cases[] = {
+    {"int\xe2\x82\xac x;\n", LEX_DIALECT_C},
+    {"while (x) return y; // int\n", LEX_DIALECT_C},
+    {"unsigned\\\nlong z; static_assert\xc3\xa9;\n", LEX_DIALECT_C},
+    {"char *s = \"int\"; char c = 'x'; double d = 1'0e-5; sizeof d;\n", LEX_DIALECT_C},
+    {"/* int */ float f; _Bool b; typedef_name t;\n", LEX_DIALECT_C},
+    {"constexpr auto r = R\"(int)\"; int y; namespace n {}\n", LEX_DIALECT_CPP},
+};
+
+typedef struct Collected Collected;
+struct Collected {
+    TokenType types[MAX_TOKENS];
+    uint32_t locs[MAX_TOKENS];
+    int size;
+};
+
+static void collect(const TokenType *types, const uint32_t *locs, int count, void *user) {
+    Collected *collected = user;
+
+    for (int i = 0; i < count && collected->size < MAX_TOKENS; ++i) {
+        collected->types[collected->size] = types[i];
+        collected->locs[collected->size] = locs[i];
+        ++collected->size;
+    }
+}
+
+// Input padded like read_file does, every API modifies its own copy
+static char *padded_input(const char *text, int padding, long *size) {
+    *size = padding + (long) strlen(text);
+
+    const long capacity = (*size + 1 + VECTOR_SIZE - 1) / VECTOR_SIZE * VECTOR_SIZE + VECTOR_SIZE;
+    char *input = aligned_alloc(VECTOR_SIZE, capacity);
+
+    if (input == NULL) {
+        fprintf(stderr, "Memory allocation failure.\n");
+        exit(1);
+    }
+
+    memset(input, 0, capacity);
+    memset(input, ' ', padding);
+    memcpy(input + padding, text, strlen(text));
+
+    return input;
+}
+
+static void collect_batch(const TokenBatch *batch, const char *src, void *user) {
+    (void) src;
+    collect(batch->types, batch->locs, (int) batch->size, user);
+}
+
+static bool same_tokens(const Collected *expected, const Collected *actual) {
+    return expected->size == actual->size
+           && memcmp(expected->types, actual->types, expected->size * sizeof(TokenType)) == 0
+           && memcmp(expected->locs, actual->locs, expected->size * sizeof(uint32_t)) == 0;
+}
+
+static Collected with_lex(const char *text, int padding, const LexOptions *options) {
+    long size;
+    char *input = padded_input(text, padding, &size);
+
+    Collected collected = {0};
+    TokenArray tokens = lex(input, size, options);
+    collect(tokens.token_types, tokens.token_locs, (int) tokens.size, &collected);
+
+    free_token_array(tokens);
+    free(input);
+
+    return collected;
+}
+
+static Collected with_callback(const char *text, int padding, const LexOptions *options) {
+    long size;
+    char *input = padded_input(text, padding, &size);
+
+    Collected collected = {0};
+    lex_with_callback(input, size, options, collect, &collected);
+
+    free(input);
+
+    return collected;
+}
+
+static Collected with_iterator(const char *text, int padding, const LexOptions *options, int batch) {
+    long size;
+    char *input = padded_input(text, padding, &size);
+
+    Collected collected = {0};
+    LexIterator *it = aligned_alloc(VECTOR_SIZE, sizeof(LexIterator));    // Holds vectors
+    TokenType types[MAX_TOKENS];
+    uint32_t locs[MAX_TOKENS];
+
+    lex_iterator_init(it, input, size, options);
+
+    for (int count; (count = lex_next_batch(it, types, locs, batch)) > 0;) {
+        collect(types, locs, count, &collected);
+    }
+
+    free(it);
+    free(input);
+
+    return collected;
+}
+
+static Collected with_pipeline(const char *text, int padding, const LexOptions *options) {
+    long size;
+    char *input = padded_input(text, padding, &size);
+
+    Collected collected = {0};
+    lex_pipelined(input, size, options, collect_batch, &collected);
+
+    free(input);
+
+    return collected;
+}
+
+static int check(const char *api, const char *text, int padding, const Collected *expected,
+                 const Collected *actual) {
+    if (same_tokens(expected, actual))
+        return 0;
+
+    fprintf(stderr, "FAILED: %s differs from lex with %d spaces before \"%s\"\n", api, padding, text);
+
+    return 1;
+}
+
+// lex_streams on 2 to 4 inputs of different lengths, each against lex
+static int check_streams(LexDialect dialect, const TokenFilter *filter) {
+    const int case_count = (int) (sizeof(cases) / sizeof(cases[0]));
+    int failed = 0;
+
+    LexOptions options = {0};
+    options.dialect = dialect;
+    options.filter = filter;
+
+    for (int count = 2; count <= 4; ++count) {
+        for (int padding = 0; padding < MAX_PADDING; padding += 7) {
+            char *inputs[4];
+            long sizes[4];
+            const char *texts[4];
+            int paddings[4];
+            Collected expected[4];
+            TokenArray results[4];
+
+            for (int s = 0; s < count; ++s) {
+                texts[s] = cases[(padding + s) % case_count].text;
+                paddings[s] = padding + 13 * s;
+                expected[s] = with_lex(texts[s], paddings[s], &options);
+                inputs[s] = padded_input(texts[s], paddings[s], &sizes[s]);
+            }
+
+            lex_streams(inputs, sizes, count, &options, results);
+
+            for (int s = 0; s < count; ++s) {
+                Collected actual = {0};
+                collect(results[s].token_types, results[s].token_locs, (int) results[s].size, &actual);
+
+                failed += check("lex_streams", texts[s], paddings[s], &expected[s], &actual);
+
+                free_token_array(results[s]);
+                free(inputs[s]);
+            }
+        }
+    }
+
+    return failed;
+}
+
+int main(void) {
+    int failed = 0;
+
+    // Identifiers and keywords are filtered again once keywords are known
+    TokenFilter filter;
+    token_filter_clear(&filter);
+    token_filter_add_name(&filter, "identifier");
+    token_filter_add_name(&filter, "int");
+    token_filter_add_name(&filter, "semi");
+
+    for (int c = 0; c < (int) (sizeof(cases) / sizeof(cases[0])); ++c) {
+        // The case alone, then after enough tokens to fill a ring batch
+        char ring_text[RING_PREFIX + 128];
+        memset(ring_text, ';', RING_PREFIX);
+        strcpy(ring_text + RING_PREFIX, cases[c].text);
+
+        for (int filtered = 0; filtered < 2; ++filtered) {
+            LexOptions options = {0};
+            options.dialect = cases[c].dialect;
+            options.filter = filtered ? &filter : NULL;
+
+            for (int padding = 0; padding < MAX_PADDING; ++padding) {
+                const char *text = cases[c].text;
+
+                const Collected expected = with_lex(text, padding, &options);
+                const Collected callback = with_callback(text, padding, &options);
+                const Collected small = with_iterator(text, padding, &options, 3);
+                const Collected large = with_iterator(text, padding, &options, MAX_TOKENS);
+                const Collected pipeline = with_pipeline(text, padding, &options);
+
+                failed += check("lex_with_callback", text, padding, &expected, &callback);
+                failed += check("lex_next_batch by 3", text, padding, &expected, &small);
+                failed += check("lex_next_batch", text, padding, &expected, &large);
+                failed += check("lex_pipelined", text, padding, &expected, &pipeline);
+
+                const Collected ring_expected = with_lex(ring_text, padding, &options);
+                const Collected ring_pipeline = with_pipeline(ring_text, padding, &options);
+
+                failed += check("lex_pipelined after a batch of semicolons", text, padding, &ring_expected,
+                                &ring_pipeline);
+            }
+        }
+    }
+
+    for (int filtered = 0; filtered < 2; ++filtered) {
+        failed += check_streams(LEX_DIALECT_C, filtered ? &filter : NULL);
+        failed += check_streams(LEX_DIALECT_CPP, filtered ? &filter : NULL);
+    }
+
+    return failed != 0;
+}
@@ -1,8 +1,5 @@
 #!/bin/bash
 
-# Set the path to the C source file
-SOURCE_FILE="../data/hello_world.c"
-
 # Build the project using CMakeLists.txt
 cd ..
 mkdir -p cmake-build-test
@@ -10,26 +7,35 @@ cd cmake-build-test || exit 1;
 cmake ..
 make
 
-# Execute the built program and capture its output
-./simd_lexer "$SOURCE_FILE" \
-    | awk -F " " '{print $2}' \
-    > simd_lexer_output.txt
+# Run on every C and C++ source file in data/
+for SOURCE_FILE in ../data/*.c ../data/*.cpp; do
+    # Execute the built program and capture the token kinds with their layout flags
+    ./simd_lexer --flags "$SOURCE_FILE" \
+        | awk -F " " '{print $2, / \[StartOfLine\]( \[LeadingSpace\])?$/ ? "[StartOfLine]" : "", / \[LeadingSpace\]$/ ? "[LeadingSpace]" : ""}' \
+        > simd_lexer_output.txt
+
+    # Execute the clang command and capture its output, flags follow the quoted spelling
+    # C23 for digit separators
+    CLANG_STD="-std=c2x"
+    if [[ "$SOURCE_FILE" == *.cpp ]]; then
+        CLANG_STD="-std=c++20"
+    fi
 
-# Execute the clang command and capture its output
-clang -fsyntax-only -Xclang -dump-tokens "$SOURCE_FILE" 2>&1 \
-    | awk -F "'" '{print $1}' \
-    > clang_output.txt
+    clang $CLANG_STD -fsyntax-only -Xclang -dump-tokens "$SOURCE_FILE" 2>&1 \
+        | awk -F "'" '{print $1, $NF ~ /\[StartOfLine\]/ ? "[StartOfLine]" : "", $NF ~ /\[LeadingSpace\]/ ? "[LeadingSpace]" : ""}' \
+        > clang_output.txt
 
-echo Running on "$SOURCE_FILE":
+    echo Running on "$SOURCE_FILE":
 
-# Check if the outputs are equal
-if diff -w "simd_lexer_output.txt" "clang_output.txt" >/dev/null; then
-    # Outputs are equal, print PASSED in green
-    echo -e "\e[32mPASSED\e[0m"
-else
-    # Outputs are not equal, print FAILED in red
-    echo -e "\e[31mFAILED\e[0m"
+    # Check if the outputs are equal
+    if diff -w "simd_lexer_output.txt" "clang_output.txt" >/dev/null; then
+        # Outputs are equal, print PASSED in green
+        echo -e "\e[32mPASSED\e[0m"
+    else
+        # Outputs are not equal, print FAILED in red
+        echo -e "\e[31mFAILED\e[0m"
 
-    # Print differences with color highlighting
-    diff --color=always "simd_lexer_output.txt" "clang_output.txt"
-fi
+        # Print differences with color highlighting
+        diff --color=always "simd_lexer_output.txt" "clang_output.txt"
+    fi
+done
@@ -1,5 +1,6 @@
 #include "tokens.h"
 
+#include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -9,310 +10,20 @@ Token create_token(TokenType type, uint32_t loc) {
 }
 
 void token_to_string(char *dst, const Token token, const char *src) {
-    switch (token.type) {
-        // One byte punctuators
-        case TOK_L_PAREN:
-            strcpy(dst, "l_paren  (");
-            break;
-        case TOK_R_PAREN:
-            strcpy(dst, "r_paren  )");
-            break;
-        case TOK_L_SQUARE:
-            strcpy(dst, "l_square  [");
-            break;
-        case TOK_R_SQUARE:
-            strcpy(dst, "r_square  ]");
-            break;
-        case TOK_L_BRACE:
-            strcpy(dst, "l_brace  {");
-            break;
-        case TOK_R_BRACE:
-            strcpy(dst, "r_brace  }");
-            break;
-        case TOK_COMMA:
-            strcpy(dst, "comma  ,");
-            break;
-        case TOK_SEMI:
-            strcpy(dst, "semi  ;");
-            break;
-        case TOK_PLUS:
-            strcpy(dst, "plus  +");
-            break;
-        case TOK_MINUS:
-            strcpy(dst, "minus  -");
-            break;
-        case TOK_TILDE:
-            strcpy(dst, "tilde  ~");
-            break;
-        case TOK_PERCENT:
-            strcpy(dst, "percent  %");
-            break;
-        case TOK_LESS:
-            strcpy(dst, "less  <");
-            break;
-        case TOK_GREATER:
-            strcpy(dst, "greater  >");
-            break;
-        case TOK_QUESTION:
-            strcpy(dst, "question  ?");
-            break;
-        case TOK_EXCLAIM:
-            strcpy(dst, "exclaim  !");
-            break;
-        case TOK_STAR:
-            strcpy(dst, "star  *");
-            break;
-        case TOK_CARET:
-            strcpy(dst, "caret  ^");
-            break;
-        case TOK_AMP:
-            strcpy(dst, "amp  &");
-            break;
-        case TOK_EQUAL:
-            strcpy(dst, "equal  =");
-            break;
-        case TOK_PERIOD:
-            strcpy(dst, "period  .");
-            break;
-        case TOK_PIPE:
-            strcpy(dst, "pipe  |");
-            break;
-        case TOK_SLASH:
-            strcpy(dst, "slash  /");
-            break;
-        case TOK_COLON:
-            strcpy(dst, "colon  :");
-            break;
-
-        // Two byte punctuators
-        case TOK_AMP_AMP:
-            strcpy(dst, "ampamp  &&");
-            break;
-        case TOK_GREATER_EQUAL:
-            strcpy(dst, "greaterequal  >=");
-            break;
-        case TOK_LESS_EQUAL:
-            strcpy(dst, "lessequal  <=");
-            break;
-        case TOK_EQUAL_EQUAL:
-            strcpy(dst, "equalequal  ==");
-            break;
-        case TOK_EXCLAIM_EQUAL:
-            strcpy(dst, "exclaimequal  !=");
-            break;
-        case TOK_PIPE_PIPE:
-            strcpy(dst, "pipepipe  ||");
-            break;
-        case TOK_PLUS_EQUAL:
-            strcpy(dst, "plusequal  +=");
-            break;
-        case TOK_MINUS_EQUAL:
-            strcpy(dst, "minusequal  -=");
-            break;
-        case TOK_STAR_EQUAL:
-            strcpy(dst, "starequal  *=");
-            break;
-        case TOK_SLASH_EQUAL:
-            strcpy(dst, "slashequal  /=");
-            break;
-        case TOK_CARET_EQUAL:
-            strcpy(dst, "caretequal  ^=");
-            break;
-        case TOK_PIPE_EQUAL:
-            strcpy(dst, "pipeequal  |=");
-            break;
-        case TOK_PERCENT_EQUAL:
-            strcpy(dst, "percentequal  %=");
-            break;
-        case TOK_AMP_EQUAL:
-            strcpy(dst, "ampequal  &=");
-            break;
-        case TOK_PLUS_PLUS:
-            strcpy(dst, "plusplus  ++");
-            break;
-        case TOK_MINUS_MINUS:
-            strcpy(dst, "minusminus  --");
-            break;
-        case TOK_GREATER_GREATER:
-            strcpy(dst, "greatergreater  >>");
-            break;
-        case TOK_LESS_LESS:
-            strcpy(dst, "lessless  <<");
-            break;
-        case TOK_ARROW:
-            strcpy(dst, "arrow  ->");
-            break;
-
-        // Three byte punctuators
-        case TOK_ELLIPSIS:
-            strcpy(dst, "ellipsis  ...");
-            break;
-        case TOK_LESS_LESS_EQUAL:
-            strcpy(dst, "lesslessequal  <<=");
-            break;
-        case TOK_GREATER_GREATER_EQUAL:
-            strcpy(dst, "greatergreaterequal  >>=");
-            break;
-
-        // Keywords
-        case TOK_AUTO:
-            strcpy(dst, "auto  auto");
-            break;
-        case TOK_BREAK:
-            strcpy(dst, "break  break");
-            break;
-        case TOK_CASE:
-            strcpy(dst, "case  case");
-            break;
-        case TOK_CHAR:
-            strcpy(dst, "char  char");
-            break;
-        case TOK_CONST:
-            strcpy(dst, "const  const");
-            break;
-        case TOK_CONTINUE:
-            strcpy(dst, "continue  continue");
-            break;
-        case TOK_DEFAULT:
-            strcpy(dst, "default  default");
-            break;
-        case TOK_DO:
-            strcpy(dst, "do  do");
-            break;
-        case TOK_DOUBLE:
-            strcpy(dst, "double  double");
-            break;
-        case TOK_ELSE:
-            strcpy(dst, "else  else");
-            break;
-        case TOK_ENUM:
-            strcpy(dst, "enum  enum");
-            break;
-        case TOK_EXTERN:
-            strcpy(dst, "extern  extern");
-            break;
-        case TOK_FLOAT:
-            strcpy(dst, "float  float");
-            break;
-        case TOK_FOR:
-            strcpy(dst, "for  for");
-            break;
-        case TOK_GOTO:
-            strcpy(dst, "goto  goto");
-            break;
-        case TOK_IF:
-            strcpy(dst, "if  if");
-            break;
-        case TOK_INLINE:
-            strcpy(dst, "inline  inline");
-            break;
-        case TOK_INT:
-            strcpy(dst, "int  int");
-            break;
-        case TOK_LONG:
-            strcpy(dst, "long  long");
-            break;
-        case TOK_REGISTER:
-            strcpy(dst, "register  register");
-            break;
-        case TOK_RESTRICT:
-            strcpy(dst, "restrict  restrict");
-            break;
-        case TOK_RETURN:
-            strcpy(dst, "return  return");
-            break;
-        case TOK_SHORT:
-            strcpy(dst, "short  short");
-            break;
-        case TOK_SIGNED:
-            strcpy(dst, "signed  signed");
-            break;
-        case TOK_SIZEOF:
-            strcpy(dst, "sizeof  sizeof");
-            break;
-        case TOK_STATIC:
-            strcpy(dst, "static  static");
-            break;
-        case TOK_STRUCT:
-            strcpy(dst, "struct  struct");
-            break;
-        case TOK_SWITCH:
-            strcpy(dst, "switch  switch");
-            break;
-        case TOK_TYPEDEF:
-            strcpy(dst, "typedef  typedef");
-            break;
-        case TOK_UNION:
-            strcpy(dst, "union  union");
-            break;
-        case TOK_UNSIGNED:
-            strcpy(dst, "unsigned  unsigned");
-            break;
-        case TOK_VOID:
-            strcpy(dst, "void  void");
-            break;
-        case TOK_VOLATILE:
-            strcpy(dst, "volatile  volatile");
-            break;
-        case TOK_WHILE:
-            strcpy(dst, "while  while");
-            break;
-        case TOK__ALIGNAS:
-            strcpy(dst, "_Alignas  _Alignas");
-            break;
-        case TOK__ALIGNOF:
-            strcpy(dst, "_Alignof  _Alignof");
-            break;
-        case TOK__ATOMIC:
-            strcpy(dst, "_Atomic  _Atomic");
-            break;
-        case TOK__BOOL:
-            strcpy(dst, "_Bool  _Bool");
-            break;
-        case TOK__COMPLEX:
-            strcpy(dst, "_Complex  _Complex");
-            break;
-        case TOK__GENERIC:
-            strcpy(dst, "_Generic  _Generic");
-            break;
-        case TOK__IMAGINARY:
-            strcpy(dst, "_Imaginary  _Imaginary");
-            break;
-        case TOK__NORETURN:
-            strcpy(dst, "_Noreturn  _Noreturn");
-            break;
-        case TOK__STATIC_ASSERT:
-            strcpy(dst, "_Static_assert  _Static_assert");
-            break;
-        case TOK__THREAD_LOCAL:
-            strcpy(dst, "_Thread_local  _Thread_local");
-            break;
-
-        case TOK_CHAR_LIT:
-            strcpy(dst, "char_constant  ");
-            strcat(dst, (src + token.loc));
-            break;
-        case TOK_STR_LIT:
-            strcpy(dst, "string_literal  ");
-            strcat(dst, (src + token.loc));
-            break;
-        case TOK_IDENT:
-            strcpy(dst, "identifier  ");
-            strcat(dst, (src + token.loc));
-            break;
-        case TOK_NUM:
-            strcpy(dst, "numeric_constant  ");
-            strcat(dst, (src + token.loc));
-            break;
-
-        case TOK_EOF:
-            strcpy(dst, "eof  ");
-            break;
-
-        default:
-            fprintf(stderr, "Invalid token type.\n");
-            strcpy(dst, "");
+    const char *name = token_names[token.type];
+
+    if (name == NULL) {
+        fprintf(stderr, "Invalid token type.\n");
+        strcpy(dst, "");
+        return;
     }
+
+    strcpy(dst, name);
+    strcat(dst, "  ");
+
+    // Punctuators and keywords have a fixed spelling, other tokens are read from the source
+    const char *spelling = token_spellings[token.type];
+    strcat(dst, spelling != NULL ? spelling : src + token.loc);
 }
 
 void print_tokens(const TokenArray tok_array) {
@@ -322,21 +33,87 @@ void print_tokens(const TokenArray tok_array) {
         char *str = malloc(100);
         token_to_string(str, token, tok_array.src);
 
-        printf("<loc:%d> %s\n", token.loc, str);
+        printf("<loc:%d> %s", token.loc, str);
+
+        if (tok_array.symbol_ids != NULL && tok_array.symbol_ids[i] != SYMBOL_NONE) {
+            printf(" <sym:%u>", tok_array.symbol_ids[i]);
+        }
+
+        if (tok_array.bracket_matches != NULL && tok_array.bracket_matches[i] != BRACKET_NONE) {
+            printf(" <match:%u>", tok_array.bracket_matches[i]);
+        }
+
+        if (tok_array.token_flags != NULL) {
+            if (tok_array.token_flags[i] & TOKEN_START_OF_LINE)
+                printf(" [StartOfLine]");
+
+            if (tok_array.token_flags[i] & TOKEN_LEADING_SPACE)
+                printf(" [LeadingSpace]");
+        }
+
+        printf("\n");
 
         free(str);
     }
 }
 
-TokenArray create_empty_token_array(uint64_t capacity) {
-    TokenType *tokens_types;
-    uint32_t *token_locs;
-    const size_t alignment = VECTOR_SIZE;
+void print_token_stats(const TokenStats *stats) {
+    uint64_t keywords = 0;
+
+    for (int type = 0; type < 256; ++type) {
+        if (stats->counts[type] == 0 || token_names[type] == NULL)
+            continue;
+
+        printf("%-24s %lu\n", token_names[type], stats->counts[type]);
+
+        // Keywords are the tokens spelled with letters
+        const char *spelling = token_spellings[type];
+        if (spelling != NULL && (spelling[0] == '_' || isalpha((unsigned char) spelling[0])))
+            keywords += stats->counts[type];
+    }
+
+    const uint64_t idents = stats->counts[TOK_IDENT];
+
+    printf("\nTokens: %lu\n", stats->tokens);
+    printf("Identifiers: %lu\n", idents);
+    printf("Keywords: %lu\n", keywords);
+    printf("Identifiers per keyword: %.3f\n", keywords ? (double) idents / keywords : 0.0);
+    printf("Literal bytes: %lu\n", stats->literal_bytes);
+}
+
+void token_filter_clear(TokenFilter *filter) {
+    memset(filter->bits, 0, sizeof(filter->bits));
+}
+
+void token_filter_add(TokenFilter *filter, TokenType type) {
+    filter->bits[type >> 3] |= 1 << (type & 7);
+}
+
+bool token_filter_has(const TokenFilter *filter, TokenType type) {
+    return (filter->bits[type >> 3] >> (type & 7)) & 1;
+}
+
+bool token_filter_add_name(TokenFilter *filter, const char *name) {
+    bool found = false;
+
+    for (int type = 0; type < 256; ++type) {
+        if (token_names[type] != NULL && strcmp(token_names[type], name) == 0) {
+            token_filter_add(filter, type);
+            found = true;
+        }
+    }
+
+    return found;
+}
+
+TokenArray create_empty_token_array(uint64_t capacity, const AllocPolicy *policy) {
+    const size_t alignment = CACHE_LINE_SIZE;
 
-    int result = posix_memalign((void**)&tokens_types, alignment, capacity * sizeof(TokenType));
-    result |= posix_memalign((void**)&token_locs, alignment, capacity * sizeof(uint32_t));
+    // append_tokens writes whole vectors past the last token
+    TokenType *tokens_types = policy_alloc((capacity + VECTOR_SIZE) * sizeof(TokenType), alignment, policy);
+    uint32_t *token_locs = policy_alloc((capacity + VECTOR_SIZE) * sizeof(uint32_t), alignment, policy);
 
-    if (result) {
+    if (tokens_types == NULL || token_locs == NULL) {
         fprintf(stderr, "Memory allocation failure.\n");
     }
 
@@ -346,6 +123,12 @@ TokenArray create_empty_token_array(uint64_t capacity) {
     tok_array.capacity = capacity;
     tok_array.src = NULL;
     tok_array.size = 0;
+    tok_array.invalid_utf8 = false;
+    tok_array.has_errors = false;
+    tok_array.symbol_ids = NULL;
+    tok_array.bracket_matches = NULL;
+    tok_array.bracket_errors = false;
+    tok_array.token_flags = NULL;
 
     return tok_array;
 }
@@ -362,12 +145,13 @@ void append_tokens(TokenArray *tok_array, __m256i types, __m256i locs, int size,
         types
     );
 
-    uint64_t *locs_64 = (uint64_t*) &locs;
+    uint64_t locs_64[4];
+    memcpy(locs_64, &locs, sizeof(locs));   // Reading through a casted pointer breaks strict aliasing once inlined
     __m256i start_idx_vec = _mm256_set1_epi32(start_idx);
 
     for (uint8_t i = 0; i < 4 && size > 0; ++i) {
         __m256i locs_expanded = _mm256_cvtepu8_epi32(
-            _mm_set_epi64x(0, *(locs_64 + i))   // Set lower 64 bits to current locations
+            _mm_set_epi64x(0, locs_64[i])   // Set lower 64 bits to current locations
         );
 
         locs_expanded = _mm256_add_epi32(
@@ -387,7 +171,62 @@ void append_tokens(TokenArray *tok_array, __m256i types, __m256i locs, int size,
     tok_array->size += size;    // Adjust size
 }
 
+void append_tokens_streamed(TokenArray *tok_array, TokenStage *stage, __m256i types, __m256i locs, int size,
+                            uint32_t start_idx) {
+    TokenArray staged = {0};
+    staged.size = stage->size;
+    staged.token_types = stage->types;
+    staged.token_locs = stage->locs;
+
+    append_tokens(&staged, types, locs, size, start_idx);
+    stage->size = staged.size;
+
+    if (stage->size < TOKEN_STAGE_SIZE)
+        return;
+
+    // One cache line of types and four of locations, aligned since the array only grows by TOKEN_STAGE_SIZE
+    __m256i *types_dst = (__m256i *) (tok_array->token_types + tok_array->size);
+    __m256i *locs_dst = (__m256i *) (tok_array->token_locs + tok_array->size);
+
+    for (int i = 0; i < TOKEN_STAGE_SIZE / VECTOR_SIZE; ++i) {
+        _mm256_stream_si256(types_dst + i, _mm256_load_si256((const __m256i *) stage->types + i));
+    }
+
+    for (int i = 0; i < TOKEN_STAGE_SIZE / 8; ++i) {
+        _mm256_stream_si256(locs_dst + i, _mm256_load_si256((const __m256i *) stage->locs + i));
+    }
+
+    tok_array->size += TOKEN_STAGE_SIZE;
+    stage->size -= TOKEN_STAGE_SIZE;
+
+    // Move the rest, less than VECTOR_SIZE tokens, to the front
+    _mm256_store_si256(
+        (__m256i *) stage->types,
+        _mm256_load_si256((const __m256i *) (stage->types + TOKEN_STAGE_SIZE))
+    );
+
+    for (int i = 0; i < VECTOR_SIZE; i += 8) {
+        _mm256_store_si256(
+            (__m256i *) (stage->locs + i),
+            _mm256_load_si256((const __m256i *) (stage->locs + TOKEN_STAGE_SIZE + i))
+        );
+    }
+}
+
+void finish_token_stage(TokenArray *tok_array, TokenStage *stage) {
+    memcpy(tok_array->token_types + tok_array->size, stage->types, stage->size * sizeof(TokenType));
+    memcpy(tok_array->token_locs + tok_array->size, stage->locs, stage->size * sizeof(uint32_t));
+
+    tok_array->size += stage->size;
+    stage->size = 0;
+
+    _mm_sfence();
+}
+
 void free_token_array(TokenArray tok_list) {
     free(tok_list.token_types);
     free(tok_list.token_locs);
+    free(tok_list.symbol_ids);
+    free(tok_list.bracket_matches);
+    free(tok_list.token_flags);
 }
@@ -0,0 +1,382 @@
+#include "tune.h"
+
+#include <cpuid.h>
+#include <float.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "tokens.h"
+
+#define TUNE_ROUNDS 64          // Passes over the sample per timing
+#define TUNE_REPEAT 5           // Timings per variant, the fastest one counts
+
+typedef struct PextVariant PextVariant;
+struct PextVariant {
+    const char *name;
+    void (*fn)(__m256i *vector, __m256i mask, int *size);
+};
+
+typedef struct RangeVariant RangeVariant;
+struct RangeVariant {
+    const char *name;
+    __m256i (*fn)(__m128i ranges, __m256i vector, int num_ranges);
+};
+
+static const PextVariant pext_variants[] = {
+    {"bmi2", mm256_pext_bmi2},
+    {"shuffle", mm256_pext_shuffle}
+};
+
+static const RangeVariant range_variants[] = {
+    {"sse42", mm256_cmpistrm_range_sse42},
+    {"compare", mm256_cmpistrm_range_compare}
+};
+
+#define PEXT_VARIANTS (int) (sizeof(pext_variants) / sizeof(pext_variants[0]))
+#define RANGE_VARIANTS (int) (sizeof(range_variants) / sizeof(range_variants[0]))
+
+Kernels kernels = {
+    mm256_pext_bmi2,
+    mm256_cmpistrm_range_sse42
+};
+
+static int pext_choice = 0;
+static int range_choice = 0;
+
+// Shuffle indices that pack the selected bytes of 8, 0x80 clears the rest
+static uint64_t pext_shuffles[256];
+
+// Built-in sample, a bit of everything the lexer sees
+static const char sample[] __attribute__((aligned(VECTOR_SIZE))) =
+    "#include <stdio.h>\n"
+    "\n"
+    "/* Count words of a line, skipping white space. */\n"
+    "static int count_words(const char *line, unsigned long size) {\n"
+    "    int words = 0;\n"
+    "    for (unsigned long i = 0; i < size; ++i) {\n"
+    "        if (line[i] != ' ' && (i == 0 || line[i - 1] == ' '))\n"
+    "            ++words;    // Start of a word\n"
+    "    }\n"
+    "    return words * 0x10 + 1.5e3f - 'a';\n"
+    "}\n"
+    "\n"
+    "int main(int argc, char **argv) {\n"
+    "    const char *text = argc > 1 ? argv[1] : \"hello, world\";\n"
+    "    printf(\"%d words\\n\", count_words(text, 12UL));\n"
+    "    return 0;\n"
+    "}\n";
+
+#define SAMPLE_VECTORS (int) (sizeof(sample) / VECTOR_SIZE)
+
+static volatile uint64_t sink;  // Keeps the timed results alive
+
+static pthread_once_t tune_once = PTHREAD_ONCE_INIT;
+static const char *tune_cache_path;
+
+void mm256_pext_bmi2(__m256i *vector, __m256i mask, int *size) {
+    uint64_t mask_u64[4] __attribute__((aligned(32)));
+    uint64_t vector_u64[4] __attribute__((aligned(32)));
+    uint8_t result[32] __attribute__((aligned(32)));
+
+    _mm256_store_si256((__m256i*)mask_u64, mask);
+    _mm256_store_si256((__m256i*)vector_u64, *vector);
+
+    *size = 0;
+    for (int i = 0; i < 4; ++i) {
+        const uint64_t temp = _pext_u64(vector_u64[i], mask_u64[i]);
+        memcpy(result + *size, &temp, sizeof(uint64_t));
+        *size += _mm_popcnt_u64(mask_u64[i]) >> 3;
+    }
+
+    *vector = _mm256_load_si256((__m256i*)result);
+}
+
+void mm256_pext_shuffle(__m256i *vector, __m256i mask, int *size) {
+    uint64_t vector_u64[4] __attribute__((aligned(32)));
+    uint8_t result[32] __attribute__((aligned(32)));
+
+    _mm256_store_si256((__m256i*)vector_u64, *vector);
+    const uint32_t bits = _mm256_movemask_epi8(mask);
+
+    *size = 0;
+    for (int i = 0; i < 4; ++i) {
+        const uint8_t byte_mask = bits >> (8 * i);
+
+        const __m128i packed = _mm_shuffle_epi8(
+            _mm_cvtsi64_si128((long long) vector_u64[i]),
+            _mm_cvtsi64_si128((long long) pext_shuffles[byte_mask])
+        );
+
+        _mm_storel_epi64((__m128i *) (result + *size), packed);
+        *size += _mm_popcnt_u32(byte_mask);
+    }
+
+    *vector = _mm256_load_si256((__m256i*)result);
+}
+
+__m256i mm256_cmpistrm_range_sse42(__m128i ranges, __m256i vector, int num_ranges) {
+    // Split vector in two for `_mm_cmpistrm`
+    __m128i low_vector = _mm256_extractf128_si256(vector, 0);
+    __m128i high_vector = _mm256_extractf128_si256(vector, 1);
+
+    __m128i low_outside_range_mask = _mm_cmpestrm(ranges, num_ranges, low_vector, 16, (1 << 6) | (1 << 2));
+    __m128i high_outside_range_mask = _mm_cmpestrm(ranges, num_ranges, high_vector, 16, (1 << 6) | (1 << 2));
+
+    return _mm256_set_m128i(
+        high_outside_range_mask,
+        low_outside_range_mask
+    );
+}
+
+__m256i mm256_cmpistrm_range_compare(__m128i ranges, __m256i vector, int num_ranges) {
+    uint8_t bounds[16];
+    _mm_storeu_si128((__m128i *) bounds, ranges);
+
+    __m256i in_ranges = _mm256_setzero_si256();
+
+    // Same pairing as _mm_cmpestrm, a trailing lower bound is ignored
+    for (int i = 0; i + 1 < num_ranges; i += 2) {
+        const __m256i above = _mm256_cmpeq_epi8(_mm256_max_epu8(vector, _mm256_set1_epi8(bounds[i])), vector);
+        const __m256i below = _mm256_cmpeq_epi8(_mm256_min_epu8(vector, _mm256_set1_epi8(bounds[i + 1])), vector);
+
+        in_ranges = _mm256_or_si256(in_ranges, _mm256_and_si256(above, below));
+    }
+
+    return in_ranges;
+}
+
+static void init_pext_shuffles(void) {
+    for (int mask = 0; mask < 256; ++mask) {
+        uint64_t indices = 0x8080808080808080;
+        int size = 0;
+
+        for (int i = 0; i < 8; ++i) {
+            if (mask & (1 << i)) {
+                indices &= ~(0xffULL << (8 * size));
+                indices |= (uint64_t) i << (8 * size);
+                ++size;
+            }
+        }
+
+        pext_shuffles[mask] = indices;
+    }
+}
+
+static double now_ns(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+
+    return time.tv_sec * 1e9 + time.tv_nsec;
+}
+
+static double time_pext(void (*pext)(__m256i *vector, __m256i mask, int *size)) {
+    double best = DBL_MAX;
+
+    for (int r = 0; r < TUNE_REPEAT; ++r) {
+        const double start = now_ns();
+        __m256i acc = _mm256_setzero_si256();
+        int total = 0;
+
+        for (int round = 0; round < TUNE_ROUNDS; ++round) {
+            for (int v = 0; v < SAMPLE_VECTORS; ++v) {
+                __m256i vector = _mm256_load_si256((const __m256i *) (sample + v * VECTOR_SIZE));
+
+                // Bytes other than white space, about as dense as token starts and kept characters
+                const __m256i mask = _mm256_cmpgt_epi8(vector, _mm256_set1_epi8(' '));
+
+                int size;
+                pext(&vector, mask, &size);
+
+                acc = _mm256_xor_si256(acc, vector);
+                total += size;
+            }
+        }
+
+        sink = _mm256_movemask_epi8(acc) + total;
+
+        const double elapsed = now_ns() - start;
+        best = elapsed < best ? elapsed : best;
+    }
+
+    return best;
+}
+
+static double time_range(__m256i (*cmpistrm_range)(__m128i ranges, __m256i vector, int num_ranges)) {
+    // Identifier characters, the 8 byte case used by the lexer
+    const __m128i ranges = _mm_setr_epi8('a', 'z', 'A', 'Z', '0', '9', '_', '_', 0, 0, 0, 0, 0, 0, 0, 0);
+    double best = DBL_MAX;
+
+    for (int r = 0; r < TUNE_REPEAT; ++r) {
+        const double start = now_ns();
+        __m256i acc = _mm256_setzero_si256();
+
+        for (int round = 0; round < TUNE_ROUNDS; ++round) {
+            for (int v = 0; v < SAMPLE_VECTORS; ++v) {
+                const __m256i vector = _mm256_load_si256((const __m256i *) (sample + v * VECTOR_SIZE));
+
+                // Range counts used by the sub lexers
+                acc = _mm256_xor_si256(acc, cmpistrm_range(ranges, vector, 2));
+                acc = _mm256_xor_si256(acc, cmpistrm_range(ranges, vector, 4));
+                acc = _mm256_xor_si256(acc, cmpistrm_range(ranges, vector, 8));
+            }
+        }
+
+        sink = _mm256_movemask_epi8(acc);
+
+        const double elapsed = now_ns() - start;
+        best = elapsed < best ? elapsed : best;
+    }
+
+    return best;
+}
+
+void cpu_name(char name[CPU_NAME_SIZE]) {
+    unsigned int regs[12] = {0};
+    unsigned int max_leaf, ebx, ecx, edx;
+
+    if (__get_cpuid(0x80000000, &max_leaf, &ebx, &ecx, &edx) && max_leaf >= 0x80000004) {
+        for (unsigned int i = 0; i < 3; ++i) {
+            __get_cpuid(0x80000002 + i, &regs[4 * i], &regs[4 * i + 1], &regs[4 * i + 2], &regs[4 * i + 3]);
+        }
+    }
+
+    memcpy(name, regs, CPU_NAME_SIZE - 1);
+    name[CPU_NAME_SIZE - 1] = '\0';
+
+    // One line in cache and baseline files
+    for (char *c = name; *c; ++c) {
+        if (*c == '\n')
+            *c = ' ';
+    }
+}
+
+static int find_pext(const char *name) {
+    for (int i = 0; i < PEXT_VARIANTS; ++i) {
+        if (strcmp(pext_variants[i].name, name) == 0)
+            return i;
+    }
+
+    return -1;
+}
+
+static int find_range(const char *name) {
+    for (int i = 0; i < RANGE_VARIANTS; ++i) {
+        if (strcmp(range_variants[i].name, name) == 0)
+            return i;
+    }
+
+    return -1;
+}
+
+// Choice of a previous run on the same CPU model, false if missing or stale
+static bool read_cache(const char *path, const char *cpu) {
+    FILE *file = fopen(path, "r");
+    if (!file)
+        return false;
+
+    char line[128];
+    char cached_cpu[CPU_NAME_SIZE] = "";
+    char pext[32] = "";
+    char range[32] = "";
+
+    while (fgets(line, sizeof(line), file)) {
+        line[strcspn(line, "\n")] = '\0';
+
+        if (strncmp(line, "cpu ", 4) == 0) {
+            snprintf(cached_cpu, sizeof(cached_cpu), "%.48s", line + 4);
+        } else {
+            sscanf(line, "pext %31s", pext);
+            sscanf(line, "cmpistrm_range %31s", range);
+        }
+    }
+
+    fclose(file);
+
+    const int pext_index = find_pext(pext);
+    const int range_index = find_range(range);
+
+    if (strcmp(cached_cpu, cpu) != 0 || pext_index < 0 || range_index < 0)
+        return false;
+
+    pext_choice = pext_index;
+    range_choice = range_index;
+
+    return true;
+}
+
+static void write_cache(const char *path, const char *cpu) {
+    FILE *file = fopen(path, "w");
+    if (!file) {
+        fprintf(stderr, "Could not write the kernel cache.\n");
+        return;
+    }
+
+    fprintf(file, "cpu %s\n", cpu);
+    fprintf(file, "pext %s\n", pext_variants[pext_choice].name);
+    fprintf(file, "cmpistrm_range %s\n", range_variants[range_choice].name);
+
+    fclose(file);
+}
+
+static void calibrate(void) {
+    double best = DBL_MAX;
+
+    for (int i = 0; i < PEXT_VARIANTS; ++i) {
+        const double elapsed = time_pext(pext_variants[i].fn);
+
+        if (elapsed < best) {
+            best = elapsed;
+            pext_choice = i;
+        }
+    }
+
+    best = DBL_MAX;
+
+    for (int i = 0; i < RANGE_VARIANTS; ++i) {
+        const double elapsed = time_range(range_variants[i].fn);
+
+        if (elapsed < best) {
+            best = elapsed;
+            range_choice = i;
+        }
+    }
+}
+
+static void run_tuning(void) {
+    init_pext_shuffles();
+
+    char cpu[CPU_NAME_SIZE];
+    cpu_name(cpu);
+
+    if (tune_cache_path == NULL || !read_cache(tune_cache_path, cpu)) {
+        calibrate();
+
+        if (tune_cache_path != NULL) {
+            write_cache(tune_cache_path, cpu);
+        }
+    }
+
+    kernels.pext = pext_variants[pext_choice].fn;
+    kernels.cmpistrm_range = range_variants[range_choice].fn;
+}
+
+void tune_kernels(const char *cache_path) {
+    // Only the first caller's cache path is used
+    if (tune_cache_path == NULL) {
+        tune_cache_path = cache_path;
+    }
+
+    pthread_once(&tune_once, run_tuning);
+}
+
+const char *tuned_kernel_names(void) {
+    static char names[64];
+
+    snprintf(names, sizeof(names), "pext=%s cmpistrm_range=%s", pext_variants[pext_choice].name,
+             range_variants[range_choice].name);
+
+    return names;
+}
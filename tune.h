@@ -0,0 +1,66 @@
+#ifndef TUNE_H
+#define TUNE_H
+
+#include <immintrin.h>
+#include <stdbool.h>
+
+#define CPU_NAME_SIZE 49        // Brand string of cpuid leaves 0x80000002-4, NUL included
+
+/**
+ * Implementations of the primitives whose speed depends on the CPU,
+ *  called through mm256_pext and mm256_cmpistrm_range. Starts with the
+ *  BMI2 and SSE4.2 variants, tune_kernels binds the fastest ones.
+ */
+typedef struct Kernels Kernels;
+struct Kernels {
+    void (*pext)(__m256i *vector, __m256i mask, int *size);
+    __m256i (*cmpistrm_range)(__m128i ranges, __m256i vector, int num_ranges);
+};
+
+extern Kernels kernels;
+
+/**
+ * mm256_pext with _pext_u64, microcoded on AMD before Zen 3.
+ */
+void mm256_pext_bmi2(__m256i *vector, __m256i mask, int *size);
+
+/**
+ * mm256_pext with one shuffle per 8 bytes, indices from a 256 entry table.
+ */
+void mm256_pext_shuffle(__m256i *vector, __m256i mask, int *size);
+
+/**
+ * mm256_cmpistrm_range with _mm_cmpestrm on each half.
+ */
+__m256i mm256_cmpistrm_range_sse42(__m128i ranges, __m256i vector, int num_ranges);
+
+/**
+ * mm256_cmpistrm_range with an unsigned min/max compare per range.
+ */
+__m256i mm256_cmpistrm_range_compare(__m128i ranges, __m256i vector, int num_ranges);
+
+/**
+ * Bind the fastest variant of each kernel. The first call times every
+ *  variant on a built-in sample, later calls do nothing. The choice is
+ *  read from the cache file if it was written on the same CPU model,
+ *  otherwise it is stored there for the next run.
+ *
+ * @param cache_path Cache file, NULL to always calibrate.
+ */
+void tune_kernels(const char *cache_path);
+
+/**
+ * CPU model that keys the tune cache, and the perf baselines.
+ *
+ * @param name Where the brand string is stored, empty if unknown.
+ */
+void cpu_name(char name[CPU_NAME_SIZE]);
+
+/**
+ * Names of the bound variants, e.g. "pext=shuffle cmpistrm_range=sse42".
+ *
+ * @return Static string.
+ */
+const char *tuned_kernel_names(void);
+
+#endif //TUNE_H
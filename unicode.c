@@ -0,0 +1,247 @@
+#include "unicode.h"
+
+// Error bits of the lookup tables
+#define TOO_SHORT       (1 << 0)    // 11______ 0_______ / 11______ 11______
+#define TOO_LONG        (1 << 1)    // 0_______ 10______
+#define OVERLONG_3      (1 << 2)    // 11100000 100_____
+#define TOO_LARGE       (1 << 3)    // 11110100 1001____ ... 11111___ 10______
+#define SURROGATE       (1 << 4)    // 11101101 101_____
+#define OVERLONG_2      (1 << 5)    // 1100000_ 10______
+#define TOO_LARGE_1000  (1 << 6)    // 11110101 1000____ ...
+#define OVERLONG_4      (1 << 6)    // 11110000 1000____
+#define TWO_CONTS       (1 << 7)    // 10______ 10______
+#define CARRY           (TOO_SHORT | TOO_LONG | TWO_CONTS)
+
+static __m256i prev_n(const __m256i input, const __m256i prev_input, const int n) {
+    const __m256i prev_lanes = _mm256_permute2x128_si256(prev_input, input, 0x21);
+
+    switch (n) {
+        case 1: return _mm256_alignr_epi8(input, prev_lanes, 15);
+        case 2: return _mm256_alignr_epi8(input, prev_lanes, 14);
+        default: return _mm256_alignr_epi8(input, prev_lanes, 13);
+    }
+}
+
+static __m256i high_nibbles(const __m256i vector) {
+    return _mm256_and_si256(_mm256_srli_epi16(vector, 4), _mm256_set1_epi8(0x0F));
+}
+
+static __m256i special_cases(const __m256i input, const __m256i prev1) {
+    const __m256i byte_1_high = _mm256_shuffle_epi8(
+        _mm256_setr_epi8(
+            TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+            TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+            TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+            TOO_SHORT | OVERLONG_2,
+            TOO_SHORT,
+            TOO_SHORT | OVERLONG_3 | SURROGATE,
+            TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4,
+
+            TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+            TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+            TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+            TOO_SHORT | OVERLONG_2,
+            TOO_SHORT,
+            TOO_SHORT | OVERLONG_3 | SURROGATE,
+            TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4
+        ),
+        high_nibbles(prev1)
+    );
+
+    const __m256i byte_1_low = _mm256_shuffle_epi8(
+        _mm256_setr_epi8(
+            CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4,
+            CARRY | OVERLONG_2,
+            CARRY,
+            CARRY,
+            CARRY | TOO_LARGE,
+            CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE,
+            CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000,
+
+            CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4,
+            CARRY | OVERLONG_2,
+            CARRY,
+            CARRY,
+            CARRY | TOO_LARGE,
+            CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE,
+            CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000
+        ),
+        _mm256_and_si256(prev1, _mm256_set1_epi8(0x0F))
+    );
+
+    const __m256i byte_2_high = _mm256_shuffle_epi8(
+        _mm256_setr_epi8(
+            TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+            TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+            TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4,
+            TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+            TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+            TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+            TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+
+            TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+            TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+            TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4,
+            TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+            TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+            TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+            TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT
+        ),
+        high_nibbles(input)
+    );
+
+    return _mm256_and_si256(_mm256_and_si256(byte_1_high, byte_1_low), byte_2_high);
+}
+
+static __m256i multibyte_lengths(const __m256i input, const __m256i prev_input, const __m256i special) {
+    const __m256i prev2 = prev_n(input, prev_input, 2);
+    const __m256i prev3 = prev_n(input, prev_input, 3);
+
+    // Bytes that must be the 3rd or 4th byte of a code point have their high bit set here
+    const __m256i is_third_byte = _mm256_subs_epu8(prev2, _mm256_set1_epi8((char) (0xE0 - 0x80)));
+    const __m256i is_fourth_byte = _mm256_subs_epu8(prev3, _mm256_set1_epi8((char) (0xF0 - 0x80)));
+
+    const __m256i must_be_continuation = _mm256_and_si256(
+        _mm256_or_si256(is_third_byte, is_fourth_byte),
+        _mm256_set1_epi8((char) 0x80)
+    );
+
+    return _mm256_xor_si256(must_be_continuation, special);
+}
+
+static __m256i is_incomplete(const __m256i input) {
+    // Lead bytes too close to the end of the block
+    const __m256i max_value = _mm256_setr_epi8(
+        -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, (char) (0xF0 - 1), (char) (0xE0 - 1), (char) (0xC0 - 1)
+    );
+
+    return _mm256_subs_epu8(input, max_value);
+}
+
+void utf8_check_init(Utf8Checker *checker) {
+    checker->error = _mm256_setzero_si256();
+    checker->prev_input = _mm256_setzero_si256();
+    checker->prev_incomplete = _mm256_setzero_si256();
+}
+
+void utf8_check_block(Utf8Checker *checker, const __m256i input) {
+    // ASCII fast path
+    if (_mm256_movemask_epi8(input) == 0) {
+        checker->error = _mm256_or_si256(checker->error, checker->prev_incomplete);
+        checker->prev_incomplete = _mm256_setzero_si256();
+        checker->prev_input = input;
+        return;
+    }
+
+    const __m256i prev1 = prev_n(input, checker->prev_input, 1);
+    const __m256i special = special_cases(input, prev1);
+
+    checker->error = _mm256_or_si256(
+        checker->error,
+        multibyte_lengths(input, checker->prev_input, special)
+    );
+
+    checker->prev_incomplete = is_incomplete(input);
+    checker->prev_input = input;
+}
+
+bool utf8_check_finish(Utf8Checker *checker) {
+    checker->error = _mm256_or_si256(checker->error, checker->prev_incomplete);
+
+    return _mm256_testz_si256(checker->error, checker->error);
+}
+
+int utf8_decode(const uint8_t *src, uint32_t *cp) {
+    const uint8_t lead = src[0];
+
+    if (lead < 0x80) {
+        *cp = lead;
+        return 1;
+    }
+
+    int len;
+    uint32_t min;
+
+    if ((lead & 0xE0) == 0xC0) {
+        len = 2;
+        min = 0x80;
+        *cp = lead & 0x1F;
+    } else if ((lead & 0xF0) == 0xE0) {
+        len = 3;
+        min = 0x800;
+        *cp = lead & 0x0F;
+    } else if ((lead & 0xF8) == 0xF0) {
+        len = 4;
+        min = 0x10000;
+        *cp = lead & 0x07;
+    } else {
+        return 0;   // Continuation or invalid lead byte
+    }
+
+    for (int i = 1; i < len; ++i) {
+        if ((src[i] & 0xC0) != 0x80)
+            return 0;
+
+        *cp = (*cp << 6) | (src[i] & 0x3F);
+    }
+
+    // Overlong encodings, surrogates and code points past U+10FFFF
+    if (*cp < min || (*cp >= 0xD800 && *cp <= 0xDFFF) || *cp > 0x10FFFF)
+        return 0;
+
+    return len;
+}
+
+static bool in_ranges(const uint32_t ranges[][2], const int size, const uint32_t cp) {
+    int lo = 0;
+    int hi = size - 1;
+
+    while (lo <= hi) {
+        const int mid = (lo + hi) / 2;
+
+        if (cp < ranges[mid][0]) {
+            hi = mid - 1;
+        } else if (cp > ranges[mid][1]) {
+            lo = mid + 1;
+        } else {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool is_xid_start(uint32_t cp) {
+    if (cp < 0x80)
+        return (cp >= 'A' && cp <= 'Z') || (cp >= 'a' && cp <= 'z') || cp == '_';
+
+    return in_ranges(xid_start_ranges, xid_start_ranges_size, cp);
+}
+
+bool is_xid_continue(uint32_t cp) {
+    if (cp < 0x80)
+        return (cp >= '0' && cp <= '9') || (cp >= 'A' && cp <= 'Z') || (cp >= 'a' && cp <= 'z') || cp == '_';
+
+    return in_ranges(xid_continue_ranges, xid_continue_ranges_size, cp);
+}
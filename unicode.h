@@ -0,0 +1,56 @@
+#ifndef UNICODE_H
+#define UNICODE_H
+
+#include <immintrin.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+extern const uint32_t xid_start_ranges[][2];
+extern const int xid_start_ranges_size;
+extern const uint32_t xid_continue_ranges[][2];
+extern const int xid_continue_ranges_size;
+
+/**
+ * Streaming UTF-8 validator state (lookup approach of Keiser & Lemire,
+ *  "Validating UTF-8 In Less Than One Instruction Per Byte").
+ */
+typedef struct Utf8Checker Utf8Checker;
+struct Utf8Checker {
+    __m256i error;              // Accumulated error bits
+    __m256i prev_input;         // Previous block of input
+    __m256i prev_incomplete;    // Non-zero if previous block ends mid code point
+};
+
+void utf8_check_init(Utf8Checker *checker);
+
+/**
+ * Validate the next block of input. Errors are accumulated and only
+ *  checked by utf8_check_finish.
+ *
+ * @param checker Validator state.
+ * @param input A __m256i vector with the next 32 bytes of input.
+ */
+void utf8_check_block(Utf8Checker *checker, const __m256i input);
+
+/**
+ * Finish validation at the end of input.
+ *
+ * @param checker Validator state.
+ * @return True if all input was valid UTF-8.
+ */
+bool utf8_check_finish(Utf8Checker *checker);
+
+/**
+ * Decode one UTF-8 encoded code point.
+ *
+ * @param src Pointer to the lead byte.
+ * @param cp Pointer where the code point is stored.
+ * @return Length of the encoding, or 0 if it is invalid.
+ */
+int utf8_decode(const uint8_t *src, uint32_t *cp);
+
+bool is_xid_start(uint32_t cp);
+
+bool is_xid_continue(uint32_t cp);
+
+#endif //UNICODE_H